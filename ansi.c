@@ -0,0 +1,367 @@
+/*
+	ansi.c
+
+	Table-driven ANSI/VT100 escape-sequence parser. putc() hands every
+	character to ansi_putc() first; plain text falls straight through,
+	while ESC [ ... sequences move the cursor, erase parts of the screen
+	or change the terminal's current color (which replaced ATTRIB).
+
+	Supported CSI sequences:
+		n A / n B / n C / n D  - cursor up / down / forward / back
+		row ; col H (or f)     - cursor position (1-based)
+		n J                    - erase in display (0 = to end, 1 = to cursor, 2 = all)
+		n K                    - erase in line (0 = to end, 1 = to cursor, 2 = all)
+		p ; p ... m            - SGR colors (0, 1, 7, 22, 27, 30-37, 39, 40-47, 49, 90-97)
+		s / u                  - save / restore cursor
+*/
+
+#include "ansi.h"
+#include "terminal.h"
+
+/* character classes the transition table is indexed by */
+#define CLASS_ESC 			0
+#define CLASS_BRACKET 		1
+#define CLASS_DIGIT 		2
+#define CLASS_SEMI 			3
+#define CLASS_FINAL 		4
+#define CLASS_OTHER 		5
+#define NUM_CLASSES 		6
+
+/* actions performed on a transition */
+#define ACT_PRINT 			0 	/* not part of a sequence, let putc() print it */
+#define ACT_NONE 			1 	/* swallow the character */
+#define ACT_START 			2 	/* start a new CSI, clear parameters */
+#define ACT_DIGIT 			3 	/* accumulate a parameter digit */
+#define ACT_SEP 			4 	/* move on to the next parameter */
+#define ACT_DISPATCH 		5 	/* execute the sequence */
+
+#define FINAL_MIN 			0x40
+#define FINAL_MAX 			0x7E
+#define NUM_ANSI_COLORS 	8
+
+/* SGR codes */
+#define SGR_RESET 			0
+#define SGR_BOLD 			1
+#define SGR_REVERSE 		7
+#define SGR_NORMAL 			22
+#define SGR_NO_REVERSE 		27
+#define SGR_FG 				30
+#define SGR_FG_DEFAULT 		39
+#define SGR_BG 				40
+#define SGR_BG_DEFAULT 		49
+#define SGR_FG_BRIGHT 		90
+
+typedef struct ansi_transition_t {
+	uint8_t next;
+	uint8_t action;
+} ansi_transition_t;
+
+/* the state machine: ansi_table[state][class] */
+static const ansi_transition_t ansi_table[ANSI_NUM_STATES][NUM_CLASSES] = {
+	/* ANSI_GROUND */
+	{ {ANSI_ESCAPE, ACT_NONE},  {ANSI_GROUND, ACT_PRINT}, {ANSI_GROUND, ACT_PRINT},
+	  {ANSI_GROUND, ACT_PRINT}, {ANSI_GROUND, ACT_PRINT}, {ANSI_GROUND, ACT_PRINT} },
+	/* ANSI_ESCAPE */
+	{ {ANSI_ESCAPE, ACT_NONE},  {ANSI_CSI, ACT_START},    {ANSI_GROUND, ACT_NONE},
+	  {ANSI_GROUND, ACT_NONE},  {ANSI_GROUND, ACT_NONE},  {ANSI_GROUND, ACT_NONE} },
+	/* ANSI_CSI */
+	{ {ANSI_ESCAPE, ACT_NONE},  {ANSI_GROUND, ACT_NONE},  {ANSI_CSI, ACT_DIGIT},
+	  {ANSI_CSI, ACT_SEP},      {ANSI_GROUND, ACT_DISPATCH}, {ANSI_CSI, ACT_NONE} }
+};
+
+/* ANSI color order (black, red, green, yellow, blue, magenta, cyan, white) to VGA order */
+static const uint8_t ansi_to_vga[NUM_ANSI_COLORS] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+/*
+	classify()
+
+	Description: maps a character to its column in ansi_table
+	Inputs: c = character
+	Outputs: CLASS_* value
+*/
+static int classify(uint8_t c)
+{
+	if( c == ANSI_ESC )
+		return CLASS_ESC;
+	if( c == '[' )
+		return CLASS_BRACKET;
+	if( c >= '0' && c <= '9' )
+		return CLASS_DIGIT;
+	if( c == ';' )
+		return CLASS_SEMI;
+	if( c >= FINAL_MIN && c <= FINAL_MAX )
+		return CLASS_FINAL;
+	return CLASS_OTHER;
+}
+
+/*
+	ansi_param()
+
+	Description: returns parameter i, or def if it is missing or 0
+*/
+static int ansi_param(ansi_state_t* st, int i, int def)
+{
+	if( i >= st->num_params || st->params[i] == 0 )
+		return def;
+	return st->params[i];
+}
+
+/*
+	clamp_cursor()
+
+	Description: keeps a terminal's cursor on the screen after a move
+	Inputs: term_num = terminal number
+*/
+static void clamp_cursor(int term_num)
+{
+	terminal_t* t = &terminals[term_num];
+
+	if( t->screen_x < 0 )
+		t->screen_x = 0;
+	if( t->screen_x > screen_cols - 1 )
+		t->screen_x = screen_cols - 1;
+	if( t->screen_y < 0 )
+		t->screen_y = 0;
+	if( t->screen_y > screen_rows - 1 )
+		t->screen_y = screen_rows - 1;
+
+	/* output moved the cursor, don't let the user backspace over it */
+	t->line_flag = t->screen_y;
+	t->term_write_flag = t->screen_x;
+}
+
+/*
+	ansi_sgr()
+
+	Description: applies a Select Graphic Rendition sequence to the
+				 terminal's current attribute byte
+	Inputs: term_num = terminal number
+*/
+static void ansi_sgr(int term_num)
+{
+	terminal_t* t = &terminals[term_num];
+	ansi_state_t* st = &t->ansi;
+	uint8_t attrib = t->attrib;
+	int i;
+	int p;
+
+	/* "ESC [ m" is the same as "ESC [ 0 m" */
+	if( st->num_params == 0 )
+		st->num_params = 1;
+
+	for( i = 0; i < st->num_params; i++ )
+	{
+		p = st->params[i];
+
+		if( p == SGR_RESET )
+		{
+			attrib = ATTRIB;
+			st->reverse = 0;
+		}
+		else if( p == SGR_BOLD )
+			attrib |= ATTRIB_BRIGHT;
+		else if( p == SGR_NORMAL )
+			attrib &= ~ATTRIB_BRIGHT;
+		else if( (p == SGR_REVERSE && !st->reverse) || (p == SGR_NO_REVERSE && st->reverse) )
+		{
+			/* only a change of state swaps: 7 twice stays reversed */
+			attrib = (uint8_t)(((attrib & ATTRIB_FG_MASK) << ATTRIB_BG_SHIFT) | ((attrib & ATTRIB_BG_MASK) >> ATTRIB_BG_SHIFT));
+			st->reverse = !st->reverse;
+		}
+		else if( p >= SGR_FG && p < SGR_FG + NUM_ANSI_COLORS )
+			attrib = (attrib & ~(ATTRIB_FG_MASK & ~ATTRIB_BRIGHT)) | ansi_to_vga[p - SGR_FG];
+		else if( p == SGR_FG_DEFAULT )
+			attrib = (attrib & ~ATTRIB_FG_MASK) | (ATTRIB & ATTRIB_FG_MASK);
+		else if( p >= SGR_BG && p < SGR_BG + NUM_ANSI_COLORS )
+			attrib = (attrib & ATTRIB_FG_MASK) | (ansi_to_vga[p - SGR_BG] << ATTRIB_BG_SHIFT);
+		else if( p == SGR_BG_DEFAULT )
+			attrib = (attrib & ATTRIB_FG_MASK) | (ATTRIB & ATTRIB_BG_MASK);
+		else if( p >= SGR_FG_BRIGHT && p < SGR_FG_BRIGHT + NUM_ANSI_COLORS )
+			attrib = (attrib & ~ATTRIB_FG_MASK) | ansi_to_vga[p - SGR_FG_BRIGHT] | ATTRIB_BRIGHT;
+	}
+
+	t->attrib = attrib;
+}
+
+/*
+	ansi_dispatch()
+
+	Description: executes a complete CSI sequence
+	Inputs: final = final character of the sequence
+			term_num = terminal number
+*/
+static void ansi_dispatch(uint8_t final, int term_num)
+{
+	terminal_t* t = &terminals[term_num];
+	ansi_state_t* st = &t->ansi;
+	int cursor = (screen_cols * t->screen_y) + t->screen_x;
+	int line = screen_cols * t->screen_y;
+
+	switch( final )
+	{
+		case 'A':
+			t->screen_y -= ansi_param(st, 0, 1);
+			clamp_cursor(term_num);
+			break;
+
+		case 'B':
+			t->screen_y += ansi_param(st, 0, 1);
+			clamp_cursor(term_num);
+			break;
+
+		case 'C':
+			t->screen_x += ansi_param(st, 0, 1);
+			clamp_cursor(term_num);
+			break;
+
+		case 'D':
+			t->screen_x -= ansi_param(st, 0, 1);
+			clamp_cursor(term_num);
+			break;
+
+		case 'H':
+		case 'f':
+			t->screen_y = ansi_param(st, 0, 1) - 1;
+			t->screen_x = ansi_param(st, 1, 1) - 1;
+			clamp_cursor(term_num);
+			break;
+
+		case 'J':
+			if( st->params[0] == 0 )
+				ansi_erase(term_num, cursor, screen_cols * screen_rows);
+			else if( st->params[0] == 1 )
+				ansi_erase(term_num, 0, cursor + 1);
+			else
+				ansi_erase(term_num, 0, screen_cols * screen_rows);
+			break;
+
+		case 'K':
+			if( st->params[0] == 0 )
+				ansi_erase(term_num, cursor, line + screen_cols);
+			else if( st->params[0] == 1 )
+				ansi_erase(term_num, line, cursor + 1);
+			else
+				ansi_erase(term_num, line, line + screen_cols);
+			break;
+
+		case 'm':
+			ansi_sgr(term_num);
+			break;
+
+		case 's':
+			st->saved_x = t->screen_x;
+			st->saved_y = t->screen_y;
+			break;
+
+		case 'u':
+			t->screen_x = st->saved_x;
+			t->screen_y = st->saved_y;
+			clamp_cursor(term_num);
+			break;
+
+		default:
+			/* unsupported sequence, ignore it */
+			break;
+	}
+}
+
+/*
+	ansi_init()
+
+	Description: resets a terminal's escape parser and color
+	Inputs: term_num = terminal number
+	Outputs: None
+*/
+void ansi_init(int term_num)
+{
+	terminals[term_num].attrib = ATTRIB;
+	memset(&terminals[term_num].ansi, 0, sizeof(ansi_state_t));
+	terminals[term_num].ansi.state = ANSI_GROUND;
+}
+
+/*
+	ansi_putc()
+
+	Description: runs one character through the escape-sequence state machine
+	Inputs: c = character written to the terminal
+			term_num = terminal number
+	Outputs: 1 if the character belonged to an escape sequence, 0 if
+			 putc() should print it
+*/
+int ansi_putc(uint8_t c, int term_num)
+{
+	ansi_state_t* st = &terminals[term_num].ansi;
+	const ansi_transition_t* tr;
+
+	/* fast path for plain text */
+	if( st->state == ANSI_GROUND && c != ANSI_ESC )
+		return 0;
+
+	tr = &ansi_table[st->state][classify(c)];
+	st->state = tr->next;
+
+	switch( tr->action )
+	{
+		case ACT_PRINT:
+			return 0;
+
+		case ACT_START:
+			memset(st->params, 0, sizeof(st->params));
+			st->num_params = 0;
+			break;
+
+		case ACT_DIGIT:
+			if( st->num_params == 0 )
+				st->num_params = 1;
+			if( st->num_params <= ANSI_MAX_PARAMS )
+			{
+				int* p = &st->params[st->num_params - 1];
+
+				*p = (*p * 10) + (c - '0');
+				if( *p > ANSI_MAX_PARAM )
+					*p = ANSI_MAX_PARAM;
+			}
+			break;
+
+		case ACT_SEP:
+			/* an empty leading parameter still counts ("ESC [ ; 5 H") */
+			if( st->num_params == 0 )
+				st->num_params = 1;
+			if( st->num_params < ANSI_MAX_PARAMS )
+				st->num_params++;
+			break;
+
+		case ACT_DISPATCH:
+			ansi_dispatch(c, term_num);
+			break;
+
+		default:
+			break;
+	}
+
+	return 1;
+}
+
+/*
+	ansi_erase()
+
+	Description: blanks a range of cells using the terminal's current color
+	Inputs: term_num = terminal number
+			start = first cell to erase
+			end = one past the last cell to erase
+	Outputs: None
+*/
+void ansi_erase(int term_num, int start, int end)
+{
+	uint16_t blank = (terminals[term_num].attrib << SHIFT_8) | ' ';
+
+	if( start < 0 )
+		start = 0;
+	if( end > screen_cols * screen_rows )
+		end = screen_cols * screen_rows;
+	if( start >= end )
+		return;
+
+	memset_word((uint16_t*)terminals[term_num].vidmem_addr + start, blank, end - start);
+	FBCON_DIRTY(term_num, start, end);
+}
@@ -0,0 +1,47 @@
+/*
+	ansi.h
+
+	ANSI/VT100 escape-sequence parser used by putc()
+*/
+
+#ifndef _ANSI_H
+#define _ANSI_H
+
+#include "types.h"
+
+#define ANSI_ESC 			0x1B
+#define ANSI_MAX_PARAMS 	8
+#define ANSI_MAX_PARAM 		9999 	/* longer digit strings saturate here */
+
+/* parser states */
+#define ANSI_GROUND 		0 	/* plain text */
+#define ANSI_ESCAPE 		1 	/* saw ESC */
+#define ANSI_CSI 			2 	/* saw ESC [ */
+#define ANSI_NUM_STATES 	3
+
+/* VGA attribute byte layout */
+#define ATTRIB_FG_MASK 		0x0F
+#define ATTRIB_BG_MASK 		0xF0
+#define ATTRIB_BRIGHT 		0x08
+#define ATTRIB_BG_SHIFT 	4
+
+/* parser state kept per terminal */
+typedef struct ansi_state_t {
+	int state;                          /* one of the ANSI_* parser states */
+	int params[ANSI_MAX_PARAMS];        /* numeric CSI parameters */
+	int num_params;                     /* number of parameters seen so far */
+	int saved_x;                        /* cursor saved by CSI s */
+	int saved_y;
+	int reverse;                        /* 1 while SGR 7 has swapped fg and bg */
+} ansi_state_t;
+
+/* resets a terminal's parser and colors */
+void ansi_init(int term_num);
+
+/* feeds one character to the parser, returns 1 if it was consumed */
+int ansi_putc(uint8_t c, int term_num);
+
+/* fills cells [start, end) of a terminal with blanks in its current color */
+void ansi_erase(int term_num, int start, int end);
+
+#endif
@@ -0,0 +1,406 @@
+/*
+	apic.c
+
+	Local APIC / I/O APIC interrupt delivery. apic_init() reads the ACPI
+	MADT for the I/O APIC address, the ISA interrupt source overrides
+	(on QEMU the PIT, IRQ 0, arrives on GSI 2) and the list of CPUs, then
+	masks the 8259 and routes the ISA IRQs through the I/O APIC to the
+	vectors the 8259 used, so the IDT doesn't change. enable_irq(),
+	disable_irq() and send_eoi() in i8259.c forward here once it is
+	enabled; EOI becomes a single store to the local APIC instead of one
+	or two port writes.
+*/
+
+#include "apic.h"
+#include "lib.h"
+#include "i8259.h"
+#include "paging.h"
+
+apic_t apic;
+
+/* page directory entries borrowed to read the ACPI tables */
+static uint32_t acpi_window_pde[ACPI_MAX_WINDOWS];
+static uint32_t acpi_window_saved[ACPI_MAX_WINDOWS];
+static int acpi_num_windows;
+/* first-MB pages made present for the RSDP search */
+static uint8_t acpi_low_pages[ACPI_RSDP_END / FOUR_KB];
+
+/*
+	acpi_map()
+
+	Description: makes physical [phys, phys + len) readable at the same
+				 virtual address until acpi_unmap_all()
+	Inputs: phys = physical address, len = bytes
+	Outputs: 0 for success, -1 if out of windows
+*/
+static int acpi_map(uint32_t phys, uint32_t len)
+{
+	uint32_t pde;
+	uint32_t page;
+	int i;
+
+	for( pde = phys / FOUR_MB; pde <= (phys + len - 1) / FOUR_MB; pde++ )
+	{
+		/* the first megabyte is mapped in 4 KB pages */
+		if( pde == 0 )
+		{
+			for( page = phys / FOUR_KB; page <= (phys + len - 1) / FOUR_KB && page < ACPI_RSDP_END / FOUR_KB; page++ )
+			{
+				if( !(page_table[page] & PAGE_PRESENT) )
+				{
+					page_table[page] |= PAGE_PRESENT;
+					acpi_low_pages[page] = 1;
+				}
+			}
+			continue;
+		}
+		/* never touch the kernel's 4 MB page */
+		if( pde == KERNEL_START_ADDR / FOUR_MB )
+			continue;
+
+		for( i = 0; i < acpi_num_windows; i++ )
+			if( acpi_window_pde[i] == pde )
+				break;
+		if( i < acpi_num_windows )
+			continue;
+		if( acpi_num_windows == ACPI_MAX_WINDOWS )
+			return -1;
+
+		acpi_window_pde[acpi_num_windows] = pde;
+		acpi_window_saved[acpi_num_windows] = page_directory[pde];
+		acpi_num_windows++;
+		page_directory[pde] = (pde * FOUR_MB) | PAGE_SIZE_4MB | PAGE_PRESENT;
+	}
+	flush_tlb();
+	return 0;
+}
+
+/*
+	acpi_unmap_all()
+
+	Description: gives back everything acpi_map() borrowed
+*/
+static void acpi_unmap_all()
+{
+	uint32_t page;
+	int i;
+
+	for( i = 0; i < acpi_num_windows; i++ )
+		page_directory[acpi_window_pde[i]] = acpi_window_saved[i];
+	acpi_num_windows = 0;
+
+	for( page = 0; page < ACPI_RSDP_END / FOUR_KB; page++ )
+	{
+		if( acpi_low_pages[page] )
+		{
+			page_table[page] &= ~PAGE_PRESENT;
+			acpi_low_pages[page] = 0;
+		}
+	}
+	flush_tlb();
+}
+
+/*
+	acpi_checksum()
+
+	Description: ACPI structures sum to 0 modulo 256
+*/
+static uint8_t acpi_checksum(uint8_t* p, uint32_t len)
+{
+	uint8_t sum = 0;
+
+	while( len-- )
+		sum += *p++;
+	return sum;
+}
+
+/*
+	acpi_find_rsdp()
+
+	Description: scans the BIOS area for the "RSD PTR " signature
+	Outputs: the RSDP, NULL if there is none
+*/
+static uint8_t* acpi_find_rsdp()
+{
+	uint8_t* p;
+
+	if( acpi_map(ACPI_RSDP_START, ACPI_RSDP_END - ACPI_RSDP_START) != 0 )
+		return NULL;
+
+	for( p = (uint8_t*)ACPI_RSDP_START; p < (uint8_t*)ACPI_RSDP_END; p += ACPI_RSDP_ALIGN )
+	{
+		if( strncmp((int8_t*)p, "RSD PTR ", 8) == 0 && acpi_checksum(p, 20) == 0 )
+			return p;
+	}
+	return NULL;
+}
+
+/*
+	apic_parse_madt()
+
+	Description: walks the MADT's entries: CPUs (local APICs), the I/O APIC
+				 and ISA interrupt source overrides
+	Inputs: madt = mapped MADT, len = its length
+*/
+static void apic_parse_madt(uint8_t* madt, uint32_t len)
+{
+	uint8_t* entry = madt + MADT_ENTRIES_OFFSET;
+	uint8_t* end = madt + len;
+	uint32_t irq;
+	uint16_t flags;
+	int have_ioapic = 0;
+
+	while( entry + 2 <= end && entry[1] >= 2 )
+	{
+		switch( entry[0] )
+		{
+			case MADT_LAPIC:
+				if( (*(uint32_t*)(entry + 4) & MADT_LAPIC_ENABLED) && apic.num_cpus < APIC_MAX_CPUS )
+					apic.cpu_apic_ids[apic.num_cpus++] = entry[3];
+				break;
+
+			case MADT_IOAPIC:
+				/* only the first I/O APIC is used; it carries the ISA IRQs */
+				if( !have_ioapic )
+				{
+					have_ioapic = 1;
+					apic.ioapic = (volatile uint32_t*)*(uint32_t*)(entry + 4);
+					apic.ioapic_gsi_base = *(uint32_t*)(entry + 8);
+				}
+				break;
+
+			case MADT_ISO:
+				irq = entry[3];
+				if( entry[2] == 0 && irq < NUM_ISA_IRQS )
+				{
+					apic.irq_gsi[irq] = *(uint32_t*)(entry + 4);
+					flags = *(uint16_t*)(entry + 8);
+					apic.irq_flags[irq] = 0;
+					if( (flags & MADT_POLARITY_MASK) == MADT_POLARITY_LOW )
+						apic.irq_flags[irq] |= IOAPIC_RTE_ACTIVE_LOW;
+					if( (flags & MADT_TRIGGER_MASK) == MADT_TRIGGER_LEVEL )
+						apic.irq_flags[irq] |= IOAPIC_RTE_LEVEL;
+				}
+				break;
+
+			default:
+				break;
+		}
+		entry += entry[1];
+	}
+}
+
+/*
+	acpi_read_madt()
+
+	Description: finds the MADT through the RSDP and RSDT and parses it
+	Outputs: 0 if a MADT was found, -1 otherwise
+*/
+static int acpi_read_madt()
+{
+	uint8_t* rsdp = acpi_find_rsdp();
+	uint8_t* rsdt;
+	uint8_t* table;
+	uint32_t len;
+	uint32_t i;
+	int ret = -1;
+
+	if( rsdp == NULL )
+		return -1;
+
+	rsdt = (uint8_t*)*(uint32_t*)(rsdp + 16);
+	if( acpi_map((uint32_t)rsdt, ACPI_HEADER_SIZE) != 0 )
+		return -1;
+	len = *(uint32_t*)(rsdt + 4);
+	if( acpi_map((uint32_t)rsdt, len) != 0 || strncmp((int8_t*)rsdt, "RSDT", 4) != 0 )
+		return -1;
+
+	for( i = 0; i < (len - ACPI_HEADER_SIZE) / 4; i++ )
+	{
+		table = (uint8_t*)((uint32_t*)(rsdt + ACPI_HEADER_SIZE))[i];
+		if( acpi_map((uint32_t)table, ACPI_HEADER_SIZE) != 0 )
+			break;
+		if( strncmp((int8_t*)table, "APIC", 4) != 0 )
+			continue;
+		if( acpi_map((uint32_t)table, *(uint32_t*)(table + 4)) != 0 )
+			break;
+		apic_parse_madt(table, *(uint32_t*)(table + 4));
+		ret = 0;
+		break;
+	}
+	return ret;
+}
+
+/*
+	lapic_read() / lapic_write() / lapic_id() / lapic_eoi()
+
+	Description: local APIC register access
+*/
+uint32_t lapic_read(uint32_t reg)
+{
+	return apic.lapic[reg / 4];
+}
+
+void lapic_write(uint32_t reg, uint32_t value)
+{
+	apic.lapic[reg / 4] = value;
+}
+
+uint32_t lapic_id()
+{
+	return lapic_read(LAPIC_ID) >> LAPIC_ID_SHIFT;
+}
+
+void lapic_eoi()
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+	ioapic_read() / ioapic_write()
+
+	Description: indirect I/O APIC register access
+*/
+static uint32_t ioapic_read(uint32_t reg)
+{
+	apic.ioapic[IOAPIC_REGSEL / 4] = reg;
+	return apic.ioapic[IOAPIC_WINDOW / 4];
+}
+
+static void ioapic_write(uint32_t reg, uint32_t value)
+{
+	apic.ioapic[IOAPIC_REGSEL / 4] = reg;
+	apic.ioapic[IOAPIC_WINDOW / 4] = value;
+}
+
+/*
+	ioapic_entry()
+
+	Description: finds the redirection entry behind an ISA IRQ
+	Outputs: entry index, -1 if the I/O APIC doesn't handle its GSI
+*/
+static int ioapic_entry(uint32_t irq_num)
+{
+	uint32_t gsi;
+
+	if( irq_num >= NUM_ISA_IRQS )
+		return -1;
+	gsi = apic.irq_gsi[irq_num];
+	if( gsi < apic.ioapic_gsi_base || gsi - apic.ioapic_gsi_base >= apic.ioapic_entries )
+		return -1;
+	return gsi - apic.ioapic_gsi_base;
+}
+
+/*
+	ioapic_enable_irq()
+
+	Description: routes an ISA IRQ to its usual vector on the boot CPU
+	Inputs: irq_num = ISA IRQ (0 - 15)
+*/
+void ioapic_enable_irq(uint32_t irq_num)
+{
+	int entry = ioapic_entry(irq_num);
+
+	if( entry < 0 )
+		return;
+	ioapic_write(IOAPIC_REDTBL + (2 * entry) + 1, apic.bsp_id << IOAPIC_RTE_DEST_SHIFT);
+	ioapic_write(IOAPIC_REDTBL + (2 * entry), (APIC_IRQ_VECTOR_BASE + irq_num) | apic.irq_flags[irq_num]);
+}
+
+/*
+	ioapic_disable_irq()
+
+	Description: masks an ISA IRQ's redirection entry
+	Inputs: irq_num = ISA IRQ (0 - 15)
+*/
+void ioapic_disable_irq(uint32_t irq_num)
+{
+	int entry = ioapic_entry(irq_num);
+
+	if( entry < 0 )
+		return;
+	ioapic_write(IOAPIC_REDTBL + (2 * entry), ioapic_read(IOAPIC_REDTBL + (2 * entry)) | IOAPIC_RTE_MASKED);
+}
+
+/*
+	lapic_init()
+
+	Description: enables the running CPU's local APIC (every CPU has its
+				 own; the registers are at the same address on all of them)
+	Inputs: None
+	Outputs: None
+*/
+void lapic_init()
+{
+	wrmsr(MSR_APIC_BASE, ((uint32_t)rdmsr(MSR_APIC_BASE) & APIC_BASE_MASK) | APIC_BASE_ENABLE);
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | APIC_SPURIOUS_VECTOR);
+}
+
+/*
+	apic_map_mmio()
+
+	Description: identity maps the 4 MB region holding a register block, uncached
+*/
+static void apic_map_mmio(uint32_t phys)
+{
+	page_directory[phys / FOUR_MB] = (phys & ~(FOUR_MB - 1)) | PAGE_SIZE_4MB | PAGE_PCD | PAGE_PWT | PAGE_RW | PAGE_PRESENT;
+}
+
+/*
+	apic_init()
+
+	Description: enables the local APIC, masks every I/O APIC entry, masks
+				 the 8259 and makes enable_irq()/send_eoi() use the APICs.
+				 IRQs must be enabled again (enable_irq) after this.
+	Inputs: None
+	Outputs: 0 for success, -1 if the CPU has no APIC (8259 stays in use)
+	Side Effects: maps the APIC registers
+*/
+int32_t apic_init()
+{
+	uint32_t a, b, c, d;
+	uint32_t i;
+	uint32_t lapic_base;
+
+	cpuid(CPUID_FEATURES, &a, &b, &c, &d);
+	if( !(d & CPUID_EDX_APIC) )
+		return -1;
+
+	for( i = 0; i < NUM_ISA_IRQS; i++ )
+	{
+		apic.irq_gsi[i] = i;
+		apic.irq_flags[i] = 0;
+	}
+	apic.ioapic = (volatile uint32_t*)IOAPIC_DEFAULT_BASE;
+	apic.ioapic_gsi_base = 0;
+	apic.num_cpus = 0;
+
+	/* without a MADT assume the PC defaults (QEMU always has one) */
+	if( acpi_read_madt() != 0 )
+		apic.irq_gsi[0] = 2;
+	acpi_unmap_all();
+
+	lapic_base = (uint32_t)rdmsr(MSR_APIC_BASE) & APIC_BASE_MASK;
+	apic.lapic = (volatile uint32_t*)lapic_base;
+	apic_map_mmio(lapic_base);
+	apic_map_mmio((uint32_t)apic.ioapic);
+	flush_tlb();
+
+	lapic_init();
+	apic.bsp_id = lapic_id();
+
+	if( apic.num_cpus == 0 )
+		apic.cpu_apic_ids[apic.num_cpus++] = lapic_id();
+
+	apic.ioapic_entries = ((ioapic_read(IOAPIC_VER) >> IOAPIC_MAX_ENTRIES_SHIFT) & 0xFF) + 1;
+	for( i = 0; i < apic.ioapic_entries; i++ )
+		ioapic_write(IOAPIC_REDTBL + (2 * i), IOAPIC_RTE_MASKED);
+
+	/* the 8259 stays initialized (its spurious vectors are harmless) but fully masked */
+	outb(0xFF, MASTER_8259_PORT + 1);
+	outb(0xFF, SLAVE_8259_PORT + 1);
+
+	apic.enabled = 1;
+	return 0;
+}
@@ -0,0 +1,103 @@
+/*
+	apic.h
+
+	Local APIC and I/O APIC support (replaces the 8259 when present)
+*/
+
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+/* CPUID / MSR */
+#define CPUID_EDX_APIC 			(1 << 9)
+#define MSR_APIC_BASE 			0x1B
+#define APIC_BASE_ENABLE 		0x800
+#define APIC_BASE_MASK 			0xFFFFF000
+
+/* default addresses (used when there is no MADT) */
+#define LAPIC_DEFAULT_BASE 		0xFEE00000
+#define IOAPIC_DEFAULT_BASE 	0xFEC00000
+
+/* local APIC registers (byte offsets) */
+#define LAPIC_ID 				0x020
+#define LAPIC_TPR 				0x080
+#define LAPIC_EOI 				0x0B0
+#define LAPIC_SVR 				0x0F0
+#define LAPIC_ICR_LOW 			0x300
+#define LAPIC_ICR_HIGH 			0x310
+#define LAPIC_LVT_TIMER 		0x320
+#define LAPIC_LVT_LINT0 		0x350
+#define LAPIC_LVT_LINT1 		0x360
+#define LAPIC_TIMER_INIT 		0x380
+#define LAPIC_TIMER_CURRENT 	0x390
+#define LAPIC_TIMER_DIVIDE 		0x3E0
+#define LAPIC_SVR_ENABLE 		0x100
+#define LAPIC_ID_SHIFT 			24
+#define LAPIC_LVT_MASKED 		0x10000
+
+/* I/O APIC registers */
+#define IOAPIC_REGSEL 			0x00
+#define IOAPIC_WINDOW 			0x10
+#define IOAPIC_VER 				0x01
+#define IOAPIC_REDTBL 			0x10 	/* two 32 bit registers per entry */
+#define IOAPIC_MAX_ENTRIES_SHIFT 16
+#define IOAPIC_RTE_MASKED 		0x10000
+#define IOAPIC_RTE_LEVEL 		0x08000
+#define IOAPIC_RTE_ACTIVE_LOW 	0x02000
+#define IOAPIC_RTE_DEST_SHIFT 	24
+
+/* interrupt vectors: ISA IRQs keep the vectors the 8259 gave them */
+#define APIC_IRQ_VECTOR_BASE 	0x20
+#define APIC_SPURIOUS_VECTOR 	0xFF
+#define NUM_ISA_IRQS 			16
+
+/* ACPI tables used to find the I/O APIC, IRQ overrides and CPUs */
+#define ACPI_RSDP_START 		0xE0000
+#define ACPI_RSDP_END 			0x100000
+#define ACPI_RSDP_ALIGN 		16
+#define ACPI_HEADER_SIZE 		36
+#define MADT_ENTRIES_OFFSET 	44
+#define MADT_LAPIC 				0
+#define MADT_IOAPIC 			1
+#define MADT_ISO 				2
+#define MADT_LAPIC_ENABLED 		0x1
+#define MADT_POLARITY_MASK 		0x3
+#define MADT_POLARITY_LOW 		0x3
+#define MADT_TRIGGER_MASK 		0xC
+#define MADT_TRIGGER_LEVEL 		0xC
+#define ACPI_MAX_WINDOWS 		8
+
+#define APIC_MAX_CPUS 			8
+
+typedef struct apic_t {
+	int enabled;                        /* 1 once interrupts go through the APICs */
+	volatile uint32_t* lapic;           /* local APIC registers */
+	volatile uint32_t* ioapic;          /* I/O APIC registers */
+	uint32_t ioapic_gsi_base;           /* first GSI the I/O APIC handles */
+	uint32_t ioapic_entries;            /* redirection entries */
+	uint32_t irq_gsi[NUM_ISA_IRQS];     /* ISA IRQ -> GSI (interrupt source overrides) */
+	uint32_t irq_flags[NUM_ISA_IRQS];   /* polarity / trigger bits for the redirection entry */
+	uint32_t bsp_id;                    /* local APIC ID of the boot CPU, which takes the ISA IRQs */
+	uint32_t num_cpus;                  /* enabled processors listed in the MADT */
+	uint8_t cpu_apic_ids[APIC_MAX_CPUS];
+} apic_t;
+
+extern apic_t apic;
+
+/* switches interrupt delivery from the 8259 to the APICs */
+int32_t apic_init();
+/* enables the running CPU's local APIC */
+void lapic_init();
+/* local APIC register access */
+uint32_t lapic_read(uint32_t reg);
+void lapic_write(uint32_t reg, uint32_t value);
+/* the running CPU's local APIC ID */
+uint32_t lapic_id();
+/* routing of ISA IRQs through the I/O APIC */
+void ioapic_enable_irq(uint32_t irq_num);
+void ioapic_disable_irq(uint32_t irq_num);
+/* end of interrupt for the local APIC */
+void lapic_eoi();
+
+#endif
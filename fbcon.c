@@ -0,0 +1,448 @@
+/*
+	fbcon.c
+
+	Text console for the VBE linear framebuffer. The terminals keep writing
+	VGA style (character, attribute) cells into their video pages; while
+	the console is enabled those cells are rendered into the framebuffer
+	with the 8x16 font the VGA card uses in text mode.
+
+	Rendering is kept cheap in three ways:
+		- glyphs are expanded to framebuffer pixels once per (character,
+		  attribute) pair and cached, so drawing a cell is FONT_HEIGHT
+		  row copies
+		- putc() and friends only mark cells dirty; the dirty rectangle is
+		  drawn when the cursor is updated (end of a write, a keystroke)
+		  and on every PIT tick
+		- scrolling moves the framebuffer up one text row with a single
+		  memmove instead of redrawing the screen
+
+	The console is suspended while a process owns the framebuffer through
+	fbmap() and redrawn when it lets go of it.
+*/
+
+#include "fbcon.h"
+#include "vbe.h"
+#include "lib.h"
+#include "paging.h"
+
+fbcon_t fbcon;
+
+/* the 16 VGA text colors as 0xRRGGBB */
+static const uint32_t vga_rgb[FBCON_NUM_COLORS] = {
+	0x000000, 0x0000AA, 0x00AA00, 0x00AAAA, 0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+	0x555555, 0x5555FF, 0x55FF55, 0x55FFFF, 0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
+};
+
+/*
+	fbcon_load_font()
+
+	Description: copies the 8x16 text mode font out of VGA plane 2. Must run
+				 before the BGA leaves text mode.
+	Inputs: dest = FONT_GLYPHS * FONT_HEIGHT byte buffer
+	Outputs: None
+	Side Effects: temporarily maps the VGA window at 0xA0000
+*/
+static void fbcon_load_font(uint8_t* dest)
+{
+	uint8_t* src = (uint8_t*)VGA_FONT_ADDR;
+	uint32_t flags;
+	int i;
+
+	for( i = 0; i < VGA_FONT_PAGES; i++ )
+		page_table[(VGA_FONT_ADDR >> PAGE_SHIFT) + i] = (VGA_FONT_ADDR + (i * FOUR_KB)) | PAGE_RW | PAGE_PRESENT;
+	flush_tlb();
+
+	cli_and_save(flags);
+	/* plane 2 only, sequential addressing, 0xA0000 window */
+	outw(0x0402, VGA_SEQ_INDEX);
+	outw(0x0704, VGA_SEQ_INDEX);
+	outw(0x0204, VGA_GC_INDEX);
+	outw(0x0005, VGA_GC_INDEX);
+	outw(0x0406, VGA_GC_INDEX);
+
+	for( i = 0; i < FONT_GLYPHS; i++ )
+		memcpy(dest + (i * FONT_HEIGHT), src + (i * FONT_PLANE_STRIDE), FONT_HEIGHT);
+
+	/* back to the text mode settings (planes 0 and 1, odd/even, 0xB8000 window) */
+	outw(0x0302, VGA_SEQ_INDEX);
+	outw(0x0304, VGA_SEQ_INDEX);
+	outw(0x0004, VGA_GC_INDEX);
+	outw(0x1005, VGA_GC_INDEX);
+	outw(0x0E06, VGA_GC_INDEX);
+	restore_flags(flags);
+
+	for( i = 0; i < VGA_FONT_PAGES; i++ )
+		page_table[(VGA_FONT_ADDR >> PAGE_SHIFT) + i] = 0;
+	flush_tlb();
+}
+
+/*
+	fbcon_pixel()
+
+	Description: converts a 0xRRGGBB color to the framebuffer's pixel format
+*/
+static uint32_t fbcon_pixel(uint32_t rgb, int index)
+{
+	uint32_t r = (rgb >> 16) & 0xFF;
+	uint32_t g = (rgb >> 8) & 0xFF;
+	uint32_t b = rgb & 0xFF;
+
+	switch( vbe.bpp )
+	{
+		case 8:
+			/* the DAC's default palette starts with the 16 text colors */
+			return index;
+		case 15:
+			return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+		case 16:
+			return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+		default:
+			return rgb;
+	}
+}
+
+/*
+	fbcon_put_pixel()
+
+	Description: stores one pixel value at the framebuffer's depth
+*/
+static void fbcon_put_pixel(uint8_t* dst, uint32_t pixel)
+{
+	uint32_t i;
+
+	for( i = 0; i < fbcon.bytes_pp; i++ )
+		dst[i] = (uint8_t)(pixel >> (i * 8));
+}
+
+/*
+	fbcon_glyph()
+
+	Description: returns a cell's pre-expanded glyph, expanding it into the
+				 cache on a miss
+	Inputs: cell = character in the low byte, attribute in the high byte
+	Outputs: FONT_HEIGHT rows of FONT_WIDTH pixels at framebuffer depth
+*/
+static uint8_t* fbcon_glyph(uint16_t cell)
+{
+	uint32_t slot = ((uint32_t)cell * FBCON_HASH_MULT) >> (32 - FBCON_CACHE_BITS);
+	uint8_t* glyph = fbcon.cache + (slot * fbcon.glyph_bytes);
+	uint8_t* bits = fbcon.font + ((cell & 0xFF) * FONT_HEIGHT);
+	uint32_t fg = fbcon.palette[(cell >> 8) & ATTRIB_FG_MASK];
+	uint32_t bg = fbcon.palette[(cell >> 8) >> ATTRIB_BG_SHIFT];
+	uint8_t* dst = glyph;
+	int row;
+	int col;
+
+	if( fbcon.tags[slot] == cell )
+	{
+		fbcon.cache_hits++;
+		return glyph;
+	}
+
+	fbcon.cache_misses++;
+	fbcon.tags[slot] = cell;
+	for( row = 0; row < FONT_HEIGHT; row++ )
+	{
+		for( col = 0; col < FONT_WIDTH; col++ )
+		{
+			fbcon_put_pixel(dst, (bits[row] & (0x80 >> col)) ? fg : bg);
+			dst += fbcon.bytes_pp;
+		}
+	}
+	return glyph;
+}
+
+/*
+	fbcon_draw_cell()
+
+	Description: blits one cell of the visible terminal
+	Inputs: x, y = cell
+*/
+static void fbcon_draw_cell(int x, int y)
+{
+	uint16_t* cells = (uint16_t*)terminals[visible_terminal].vidmem_addr;
+	int i = (y * fbcon.cols) + x;
+	uint32_t row_bytes = FONT_WIDTH * fbcon.bytes_pp;
+	uint8_t* dst = (uint8_t*)vbe.lfb + (y * FONT_HEIGHT * vbe.pitch) + (x * row_bytes);
+	uint8_t* glyph = fbcon_glyph(cells[i]);
+	int row;
+
+	for( row = 0; row < FONT_HEIGHT; row++ )
+	{
+		memcpy(dst, glyph, row_bytes);
+		glyph += row_bytes;
+		dst += vbe.pitch;
+	}
+	fbcon.shadow[i] = cells[i];
+}
+
+/*
+	fbcon_draw_cursor()
+
+	Description: draws the underline cursor in the cell's foreground color
+*/
+static void fbcon_draw_cursor()
+{
+	uint16_t* cells = (uint16_t*)terminals[visible_terminal].vidmem_addr;
+	uint16_t cell = cells[(fbcon.cursor_y * fbcon.cols) + fbcon.cursor_x];
+	uint32_t fg = fbcon.palette[(cell >> 8) & ATTRIB_FG_MASK];
+	uint8_t* dst = (uint8_t*)vbe.lfb + (((fbcon.cursor_y + 1) * FONT_HEIGHT - FBCON_CURSOR_LINES) * vbe.pitch)
+				   + (fbcon.cursor_x * FONT_WIDTH * fbcon.bytes_pp);
+	int row;
+	int col;
+
+	for( row = 0; row < FBCON_CURSOR_LINES; row++ )
+	{
+		for( col = 0; col < FONT_WIDTH; col++ )
+			fbcon_put_pixel(dst + (col * fbcon.bytes_pp), fg);
+		dst += vbe.pitch;
+	}
+}
+
+/*
+	fbcon_init()
+
+	Description: reads the VGA font, sets the console's framebuffer mode and
+				 sizes the text grid to it
+	Inputs: None
+	Outputs: 0 for success, -1 if there is no BGA or not enough memory
+	Side Effects: sets screen_cols / screen_rows; must run before the
+				  terminals are created
+*/
+int32_t fbcon_init()
+{
+	uint32_t cells_pages;
+	uint32_t cache_pages;
+	int i;
+
+	fbcon.font = (uint8_t*)alloc_frame();
+	if( fbcon.font == NULL )
+		return -1;
+	fbcon_load_font(fbcon.font);
+
+	if( vbe_set_mode(FBCON_XRES, FBCON_YRES, FBCON_BPP) != 0 )
+	{
+		free_frame((uint32_t)fbcon.font);
+		return -1;
+	}
+
+	fbcon.bytes_pp = (vbe.bpp + 7) / 8;
+	fbcon.glyph_bytes = FONT_WIDTH * FONT_HEIGHT * fbcon.bytes_pp;
+	fbcon.cols = vbe.xres / FONT_WIDTH;
+	fbcon.rows = vbe.yres / FONT_HEIGHT;
+
+	cells_pages = ((fbcon.cols * fbcon.rows * 2) + FOUR_KB - 1) / FOUR_KB;
+	cache_pages = ((FBCON_CACHE_ENTRIES * fbcon.glyph_bytes) + FOUR_KB - 1) / FOUR_KB;
+	fbcon.shadow = (uint16_t*)alloc_frames(cells_pages);
+	fbcon.cache = (uint8_t*)alloc_frames(cache_pages);
+	if( fbcon.shadow == NULL || fbcon.cache == NULL )
+	{
+		if( fbcon.shadow != NULL )
+			free_frames((uint32_t)fbcon.shadow, cells_pages);
+		if( fbcon.cache != NULL )
+			free_frames((uint32_t)fbcon.cache, cache_pages);
+		free_frame((uint32_t)fbcon.font);
+		vbe_disable();
+		return -1;
+	}
+
+	for( i = 0; i < FBCON_CACHE_ENTRIES; i++ )
+		fbcon.tags[i] = FBCON_TAG_EMPTY;
+	for( i = 0; i < FBCON_NUM_COLORS; i++ )
+		fbcon.palette[i] = fbcon_pixel(vga_rgb[i], i);
+
+	fbcon.dirty_x0 = fbcon.dirty_y0 = 0;
+	fbcon.dirty_x1 = fbcon.dirty_y1 = 0;
+	fbcon.cursor_x = fbcon.cursor_y = 0;
+	memset((void*)vbe.lfb, 0, vbe.size);
+
+	screen_cols = fbcon.cols;
+	screen_rows = fbcon.rows;
+	fbcon.enabled = 1;
+	return 0;
+}
+
+/*
+	fbcon_dirty()
+
+	Description: grows the dirty rectangle to cover cells [start, end). A
+				 range spanning several rows dirties those rows entirely.
+	Inputs: start, end = cell indices in the visible terminal
+	Outputs: None
+*/
+void fbcon_dirty(int start, int end)
+{
+	int x0, y0, x1, y1;
+	uint32_t flags;
+
+	if( start >= end )
+		return;
+
+	y0 = start / fbcon.cols;
+	y1 = ((end - 1) / fbcon.cols) + 1;
+	if( y1 - y0 == 1 )
+	{
+		x0 = start % fbcon.cols;
+		x1 = ((end - 1) % fbcon.cols) + 1;
+	}
+	else
+	{
+		x0 = 0;
+		x1 = fbcon.cols;
+	}
+
+	cli_and_save(flags);
+	if( fbcon.dirty_x1 == 0 )
+	{
+		fbcon.dirty_x0 = x0;
+		fbcon.dirty_y0 = y0;
+		fbcon.dirty_x1 = x1;
+		fbcon.dirty_y1 = y1;
+	}
+	else
+	{
+		if( x0 < fbcon.dirty_x0 )
+			fbcon.dirty_x0 = x0;
+		if( y0 < fbcon.dirty_y0 )
+			fbcon.dirty_y0 = y0;
+		if( x1 > fbcon.dirty_x1 )
+			fbcon.dirty_x1 = x1;
+		if( y1 > fbcon.dirty_y1 )
+			fbcon.dirty_y1 = y1;
+	}
+	restore_flags(flags);
+}
+
+/*
+	fbcon_flush()
+
+	Description: draws the cells in the dirty rectangle (and the cursor if
+				 it is inside it), then empties the rectangle
+	Inputs: None
+	Outputs: None
+	Side Effects: does nothing while a process owns the framebuffer
+*/
+void fbcon_flush()
+{
+	uint32_t flags;
+	int x, y;
+
+	if( !fbcon.enabled || vbe.owner != -1 )
+		return;
+
+	cli_and_save(flags);
+	for( y = fbcon.dirty_y0; y < fbcon.dirty_y1; y++ )
+		for( x = fbcon.dirty_x0; x < fbcon.dirty_x1; x++ )
+			fbcon_draw_cell(x, y);
+
+	if( fbcon.cursor_x >= fbcon.dirty_x0 && fbcon.cursor_x < fbcon.dirty_x1 &&
+		fbcon.cursor_y >= fbcon.dirty_y0 && fbcon.cursor_y < fbcon.dirty_y1 )
+		fbcon_draw_cursor();
+
+	fbcon.dirty_x0 = fbcon.dirty_y0 = 0;
+	fbcon.dirty_x1 = fbcon.dirty_y1 = 0;
+	restore_flags(flags);
+}
+
+/*
+	fbcon_update_cursor()
+
+	Description: moves the cursor and draws everything that is pending
+	Inputs: x, y = cursor cell in the visible terminal
+	Outputs: None
+*/
+void fbcon_update_cursor(int x, int y)
+{
+	uint32_t flags;
+
+	if( x >= (int)fbcon.cols )
+		x = fbcon.cols - 1;
+
+	cli_and_save(flags);
+	/* redrawing the old cell erases the old cursor */
+	fbcon_dirty((fbcon.cursor_y * fbcon.cols) + fbcon.cursor_x, (fbcon.cursor_y * fbcon.cols) + fbcon.cursor_x + 1);
+	fbcon.cursor_x = x;
+	fbcon.cursor_y = y;
+	fbcon_dirty((y * fbcon.cols) + x, (y * fbcon.cols) + x + 1);
+	fbcon_flush();
+	restore_flags(flags);
+}
+
+/*
+	fbcon_scroll()
+
+	Description: called after the visible terminal's cells scrolled up one
+				 row: moves the framebuffer (and the shadow cells) up one
+				 text row with one memmove and dirties the new bottom row
+	Inputs: None
+	Outputs: None
+*/
+void fbcon_scroll()
+{
+	uint32_t row_bytes = FONT_HEIGHT * vbe.pitch;
+	uint32_t flags;
+
+	cli_and_save(flags);
+	if( vbe.owner != -1 )
+	{
+		/* suspended, the whole screen is redrawn on release anyway */
+		restore_flags(flags);
+		return;
+	}
+
+	/* the cursor's pixels move with the screen, so its old cell needs a redraw */
+	fbcon_dirty((fbcon.cursor_y * fbcon.cols) + fbcon.cursor_x, (fbcon.cursor_y * fbcon.cols) + fbcon.cursor_x + 1);
+
+	/* pending cells moved up a row along with the text */
+	if( fbcon.dirty_x1 != 0 )
+	{
+		if( fbcon.dirty_y0 > 0 )
+			fbcon.dirty_y0--;
+		fbcon.dirty_y1--;
+		if( fbcon.dirty_y1 <= fbcon.dirty_y0 )
+			fbcon.dirty_x0 = fbcon.dirty_y0 = fbcon.dirty_x1 = fbcon.dirty_y1 = 0;
+	}
+
+	memmove((void*)vbe.lfb, (void*)(vbe.lfb + row_bytes), (fbcon.rows - 1) * row_bytes);
+	memmove(fbcon.shadow, fbcon.shadow + fbcon.cols, (fbcon.rows - 1) * fbcon.cols * 2);
+	fbcon_dirty((fbcon.rows - 1) * fbcon.cols, fbcon.rows * fbcon.cols);
+	restore_flags(flags);
+}
+
+/*
+	fbcon_redraw()
+
+	Description: redraws the whole visible terminal (terminal switch, or the
+				 framebuffer was handed back by a process)
+	Inputs: None
+	Outputs: None
+*/
+void fbcon_redraw()
+{
+	fbcon_dirty(0, fbcon.cols * fbcon.rows);
+	fbcon_flush();
+}
+
+/*
+	fbcon_sync()
+
+	Description: redraws cells that differ from what is on screen. Used for
+				 terminals a process has vidmap()'d, whose writes bypass putc().
+	Inputs: None
+	Outputs: None
+*/
+void fbcon_sync()
+{
+	uint16_t* cells = (uint16_t*)terminals[visible_terminal].vidmem_addr;
+	uint32_t i;
+
+	if( !fbcon.enabled || vbe.owner != -1 )
+		return;
+
+	for( i = 0; i < fbcon.cols * fbcon.rows; i++ )
+	{
+		if( cells[i] != fbcon.shadow[i] )
+			fbcon_dirty(i, i + 1);
+	}
+	fbcon_flush();
+}
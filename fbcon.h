@@ -0,0 +1,86 @@
+/*
+	fbcon.h
+
+	Text console on top of the VBE linear framebuffer
+*/
+
+#ifndef _FBCON_H
+#define _FBCON_H
+
+#include "types.h"
+
+/* mode set for the console ("fbcon" on the kernel command line) */
+#define FBCON_XRES 				1024
+#define FBCON_YRES 				768
+#define FBCON_BPP 				32
+
+/* the font is the one the VGA card uses in text mode, read from plane 2 */
+#define FONT_WIDTH 				8
+#define FONT_HEIGHT 			16
+#define FONT_GLYPHS 			256
+#define FONT_PLANE_STRIDE 		32 		/* VGA keeps every glyph in a 32 byte slot */
+#define VGA_FONT_ADDR 			0xA0000
+#define VGA_FONT_PAGES 			16
+#define VGA_SEQ_INDEX 			0x3C4
+#define VGA_GC_INDEX 			0x3CE
+
+/* largest text grid the console can show */
+#define FBCON_MAX_COLS 			(FBCON_XRES / FONT_WIDTH)
+#define FBCON_MAX_ROWS 			(FBCON_YRES / FONT_HEIGHT)
+
+/* glyph cache: direct mapped on (character, attribute), glyphs stored at framebuffer depth */
+#define FBCON_CACHE_BITS 		9
+#define FBCON_CACHE_ENTRIES 	(1 << FBCON_CACHE_BITS)
+#define FBCON_HASH_MULT 		0x9E3779B1 	/* Fibonacci hashing */
+#define FBCON_TAG_EMPTY 		0xFFFFFFFF
+#define FBCON_MAX_BPP 			32
+
+#define FBCON_NUM_COLORS 		16
+#define FBCON_CURSOR_LINES 		2 		/* underline cursor height in pixels */
+
+typedef struct fbcon_t {
+	int enabled;            /* 1 once the console owns the framebuffer */
+	uint32_t cols;          /* text grid in cells */
+	uint32_t rows;
+	uint32_t bytes_pp;      /* framebuffer bytes per pixel */
+	uint32_t glyph_bytes;   /* size of one pre-expanded glyph */
+	uint8_t* font;          /* FONT_GLYPHS x FONT_HEIGHT rows, one bit per pixel */
+	uint8_t* cache;         /* FBCON_CACHE_ENTRIES pre-expanded glyphs */
+	uint16_t* shadow;       /* the cells as they are currently drawn */
+	uint32_t tags[FBCON_CACHE_ENTRIES]; /* (attrib << 8 | char) held by each cache slot */
+	uint32_t palette[FBCON_NUM_COLORS]; /* VGA colors as framebuffer pixel values */
+	int dirty_x0;           /* dirty rectangle in cells, [x0, x1) x [y0, y1) */
+	int dirty_y0;
+	int dirty_x1;
+	int dirty_y1;
+	int cursor_x;           /* cell the cursor is drawn under */
+	int cursor_y;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+} fbcon_t;
+
+extern fbcon_t fbcon;
+
+/* marks cells [start, end) of the visible terminal as needing a redraw */
+#define FBCON_DIRTY(term_num, start, end) 							\
+do { 																\
+	if( fbcon.enabled && terminals[term_num].is_visible ) 			\
+		fbcon_dirty(start, end); 									\
+} while (0)
+
+/* reads the VGA font and switches to the framebuffer console */
+int32_t fbcon_init();
+/* adds cells [start, end) to the dirty rectangle */
+void fbcon_dirty(int start, int end);
+/* draws the dirty rectangle */
+void fbcon_flush();
+/* moves the cursor and flushes */
+void fbcon_update_cursor(int x, int y);
+/* scrolls the screen up one text row */
+void fbcon_scroll();
+/* redraws the whole visible terminal */
+void fbcon_redraw();
+/* redraws cells changed behind the console's back (vidmap) */
+void fbcon_sync();
+
+#endif
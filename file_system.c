@@ -23,9 +23,6 @@ inode_t *inodes;
 // datablocks start address
 uint32_t datablocks_start;
 
-// counts the file_name reads for ls
-uint32_t ls_helper = 0;
-
 /*read_dentry_by_name
 * finds a dentry by name and copies the info into the dentry param
 * Input: fname - name of entry to find
@@ -152,6 +149,34 @@ int32_t read_data(uint32_t inode, uint32_t offset, uint8_t *buf, uint32_t length
   return num_bytes_read;
 }
 
+/*read_data_span
+* finds a file's bytes in the file system image without copying them:
+* from offset up to the end of its data block or of the file
+* Input: inode, offset, data - set to the bytes' address
+* Output: number of bytes at *data, 0 at end of file, -1 - failure
+* Side Effects: none
+*/
+int32_t read_data_span(uint32_t inode, uint32_t offset, uint8_t** data)
+{
+  uint32_t block;
+  uint32_t length;
+
+  if(data == NULL || inode >= fs_stats.num_inodes || offset > inodes[inode].length)
+    return -1;
+  if(offset == inodes[inode].length)
+    return 0;
+
+  block = inodes[inode].datablocks[offset / FOUR_K];
+  if(block >= fs_stats.num_datablocks)
+    return -1;
+
+  *data = (uint8_t*)(datablocks_start + block * FOUR_K + offset % FOUR_K);
+  length = FOUR_K - offset % FOUR_K;
+  if(length > inodes[inode].length - offset)
+    length = inodes[inode].length - offset;
+  return length;
+}
+
 /*file_system_open
 * initializes all variables if the file system isn't already open
 * Input: start_addr - address the fs starts at
@@ -209,37 +234,122 @@ int32_t directory_close(int32_t fd)
   return 0;
 }
 
+/*directory_entry
+* copies the name of one directory entry
+* Input: index: entry number
+         buf: address to copy the name into
+         nbytes: size of buf
+* Output: length of the name copied, 0 - past the last entry
+* Side Effects: none
+*/
+int32_t directory_entry(uint32_t index, void* buf, int32_t nbytes)
+{
+    int i = 0;
+
+    if(index >= fs_stats.num_dentries)
+      return 0;
+
+    while( (i < FILENAME_SIZE) && (i < nbytes) && (dentries[index].filename[i] != NULL) )
+    {
+      ((int8_t*)(buf))[i] = dentries[index].filename[i];
+      i++;
+    }
+    return i;
+}
+
 /*directory_read
-* Performs dir-specific read() sys call
+* Performs dir-specific read() sys call: one file name per call, from the
+* entry at the fd's file position (lseek() moves it like a file's)
 * Input: fd: file descriptor number
          buf: address to read data into (SHOULD BE DIRECTORY NAME)
          nbytes: number of bytes to read
-* Output: 0 - success, -1= fail
-* Side Effects: prints to screen
+* Output: length of the name, 0 - no entries left (the next read starts over)
+* Side Effects: advances the file position
 */
 int32_t directory_read(int32_t fd, void* buf, int32_t nbytes)
 {
-    int i = 0;
+    pcb_t * pcb = get_PCB_from_stack();
+    uint32_t index = pcb->fd_array[fd].file_position;
+    int32_t length;
 
     /* check if we have finished prnting all of the file names in the directory */
-    if(ls_helper < fs_stats.num_dentries)
+    if(index < fs_stats.num_dentries)
     {
-        /* copy the file name into the buffer */
-        while( (dentries[ls_helper].filename[i] != NULL) && (i < FILENAME_SIZE) )
-        {
-          ((int8_t*)(buf))[i] = dentries[ls_helper].filename[i];
-          i++;
-        }
-        ls_helper++;
-        return i;
+        length = directory_entry(index, buf, nbytes);
+        pcb->fd_array[fd].file_position++;
+        return length;
     }
     else
     {
-        ls_helper = 0;
+        pcb->fd_array[fd].file_position = 0;
         return 0;
     }
 }
 
+/*directory_getdents
+* packs as many directory entries as fit into buf as dirent_t records
+* Input: position: entry number to start at, moved past what was packed
+         buf: address to pack the records into
+         nbytes: size of buf
+* Output: bytes used in buf, 0 - no entries left, -1 - buf too small for
+*         the next entry
+* Side Effects: advances *position
+*/
+int32_t directory_getdents(uint32_t* position, void* buf, int32_t nbytes)
+{
+    uint32_t index = *position;
+    int32_t used = 0;
+    dirent_t* d;
+    int32_t namelen;
+    int32_t reclen;
+
+    for( ; index < fs_stats.num_dentries; index++ )
+    {
+      for( namelen = 0; namelen < FILENAME_SIZE && dentries[index].filename[namelen] != NULL; namelen++ );
+      /* name and its NUL, rounded up so the next record stays aligned */
+      reclen = (sizeof(dirent_t) + namelen + 1 + 3) & ~3;
+      if(reclen > nbytes - used)
+        break;
+
+      d = (dirent_t*)((uint8_t*)buf + used);
+      d->inode = dentries[index].inode;
+      d->size = (dentries[index].filetype == FILE_DENTRY_VAL) ? inodes[d->inode].length : 0;
+      d->reclen = reclen;
+      d->type = dentries[index].filetype;
+      d->namelen = namelen;
+      memcpy(d->name, dentries[index].filename, namelen);
+      d->name[namelen] = '\0';
+      used += reclen;
+    }
+
+    if(used == 0 && index < fs_stats.num_dentries)
+      return -1;
+    *position = index;
+    return used;
+}
+
+/*directory_length
+* Input: none
+* Output: number of directory entries, the end for lseek()
+* Side Effects: none
+*/
+int32_t directory_length(void)
+{
+  return fs_stats.num_dentries;
+}
+
+/*file_length
+* Input: inode
+* Output: the file's length in bytes, -1 - bad inode
+* Side Effects: none
+*/
+int32_t file_length(uint32_t inode)
+{
+  if(inode >= fs_stats.num_inodes)
+    return -1;
+  return inodes[inode].length;
+}
+
 
 /*directory_write
 * does nothing
@@ -274,6 +384,17 @@ int32_t file_close(int32_t fd)
   return 0;
 }
 
+/*file_poll
+* poll hook of regular files and the directory
+* Input: pcb, fd (not used)
+* Output: POLLIN | POLLOUT, reads and writes never wait
+* Side Effects: none
+*/
+int32_t file_poll(struct pcb_t* pcb, int32_t fd)
+{
+  return POLLIN | POLLOUT;
+}
+
 /*file_read
 * Perform the fs-specific read() system call
 * Input: fd: file descriptor array number
@@ -31,6 +31,18 @@ typedef struct
   uint8_t reserved[DENTRY_RESERVED];
 } dentry_t;
 
+// one entry as getdents() packs it; records follow each other in the
+// buffer, reclen bytes apart
+typedef struct
+{
+  uint32_t inode;
+  uint32_t size;      // length in bytes, 0 unless a regular file
+  uint16_t reclen;    // whole record, name padded to 4 bytes
+  uint8_t  type;      // filetype from the dentry
+  uint8_t  namelen;
+  int8_t   name[];    // namelen characters and a NUL
+} dirent_t;
+
 // inode, length in bytes
 typedef struct
 {
@@ -42,6 +54,8 @@ typedef struct
 int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 int32_t read_data(uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+// where read_data would copy from, one data block at a time
+int32_t read_data_span(uint32_t inode, uint32_t offset, uint8_t** data);
 
 //file system startup/shutdown
 int32_t file_system_init(uint32_t start_addr);
@@ -52,8 +66,18 @@ int32_t directory_open(const uint8_t* filename);
 int32_t directory_close(int32_t fd);
 int32_t directory_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t directory_write(int32_t fd, const void* buf, int32_t nbytes);
+// name of entry index, for directory_read() and pread()
+int32_t directory_entry(uint32_t index, void* buf, int32_t nbytes);
+// packs entries from *position on into buf, for getdents()
+int32_t directory_getdents(uint32_t* position, void* buf, int32_t nbytes);
+// ends for lseek()
+int32_t directory_length(void);
+int32_t file_length(uint32_t inode);
 int32_t file_open(const uint8_t* filename);
 int32_t file_close(int32_t fd);
+struct pcb_t;
+/* files and the directory never make a read wait */
+int32_t file_poll(struct pcb_t* pcb, int32_t fd);
 int32_t file_read(int32_t fd, void* buf, int32_t nbytes);
 int32_t file_write(int32_t fd, const void* buf, int32_t nbytes);
 
@@ -4,6 +4,7 @@
 
 #include "i8259.h"
 #include "lib.h"
+#include "apic.h"
 
 #define INIT_MASK 	0xFF
 #define SLAVE_IRQ 	2
@@ -50,6 +51,13 @@ void enable_irq(uint32_t irq_num)
 	if( (irq_num < 0) || (irq_num > 15) )
 		return;
 
+	/* The 8259 is masked once the I/O APIC takes over */
+	if( apic.enabled )
+	{
+		ioapic_enable_irq(irq_num);
+		return;
+	}
+
 	/* Create mask based on either Master or Slave PIC */
 	if( irq_num >= 8 )
 		mask = ~(1 << (irq_num - 8));
@@ -86,6 +94,12 @@ void disable_irq(uint32_t irq_num)
 	if( (irq_num < 0) || (irq_num > 15) )
 		return;
 
+	if( apic.enabled )
+	{
+		ioapic_disable_irq(irq_num);
+		return;
+	}
+
 	/* Create mask based on either Master or Slave PIC */
 	if( irq_num >= 8 )
 		mask = (1 << (irq_num - 8));
@@ -109,6 +123,13 @@ void disable_irq(uint32_t irq_num)
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num)
 {
+	/* one store to the local APIC, whatever the IRQ */
+	if( apic.enabled )
+	{
+		lapic_eoi();
+		return;
+	}
+
 	/* IRQ belongs to Master PIC */
 	if( (irq_num >= 0) && (irq_num <= 7) )
 	{
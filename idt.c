@@ -10,6 +10,7 @@
 #include "rtc.h"
 #include "mouse.h"
 #include "scheduler.h"
+#include "klog.h"
 
 #define SYSCALL_INDEX 0x80
 
@@ -85,6 +86,10 @@ void IDT_init()
   SET_IDT_ENTRY(idt[0x28], INT_HANDLER_40);  //rtc
   SET_IDT_ENTRY(idt[0x2C], INT_HANDLER_44);  //mouse
   SET_IDT_ENTRY(idt[0x20], INT_HANDLER_32);  //pit
+  SET_IDT_ENTRY(idt[0x24], INT_HANDLER_36);  //serial (COM1)
+  SET_IDT_ENTRY(idt[0xF0], INT_HANDLER_240); //local APIC timer
+  SET_IDT_ENTRY(idt[0xF1], INT_HANDLER_241); //TLB shootdown IPI
+  SET_IDT_ENTRY(idt[0xFF], APIC_SPURIOUS);   //local APIC spurious
 
   /* Set up System Call Interrupt Handler */
   SET_IDT_ENTRY(idt[0x80], SYSCALL_INTERRUPT);
@@ -109,112 +114,112 @@ void IDT_init()
 // idt[32-255]
 void GENERAL_INTERRUPT()
 {
-  printf("GENERAL_INTERRUPT\n");
+  klog(KLOG_ERR, "GENERAL_INTERRUPT");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[0]
 void DIVIDE_ERROR_EXCEPTION()
 {
-  printf("DIVIDE_ERROR_EXCEPTION\n");
+  klog(KLOG_ERR, "DIVIDE_ERROR_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[1]
 void DEBUG_EXCEPTION()
 {
-  printf("DEBUG_EXCEPTION\n");
+  klog(KLOG_ERR, "DEBUG_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[2]
 void NMI_INTERRUPT()
 {
-  printf("NMI_INTERRUPT\n");
+  klog(KLOG_ERR, "NMI_INTERRUPT");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[3]
 void BREAKPOINT_EXCEPTION()
 {
-  printf("BREAKPOINT_EXCEPTION\n");
+  klog(KLOG_ERR, "BREAKPOINT_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[4]
 void OVERFLOW_EXCEPTION()
 {
-  printf("OVERFLOW_EXCEPTION\n");
+  klog(KLOG_ERR, "OVERFLOW_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[5]
 void BOUND_RANGE_EXCEEDED_EXCEPTION()
 {
-  printf("BOUND_RANGE_EXCEEDED_EXCEPTION\n");
+  klog(KLOG_ERR, "BOUND_RANGE_EXCEEDED_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[6]
 void INVALID_OPCODE_EXCEPTION()
 {
-  printf("INVALID_OPCODE_EXCEPTION\n");
+  klog(KLOG_ERR, "INVALID_OPCODE_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[7]
 void DEVICE_NOT_AVAILABLE_EXCEPTION()
 {
-  printf("DEVICE_NOT_AVAILABLE_EXCEPTION\n");
+  klog(KLOG_ERR, "DEVICE_NOT_AVAILABLE_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[8]
 void DOUBLE_FAULT_EXCEPTION()
 {
-  printf("DOUBLE_FAULT_EXCEPTION\n");
+  klog(KLOG_ERR, "DOUBLE_FAULT_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[9]
 void COPROCESSOR_SEGMENT_OVERRUN()
 {
-  printf("COPROCESSOR_SEGMENT_OVERRUN\n");
+  klog(KLOG_ERR, "COPROCESSOR_SEGMENT_OVERRUN");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[10]
 void INVALID_TSS_EXCEPTION()
 {
-  printf("INVALID_TSS_EXCEPTION\n");
+  klog(KLOG_ERR, "INVALID_TSS_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[11]
 void SEGMENT_NOT_PRESENT()
 {
-  printf("SEGMENT_NOT_PRESENT\n");
+  klog(KLOG_ERR, "SEGMENT_NOT_PRESENT");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[12]
 void STACK_FAULT_EXCEPTION()
 {
-  printf("STACK_FAULT_EXCEPTION\n");
+  klog(KLOG_ERR, "STACK_FAULT_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[13]
 void GENERAL_PROTECTION_EXCEPTION()
 {
-  printf("GENERAL_PROTECTION_EXCEPTION\n");
+  klog(KLOG_ERR, "GENERAL_PROTECTION_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[14]
 void PAGE_FAULT_EXCEPTION()
 {
-  printf("PAGE_FAULT_EXCEPTION\n");
+  klog(KLOG_ERR, "PAGE_FAULT_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
@@ -223,28 +228,28 @@ void PAGE_FAULT_EXCEPTION()
 // idt[16]
 void X87_FPU_FLOATING_POINT_ERROR()
 {
-  printf("X87_FPU_FLOATING_POINT_ERROR\n");
+  klog(KLOG_ERR, "X87_FPU_FLOATING_POINT_ERROR");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[17]
 void ALIGNMENT_CHECK_EXCEPTION()
 {
-  printf("ALIGNMENT_CHECK_EXCEPTION\n");
+  klog(KLOG_ERR, "ALIGNMENT_CHECK_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[18]
 void MACHINE_CHECK_EXCEPTION()
 {
-  printf("MACHINE_CHECK_EXCEPTION\n");
+  klog(KLOG_ERR, "MACHINE_CHECK_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
 // idt[19]
 void SIMD_FLOATING_POINT_EXCEPTION()
 {
-  printf("SIMD_FLOATING_POINT_EXCEPTION\n");
+  klog(KLOG_ERR, "SIMD_FLOATING_POINT_EXCEPTION");
   halt(HALT_BY_EXCEPTION);
 }
 
@@ -22,7 +22,25 @@ void INT_HANDLER_44();
 /* Interrupt Handler for the PIT */
 void INT_HANDLER_32();
 
+/* Interrupt Handler for the COM1 serial port */
+void INT_HANDLER_36();
+
+/* Interrupt Handler for the local APIC timer */
+void INT_HANDLER_240();
+
+/* Interrupt Handler for the TLB shootdown IPI */
+void INT_HANDLER_241();
+
+/* Local APIC spurious interrupt vector */
+void APIC_SPURIOUS();
+
 /* System Call Interrup Handler */
 void SYSCALL_INTERRUPT();
 
+/* SYSENTER entry point (same jump table as SYSCALL_INTERRUPT) */
+void SYSENTER_ENTRY();
+
+/* system call handlers by number (entry 0 is unused) */
+extern void* jumptable[];
+
 #endif
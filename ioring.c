@@ -0,0 +1,315 @@
+/*
+	ioring.c
+
+	Asynchronous I/O rings (see ioring.h). The shared page and its page
+	table come from the frame pool, so the kernel reaches a ring through
+	its identity mapping from any context; the user mapping at
+	IORING_ADDR is one of the process's windows (see paging.h).
+
+	Requests run through the process's fd_array just like read() and
+	write(), always in the process's own context with interrupts on: in
+	io_enter(), or on the way out of one of its system calls. Never from
+	an interrupt handler. A request is only run once it can't block.
+	io_enter() waits for completions by sleeping its terminal; the
+	keyboard, RTC, mouse and pipe wakeups that poll() relies on end the
+	wait.
+*/
+
+#include "ioring.h"
+#include "system_calls.h"
+#include "scheduler.h"
+
+ioring_t iorings[MAX_NUM_PROCS];
+spinlock_t ioring_lock = SPINLOCK_INIT("ioring");
+
+/*
+	ioring_ready()
+
+	Description: tells whether a request would finish without waiting,
+				 from the file's poll hook
+	Inputs: pcb = owner, sqe = request
+	Outputs: 1 if it can run now, 0 if not
+*/
+static int ioring_ready(pcb_t* pcb, io_sqe_t* sqe)
+{
+	fd_t* f;
+	int32_t mask;
+
+	if( sqe->fd < MIN_FD_NUM || sqe->fd >= FD_ARRAY_SIZE )
+		return 1;
+
+	f = &pcb->fd_array[sqe->fd];
+	if( f->flags == FREE )
+		return 1;
+
+	/* errors are reported by running the request */
+	mask = f->f_op.poll(pcb, sqe->fd);
+	if( mask < 0 )
+		return 1;
+	if( sqe->opcode == IORING_OP_READ )
+		return (mask & POLLIN) != 0;
+	if( sqe->opcode == IORING_OP_WRITE )
+		return (mask & POLLOUT) != 0;
+	return 1;
+}
+
+/*
+	ioring_run()
+
+	Description: carries out a request with the same checks as read() and
+				 write(), plus one on the buffer: a request may run after
+				 io_enter() has returned, so it must not point anywhere
+				 but the user page
+	Inputs: pcb = owner, sqe = request
+	Outputs: the result for the completion
+*/
+static int32_t ioring_run(pcb_t* pcb, io_sqe_t* sqe)
+{
+	fd_t* f;
+
+	if( sqe->opcode == IORING_OP_NOP )
+		return 0;
+	if( sqe->opcode != IORING_OP_READ && sqe->opcode != IORING_OP_WRITE )
+		return -1;
+	if( sqe->fd < MIN_FD_NUM || sqe->fd >= FD_ARRAY_SIZE || sqe->len < 0 || sqe->len > MB4 )
+		return -1;
+	if( (uint32_t)sqe->buf < MB128 || (uint32_t)sqe->buf - MB128 > MB4 - sqe->len )
+		return -1;
+
+	f = &pcb->fd_array[sqe->fd];
+	if( f->flags == FREE )
+		return -1;
+
+	if( sqe->opcode == IORING_OP_READ )
+		return f->f_op.read(sqe->fd, sqe->buf, sqe->len);
+	return f->f_op.write(sqe->fd, sqe->buf, sqe->len);
+}
+
+/*
+	ioring_complete()
+
+	Description: posts a completion
+	Inputs: r = ring, user_data = the request's, res = its result
+	Outputs: None
+	Side Effects: counts it in cq_overflow if the queue is full
+*/
+static void ioring_complete(ioring_t* r, uint32_t user_data, int32_t res)
+{
+	io_ring_t* ring = r->ring;
+	uint32_t flags;
+
+	spin_lock_irqsave(&ioring_lock, flags);
+	if( ring->cq_tail - ring->cq_head >= IORING_CQ_ENTRIES )
+	{
+		ring->cq_overflow++;
+	}
+	else
+	{
+		ring->cq[ring->cq_tail & (IORING_CQ_ENTRIES - 1)].user_data = user_data;
+		ring->cq[ring->cq_tail & (IORING_CQ_ENTRIES - 1)].res = res;
+		/* the entry must be visible before the new tail */
+		barrier();
+		ring->cq_tail++;
+	}
+	spin_unlock_irqrestore(&ioring_lock, flags);
+}
+
+/*
+	ioring_run_pending()
+
+	Description: runs the pending requests that have become ready, one at
+				 a time (taken off the list under the lock, run without it)
+	Inputs: pcb = owner, r = its ring
+	Outputs: None
+*/
+static void ioring_run_pending(pcb_t* pcb, ioring_t* r)
+{
+	io_sqe_t sqe;
+	uint32_t flags;
+	uint32_t i;
+	int found;
+
+	do {
+		found = 0;
+		spin_lock_irqsave(&ioring_lock, flags);
+		for( i = 0; i < r->num_pending; i++ )
+		{
+			if( ioring_ready(pcb, &r->pending[i]) )
+			{
+				sqe = r->pending[i];
+				r->pending[i] = r->pending[--r->num_pending];
+				found = 1;
+				break;
+			}
+		}
+		spin_unlock_irqrestore(&ioring_lock, flags);
+
+		if( found )
+			ioring_complete(r, sqe.user_data, ioring_run(pcb, &sqe));
+	} while( found );
+}
+
+/*
+	ioring_any_ready()
+
+	Description: tells whether a pending request could run now
+	Inputs: pcb = owner, r = its ring
+	Outputs: 1 if one could, 0 if not
+*/
+static int ioring_any_ready(pcb_t* pcb, ioring_t* r)
+{
+	uint32_t flags;
+	uint32_t i;
+	int ready = 0;
+
+	spin_lock_irqsave(&ioring_lock, flags);
+	for( i = 0; i < r->num_pending && !ready; i++ )
+		ready = ioring_ready(pcb, &r->pending[i]);
+	spin_unlock_irqrestore(&ioring_lock, flags);
+	return ready;
+}
+
+/*
+	ioring_setup()
+
+	Description: gives the process a ring (once) and maps it
+	Inputs: pcb = the calling process
+	Outputs: IORING_ADDR, -1 if no frames are left
+*/
+int32_t ioring_setup(pcb_t* pcb)
+{
+	ioring_t* r = &iorings[pcb->process_id];
+	uint32_t ring, table;
+
+	if( r->ring != NULL )
+		return IORING_ADDR;
+
+	ring = alloc_frame();
+	table = alloc_frame();
+	if( ring == 0 || table == 0 )
+	{
+		if( ring != 0 )
+			free_frame(ring);
+		if( table != 0 )
+			free_frame(table);
+		return -1;
+	}
+
+	((uint32_t*)table)[0] = ring | PAGE_PRESENT | PAGE_RW | PAGE_USER;
+	r->table = (uint32_t*)table;
+	r->num_pending = 0;
+	r->ring = (io_ring_t*)ring;
+
+	user_window_attach(pcb->process_id, USER_WIN_IORING, table | PAGE_PRESENT | PAGE_RW | PAGE_USER);
+	return IORING_ADDR;
+}
+
+/*
+	ioring_enter()
+
+	Description: takes up to to_submit new requests off the submission
+				 queue, runs those that are ready and keeps the others
+				 pending, then sleeps until at least min_complete
+				 completions are unread (or nothing is left pending)
+	Inputs: pcb = the calling process, to_submit, min_complete
+	Outputs: number of requests taken, -1 without a ring
+*/
+int32_t ioring_enter(pcb_t* pcb, int32_t to_submit, int32_t min_complete)
+{
+	ioring_t* r = &iorings[pcb->process_id];
+	io_ring_t* ring = r->ring;
+	io_sqe_t sqe;
+	uint32_t flags;
+	int32_t submitted = 0;
+	int queued;
+
+	if( ring == NULL || to_submit < 0 || min_complete < 0 )
+		return -1;
+	if( min_complete > IORING_CQ_ENTRIES )
+		min_complete = IORING_CQ_ENTRIES;
+
+	while( submitted < to_submit && ring->sq_head != ring->sq_tail )
+	{
+		/* a copy: the program may reuse the slot as soon as sq_head moves */
+		sqe = ring->sq[ring->sq_head & (IORING_SQ_ENTRIES - 1)];
+		barrier();
+		ring->sq_head++;
+		submitted++;
+
+		if( ioring_ready(pcb, &sqe) )
+		{
+			ioring_complete(r, sqe.user_data, ioring_run(pcb, &sqe));
+			continue;
+		}
+
+		spin_lock_irqsave(&ioring_lock, flags);
+		queued = r->num_pending < IORING_SQ_ENTRIES;
+		if( queued )
+			r->pending[r->num_pending++] = sqe;
+		spin_unlock_irqrestore(&ioring_lock, flags);
+		if( !queued )
+			ioring_complete(r, sqe.user_data, -1);
+	}
+
+	while( 1 )
+	{
+		ioring_run_pending(pcb, r);
+		if( ring->cq_tail - ring->cq_head >= (uint32_t)min_complete || r->num_pending == 0 )
+			break;
+
+		sched_sleep(pcb->terminal_number, 0);
+		if( ioring_any_ready(pcb, r) )
+			sched_wakeup(pcb->terminal_number);
+		sched_wait(pcb->terminal_number);
+	}
+
+	return submitted;
+}
+
+/*
+	ioring_release()
+
+	Description: drops a process's ring and its pending requests
+	Inputs: pid = process ID
+	Outputs: None
+*/
+void ioring_release(int pid)
+{
+	ioring_t* r = &iorings[pid];
+	uint32_t ring, table;
+	uint32_t flags;
+
+	spin_lock_irqsave(&ioring_lock, flags);
+	ring = (uint32_t)r->ring;
+	table = (uint32_t)r->table;
+	r->ring = NULL;
+	r->table = NULL;
+	r->num_pending = 0;
+	spin_unlock_irqrestore(&ioring_lock, flags);
+	user_window_set(pid, USER_WIN_IORING, 0);
+
+	if( ring != 0 )
+	{
+		free_frame(ring);
+		free_frame(table);
+	}
+}
+
+/*
+	ioring_poll()
+
+	Description: completes what has become ready among the calling
+				 process's pending requests. Called on the way out of
+				 every system call (int_handler.S), with interrupts on and
+				 the caller's program mapped.
+	Inputs: None
+	Outputs: None
+*/
+void ioring_poll()
+{
+	pcb_t* pcb = get_PCB_from_stack();
+	ioring_t* r = &iorings[pcb->process_id];
+
+	if( r->num_pending != 0 )
+		ioring_run_pending(pcb, r);
+}
@@ -0,0 +1,83 @@
+/*
+	ioring.h
+
+	Asynchronous I/O rings. io_setup() maps a page holding a submission
+	queue (filled by the program) and a completion queue (filled by the
+	kernel) at IORING_ADDR. io_enter() hands the kernel new submissions.
+	Reads and writes that can finish right away complete there; the rest
+	(a terminal line, an RTC tick or a mouse event that hasn't come yet)
+	stay pending while the program keeps running. They are completed on
+	the way out of the program's next system call once they can be (an
+	io_enter(0, 0) is enough), or while io_enter() waits for them.
+*/
+
+#ifndef _IORING_H
+#define _IORING_H
+
+#include "types.h"
+#include "spinlock.h"
+
+#define IORING_ADDR 		0x0C000000 	// 192 MB
+#define IORING_SQ_ENTRIES 	64 			/* powers of two */
+#define IORING_CQ_ENTRIES 	128
+
+/* opcodes */
+#define IORING_OP_NOP 		0
+#define IORING_OP_READ 		1
+#define IORING_OP_WRITE 	2
+
+/* one request */
+typedef struct io_sqe_t {
+	uint32_t opcode;
+	int32_t fd;
+	uint8_t* buf;           /* must lie in the 128 MB user page */
+	int32_t len;
+	uint32_t user_data;     /* handed back in the completion */
+} io_sqe_t;
+
+/* one completion */
+typedef struct io_cqe_t {
+	uint32_t user_data;
+	int32_t res;            /* what read() / write() returned */
+} io_cqe_t;
+
+/*
+	The shared page. The program produces at sq_tail and consumes at
+	cq_head; the kernel consumes at sq_head and produces at cq_tail. The
+	counters run freely, an index is the counter masked by the size.
+*/
+typedef struct io_ring_t {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	volatile uint32_t cq_overflow;  /* completions lost to a full queue */
+	io_sqe_t sq[IORING_SQ_ENTRIES];
+	io_cqe_t cq[IORING_CQ_ENTRIES];
+} io_ring_t;
+
+/* kernel side of a process's ring */
+typedef struct ioring_t {
+	io_ring_t* ring;        /* kernel address of the shared page, NULL if none */
+	uint32_t* table;        /* page table mapping it at IORING_ADDR */
+	io_sqe_t pending[IORING_SQ_ENTRIES];    /* submitted, not ready yet */
+	uint32_t num_pending;
+} ioring_t;
+
+/* indexed by process ID */
+extern ioring_t iorings[];
+/* protects every ring's pending list and completion queue */
+extern spinlock_t ioring_lock;
+
+struct pcb_t;
+
+/* gives a process a ring and maps it; outputs its user address or -1 */
+int32_t ioring_setup(struct pcb_t* pcb);
+/* takes submissions and waits for completions (io_enter) */
+int32_t ioring_enter(struct pcb_t* pcb, int32_t to_submit, int32_t min_complete);
+/* frees a process's ring (halt) */
+void ioring_release(int pid);
+/* system call exit: completes the caller's pending requests that are ready */
+void ioring_poll();
+
+#endif
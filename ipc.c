@@ -0,0 +1,257 @@
+/*
+	ipc.c
+
+	Message passing (see ipc.h). Like an I/O ring, a window's page table
+	and pages come from the frame pool and the user mapping at IPC_ADDR
+	is one of the process's windows (see paging.h). A
+	window's page table is only changed by its own process, so ipc_lock
+	just covers the mailbox queues.
+*/
+
+#include "ipc.h"
+#include "lib.h"
+#include "paging.h"
+#include "system_calls.h"
+#include "scheduler.h"
+
+#define IPC_PTE_FLAGS 	(PAGE_PRESENT | PAGE_RW | PAGE_USER)
+
+ipc_box_t ipc_boxes[MAX_NUM_PROCS];
+spinlock_t ipc_lock = SPINLOCK_INIT("ipc");
+
+/*
+	ipc_user_msg()
+
+	Description: checks that a message lies in the 128 MB user page
+	Inputs: msg = user pointer
+	Outputs: 1 if it does, 0 if not
+*/
+static int ipc_user_msg(ipc_msg_t* msg)
+{
+	return (uint32_t)msg >= MB128 && (uint32_t)msg - MB128 <= MB4 - sizeof(ipc_msg_t);
+}
+
+/*
+	ipc_free_table()
+
+	Description: frees a window's pages and its page table
+	Inputs: table = page table
+	Outputs: None
+*/
+static void ipc_free_table(uint32_t* table)
+{
+	int i;
+
+	for( i = 0; i < IPC_WINDOW_PAGES; i++ )
+	{
+		if( table[i] & PAGE_PRESENT )
+			free_frame(table[i] & PAGE_ADDR_MASK);
+	}
+	free_frame((uint32_t)table);
+}
+
+/*
+	ipc_setup()
+
+	Description: gives the process a message window (once), maps it and
+				 opens its mailbox
+	Inputs: pcb = the calling process
+	Outputs: IPC_ADDR, -1 if no frames are left
+*/
+int32_t ipc_setup(pcb_t* pcb)
+{
+	ipc_box_t* box = &ipc_boxes[pcb->process_id];
+	uint32_t* table;
+	uint32_t page;
+	uint32_t flags;
+	int i;
+
+	if( box->table != NULL )
+		return IPC_ADDR;
+
+	table = (uint32_t*)alloc_frame();
+	if( table == NULL )
+		return -1;
+	for( i = 0; i < IPC_WINDOW_PAGES; i++ )
+	{
+		page = alloc_frame();
+		if( page == 0 )
+		{
+			ipc_free_table(table);
+			return -1;
+		}
+		table[i] = page | IPC_PTE_FLAGS;
+	}
+
+	spin_lock_irqsave(&ipc_lock, flags);
+	box->head = box->tail = 0;
+	box->term = pcb->terminal_number;
+	box->table = table;
+	spin_unlock_irqrestore(&ipc_lock, flags);
+
+	user_window_attach(pcb->process_id, USER_WIN_IPC, (uint32_t)table | IPC_PTE_FLAGS);
+	return IPC_ADDR;
+}
+
+/*
+	ipc_send()
+
+	Description: queues a message in another process's mailbox. The
+				 payload pages move out of the sender's window into the
+				 message; the sender's window gets zeroed pages instead.
+	Inputs: pcb = the calling process, pid = receiver, msg = user message
+	Outputs: 0 for success, -1 for failure (bad message, receiver has no
+			 mailbox or it is full, no frames left)
+	Side Effects: wakes the receiver
+*/
+int32_t ipc_send(pcb_t* pcb, int32_t pid, ipc_msg_t* msg)
+{
+	ipc_box_t* self = &ipc_boxes[pcb->process_id];
+	ipc_box_t* box;
+	ipc_entry_t* e;
+	uint32_t fresh[IPC_WINDOW_PAGES];
+	uint32_t num_pages, page;
+	uint32_t flags;
+	uint32_t i;
+	int term = 0;
+	int sent = 0;
+
+	if( pid < 0 || pid >= MAX_NUM_PROCS || !ipc_user_msg(msg) || msg->len > IPC_INLINE )
+		return -1;
+	num_pages = msg->num_pages;
+	page = msg->page;
+	if( num_pages > IPC_WINDOW_PAGES || page > IPC_WINDOW_PAGES - num_pages ||
+		(num_pages != 0 && self->table == NULL) )
+		return -1;
+	box = &ipc_boxes[pid];
+
+	/* replacements first, outside the lock: allocating zeroes a page */
+	for( i = 0; i < num_pages; i++ )
+	{
+		fresh[i] = alloc_frame();
+		if( fresh[i] == 0 )
+		{
+			while( i-- > 0 )
+				free_frame(fresh[i]);
+			return -1;
+		}
+	}
+
+	spin_lock_irqsave(&ipc_lock, flags);
+	if( box->table != NULL && box->tail - box->head < IPC_QUEUE )
+	{
+		e = &box->queue[box->tail & (IPC_QUEUE - 1)];
+		e->sender = pcb->process_id;
+		e->len = msg->len;
+		memcpy(e->data, msg->data, msg->len);
+		e->num_pages = num_pages;
+		for( i = 0; i < num_pages; i++ )
+		{
+			e->frames[i] = self->table[page + i] & PAGE_ADDR_MASK;
+			self->table[page + i] = fresh[i] | IPC_PTE_FLAGS;
+		}
+		box->tail++;
+		term = box->term;
+		sent = 1;
+	}
+	spin_unlock_irqrestore(&ipc_lock, flags);
+
+	if( !sent )
+	{
+		for( i = 0; i < num_pages; i++ )
+			free_frame(fresh[i]);
+		return -1;
+	}
+
+	if( num_pages != 0 )
+		flush_tlb();
+	sched_wakeup(term);
+	return 0;
+}
+
+/*
+	ipc_recv()
+
+	Description: takes the oldest message from the mailbox, waiting for
+				 one if it is empty. Payload pages are mapped at the start
+				 of the window, replacing (and freeing) what was there.
+	Inputs: pcb = the calling process, msg = user message to fill in
+	Outputs: 0 for success, -1 for failure (bad message, no mailbox)
+*/
+int32_t ipc_recv(pcb_t* pcb, ipc_msg_t* msg)
+{
+	ipc_box_t* box = &ipc_boxes[pcb->process_id];
+	ipc_entry_t e;
+	uint32_t flags;
+	uint32_t i;
+	int found;
+
+	if( !ipc_user_msg(msg) || box->table == NULL )
+		return -1;
+
+	while( 1 )
+	{
+		spin_lock_irqsave(&ipc_lock, flags);
+		found = box->head != box->tail;
+		if( found )
+			e = box->queue[box->head++ & (IPC_QUEUE - 1)];
+		spin_unlock_irqrestore(&ipc_lock, flags);
+		if( found )
+			break;
+
+		sched_sleep(pcb->terminal_number, 0);
+		if( box->head != box->tail )
+			sched_wakeup(pcb->terminal_number);
+		sched_wait(pcb->terminal_number);
+	}
+
+	for( i = 0; i < e.num_pages; i++ )
+	{
+		free_frame(box->table[i] & PAGE_ADDR_MASK);
+		box->table[i] = e.frames[i] | IPC_PTE_FLAGS;
+	}
+	if( e.num_pages != 0 )
+		flush_tlb();
+
+	msg->sender = e.sender;
+	msg->len = e.len;
+	memcpy(msg->data, e.data, e.len);
+	msg->page = 0;
+	msg->num_pages = e.num_pages;
+	return 0;
+}
+
+/*
+	ipc_release()
+
+	Description: closes a process's mailbox, frees its window and the
+				 payloads of messages nobody will read
+	Inputs: pid = process ID
+	Outputs: None
+*/
+void ipc_release(int pid)
+{
+	ipc_box_t* box = &ipc_boxes[pid];
+	uint32_t* table;
+	uint32_t flags;
+	uint32_t i;
+	ipc_entry_t* e;
+
+	spin_lock_irqsave(&ipc_lock, flags);
+	table = box->table;
+	box->table = NULL;
+	spin_unlock_irqrestore(&ipc_lock, flags);
+	user_window_set(pid, USER_WIN_IPC, 0);
+
+	if( table == NULL )
+		return;
+
+	/* closed: nothing is added any more */
+	for( ; box->head != box->tail; box->head++ )
+	{
+		e = &box->queue[box->head & (IPC_QUEUE - 1)];
+		for( i = 0; i < e->num_pages; i++ )
+			free_frame(e->frames[i]);
+	}
+	ipc_free_table(table);
+}
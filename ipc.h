@@ -0,0 +1,67 @@
+/*
+	ipc.h
+
+	Message passing between processes. ipc_setup() opens the process's
+	mailbox and maps its message window, IPC_WINDOW_PAGES pages at
+	IPC_ADDR. A message carries up to IPC_INLINE bytes in the message
+	itself and, for large payloads, whole pages of the sender's window:
+	those are unmapped from the sender (who gets fresh zeroed pages in
+	their place) and mapped into the receiver's window, never copied.
+	msg_recv() waits for a message.
+*/
+
+#ifndef _IPC_H
+#define _IPC_H
+
+#include "types.h"
+#include "spinlock.h"
+
+#define IPC_ADDR 			0x0C400000 	// 196 MB
+#define IPC_WINDOW_PAGES 	8
+#define IPC_INLINE 			64
+#define IPC_QUEUE 			4 			/* messages a mailbox holds; a power of two */
+
+/* what a program passes to msg_send() and gets from msg_recv() */
+typedef struct ipc_msg_t {
+	int32_t sender;         /* set by msg_recv() */
+	uint32_t len;           /* bytes used in data */
+	uint8_t data[IPC_INLINE];
+	uint32_t page;          /* first window page of the payload (msg_recv(): always 0) */
+	uint32_t num_pages;     /* pages in the payload, 0 for none */
+} ipc_msg_t;
+
+/* a queued message: the payload is held as physical frames */
+typedef struct ipc_entry_t {
+	int32_t sender;
+	uint32_t len;
+	uint8_t data[IPC_INLINE];
+	uint32_t num_pages;
+	uint32_t frames[IPC_WINDOW_PAGES];
+} ipc_entry_t;
+
+/* kernel side of a process's mailbox */
+typedef struct ipc_box_t {
+	uint32_t* table;        /* page table of the window, NULL while closed */
+	int term;               /* terminal of the owner, to wake it up */
+	ipc_entry_t queue[IPC_QUEUE];
+	uint32_t head;
+	uint32_t tail;
+} ipc_box_t;
+
+/* indexed by process ID */
+extern ipc_box_t ipc_boxes[];
+/* protects every mailbox */
+extern spinlock_t ipc_lock;
+
+struct pcb_t;
+
+/* opens the process's mailbox and maps its window; outputs IPC_ADDR or -1 */
+int32_t ipc_setup(struct pcb_t* pcb);
+/* queues a message for process pid (msg_send) */
+int32_t ipc_send(struct pcb_t* pcb, int32_t pid, ipc_msg_t* msg);
+/* waits for a message and takes it (msg_recv) */
+int32_t ipc_recv(struct pcb_t* pcb, ipc_msg_t* msg);
+/* closes a process's mailbox, dropping queued messages (halt) */
+void ipc_release(int pid);
+
+#endif
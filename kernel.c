@@ -19,6 +19,12 @@
 #include "paging.h"
 #include "file_system.h"
 #include "scheduler.h"
+#include "fbcon.h"
+#include "serial.h"
+#include "klog.h"
+#include "apic.h"
+#include "smp.h"
+#include "vdso.h"
 
 #define RUN_TESTS 0
 
@@ -26,6 +32,33 @@
 /* Check if the bit BIT in FLAGS is set. */
 #define CHECK_FLAG(flags, bit)   ((flags) & (1 << (bit)))
 
+/* Options read from the kernel command line (before paging hides it) */
+static int opt_fbcon;
+static int opt_serial;
+static int opt_noapic;
+static int opt_smp;
+
+/* int cmdline_option(const int8_t* cmdline, const int8_t* name);
+ * Inputs: cmdline = multiboot command line
+ *         name = option to look for
+ * Return Value: 1 if name appears as a space separated word, else 0
+ * Function: tests for a boolean kernel option such as "fbcon" */
+static int cmdline_option(const int8_t* cmdline, const int8_t* name)
+{
+    uint32_t len = strlen(name);
+
+    while (*cmdline != '\0') {
+        if (strncmp(cmdline, name, len) == 0 && (cmdline[len] == ' ' || cmdline[len] == '\0'))
+            return 1;
+        /* skip to the next word */
+        while (*cmdline != '\0' && *cmdline != ' ')
+            cmdline++;
+        while (*cmdline == ' ')
+            cmdline++;
+    }
+    return 0;
+}
+
 /* Check if MAGIC is valid and print the Multiboot information structure
    pointed by ADDR. */
 void entry(unsigned long magic, unsigned long addr) {
@@ -56,8 +89,13 @@ void entry(unsigned long magic, unsigned long addr) {
         printf("boot_device = 0x%#x\n", (unsigned)mbi->boot_device);
 
     /* Is the command line passed? */
-    if (CHECK_FLAG(mbi->flags, 2))
+    if (CHECK_FLAG(mbi->flags, 2)) {
         printf("cmdline = %s\n", (char *)mbi->cmdline);
+        opt_fbcon = cmdline_option((int8_t*)mbi->cmdline, "fbcon");
+        opt_serial = cmdline_option((int8_t*)mbi->cmdline, "serial");
+        opt_noapic = cmdline_option((int8_t*)mbi->cmdline, "noapic");
+        opt_smp = cmdline_option((int8_t*)mbi->cmdline, "smp");
+    }
 
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
@@ -162,6 +200,19 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Init Paging */
     paging_init();
 
+    /* Deliver interrupts through the APICs unless told not to (before any
+     * device enables its IRQ) */
+    if (!opt_noapic) {
+        if (apic_init() == 0)
+            klog(KLOG_INFO, "apic: %u cpus, I/O APIC at %x", apic.num_cpus, (uint32_t)apic.ioapic);
+        else
+            klog(KLOG_WARN, "apic: no local APIC, using the 8259");
+    }
+
+    /* Move the terminals onto the framebuffer console if asked to */
+    if (opt_fbcon && fbcon_init() != 0)
+        klog(KLOG_WARN, "fbcon: no usable framebuffer, staying in text mode");
+
     /* Initialize devices, memory, filesystem, enable device interrupts on the
      * PIC, any other initialization stuff... */
 
@@ -171,20 +222,41 @@ void entry(unsigned long magic, unsigned long addr) {
     /* Init the IDT */
     IDT_init();
 
+    /* Fast system calls alongside int 0x80 */
+    sysenter_enabled = (sysenter_init() == 0);
+    if (!sysenter_enabled)
+        klog(KLOG_WARN, "sysenter: not supported, only int 0x80");
+
     /* Init the keyboard*/
     keyboard_init();
 
     /* Init the terminals, sets up Terminal 1 to boot first */
     terminal_init();
 
+    /* Mirror Terminal 1 to COM1 and take input from it for headless runs */
+    if (opt_serial && serial_init(0) != 0)
+        klog(KLOG_WARN, "serial: no UART on COM1");
+
     /* enable the cursor */
     enable_cursor();
 
     /* Init the mouse */
-    //mouse_init();
+    mouse_init();
 
     /* Init the pit and scheduler stuff */
     scheduler_init();
+
+    /* Map the time page into every process (needs the PIT ticking) */
+    if (vdso_init() != 0)
+        klog(KLOG_WARN, "vdso: no time page");
+
+    /* Start the other CPUs (needs the PIT to time the startup) */
+    if (opt_smp) {
+        if (smp_init() == 0)
+            klog(KLOG_INFO, "smp: %u CPUs online", num_cpus_online);
+        else
+            klog(KLOG_WARN, "smp: no other CPUs started");
+    }
 /*
 #ifdef RUN_TESTS
     // Run tests
@@ -76,14 +76,8 @@ void keyboard_handler()
 	unsigned char ascii = inb(KEYBOARD_PORT);
 	ascii = scan_to_ASCII(ascii);
 
-	/* print it to the screen */
-	if( (ascii != 0 && ascii != BACKSPACE) && (terminals[visible_terminal].length < PRINT_LENGTH || ascii == ENTER) )
-		putc(ascii, visible_terminal);
-  /* send ascii value to buffer for handling the buffer */
-  handle_buffer(ascii, visible_terminal);
-
-	/* update cursor */
-	update_cursor(visible_terminal);
+	/* echo it and hand it to the visible terminal's line buffer */
+	terminal_input(ascii, visible_terminal);
 
 	sti();
 }
@@ -138,7 +132,7 @@ unsigned char scan_to_ASCII(unsigned char code)
 			alt_flag = 0; break;
 
 		case BACKSPACE_PRESS:
-			backspace(visible_terminal); return BACKSPACE;
+			return BACKSPACE;
 
 		default:
 			break;
@@ -163,66 +157,13 @@ unsigned char scan_to_ASCII(unsigned char code)
 		return 0;
 	}
 
-	if( alt_flag && (code == F1) )
-	{
-		int prev_term = visible_terminal;
-		visible_terminal = 0;
-		int curr_term = visible_terminal;
-		terminals[prev_term].is_visible = 0;
-		terminals[curr_term].is_visible = 1;
-		/* point Terminal 1's video memory page to physical video memory */
-		display_terminal(curr_term, prev_term);
-		update_cursor(visible_terminal);
-		sti();
-		return 0;
-	}
-
-	if( alt_flag && (code == F2) )
-	{
-		int prev_term = visible_terminal;
-		visible_terminal = 1;
-		int curr_term = visible_terminal;
-		terminals[prev_term].is_visible = 0;
-		terminals[curr_term].is_visible = 1;
-		/* point Terminal 2's video memory page to physical video memory */
-		display_terminal(curr_term, prev_term);
-		update_cursor(visible_terminal);
-		if( terminals[1].has_been_launched == 0 )
-		{
-			sti();
-			/* launch Terminal 2's base shell */
-			if( execute((uint8_t*)"shell") == 0 )
-			{
-					/* execute failed due to max processes reached, reset has_been_launched and curr_idx */
-					terminals[1].has_been_launched = 0;
-					curr_idx = restore_curr_idx;
-			}
-		}
-		sti();
-		return 0;
-	}
-
-	if( alt_flag && (code == F3) )
+	/* ALT + F1..F12 switches to (and if needed creates) that terminal */
+	if( alt_flag && ((code >= F1 && code <= F10) || code == F11 || code == F12) )
 	{
-		int prev_term = visible_terminal;
-		visible_terminal = 2;
-		int curr_term = visible_terminal;
-		terminals[prev_term].is_visible = 0;
-		terminals[curr_term].is_visible = 1;
-		/* point Terminal 3's video memory page to physical video memory */
-		display_terminal(curr_term, prev_term);
-		update_cursor(visible_terminal);
-		if( terminals[2].has_been_launched == 0 )
-		{
-			sti();
-			/* launch Terminal 3's base shell */
-			if( execute((uint8_t*)"shell") == 0 )
-			{
-					/* execute failed due to max processes reached, reset has_been_launched and curr_idx */
-					terminals[2].has_been_launched = 0;
-					curr_idx = restore_curr_idx;
-			}
-		}
+		if( code <= F10 )
+			switch_terminal(code - F1);
+		else
+			switch_terminal(code - F11 + (F10 - F1 + 1));
 		sti();
 		return 0;
 	}
@@ -34,8 +34,9 @@
 #define SPACE 				32
 #define TAB 				9
 #define F1          0x3B
-#define F2          0x3C
-#define F3          0x3D
+#define F10         0x44
+#define F11         0x57
+#define F12         0x58
 
 /* Used before Demo, since our laptops required Fn key for F#'s */
 #define ONE         0x02
@@ -0,0 +1,233 @@
+/*
+	klog.c
+
+	Kernel log ring. Writers claim a slot with one lock xadd on the head
+	counter, fill it in and publish it by storing its sequence number, so
+	logging from an interrupt handler costs a handful of stores and no
+	formatting or screen updates. When the ring wraps the oldest records
+	are overwritten.
+
+	The records are formatted only when they are read: klog_drain() prints
+	new records to the console from the PIT handler, a few per tick, and
+	the dmesg() system call formats the whole ring for user space.
+*/
+
+#include "klog.h"
+#include "lib.h"
+#include "scheduler.h"
+
+static klog_record_t klog_ring[KLOG_ENTRIES];
+static volatile uint32_t klog_head;     /* next position to hand out */
+static uint32_t klog_tail;              /* next position klog_drain() prints */
+static uint32_t klog_dropped;           /* records overwritten before they were printed */
+
+uint32_t klog_console_level = KLOG_INFO;
+
+static int8_t* klog_level_names[KLOG_NUM_LEVELS] = { "err", "warn", "info", "debug" };
+
+/* vformat() sink writing into a bounded buffer */
+typedef struct klog_buf_t {
+	uint8_t* buf;
+	int32_t len;
+	int32_t size;
+} klog_buf_t;
+
+static void klog_buf_emit(uint8_t c, void* ctx)
+{
+	klog_buf_t* b = (klog_buf_t*)ctx;
+
+	if( b->len < b->size )
+		b->buf[b->len++] = c;
+}
+
+/*
+	klog_count_args()
+
+	Description: counts the argument dwords a format string consumes,
+				 following vformat()'s conversions
+	Inputs: fmt = format string
+	Outputs: number of arguments, at most KLOG_MAX_ARGS
+*/
+static int klog_count_args(int8_t* fmt)
+{
+	int n = 0;
+
+	while( *fmt != '\0' && n < KLOG_MAX_ARGS )
+	{
+		if( *fmt++ != '%' )
+			continue;
+		while( *fmt == '#' )
+			fmt++;
+		switch( *fmt )
+		{
+			case 'x': case 'u': case 'd': case 'c': case 's':
+				n++;
+				break;
+			case '\0':
+				return n;
+		}
+		fmt++;
+	}
+	return n;
+}
+
+/*
+	klog()
+
+	Description: appends a record to the log. Takes printf() style
+				 arguments (up to KLOG_MAX_ARGS of them); only the ones
+				 the format uses are read, the rest of the record is
+				 zeroed.
+	Inputs: level = KLOG_* level, fmt = format string
+	Outputs: None
+	Side Effects: may overwrite the oldest record
+*/
+void klog(uint32_t level, int8_t* fmt, ...)
+{
+	uint32_t* args = (uint32_t*)&fmt + 1;
+	uint32_t pos = atomic_xadd(&klog_head, 1);
+	klog_record_t* rec = &klog_ring[pos & (KLOG_ENTRIES - 1)];
+	int nargs = klog_count_args(fmt);
+	int i;
+
+	/* readers must not take a half written record for the old one */
+	rec->seq = 0;
+	barrier();
+
+	rec->level = level;
+	rec->ticks = pit_ticks;
+	rec->tsc = rdtsc();
+	rec->fmt = fmt;
+	for( i = 0; i < KLOG_MAX_ARGS; i++ )
+		rec->args[i] = (i < nargs) ? args[i] : 0;
+
+	barrier();
+	rec->seq = pos + 1;
+}
+
+/*
+	klog_fetch()
+
+	Description: copies out the record at a ring position
+	Inputs: pos = ring position, out = where to copy it
+	Outputs: 1 if out holds that record, 0 if it isn't complete yet or
+			 was overwritten while being copied
+*/
+static int klog_fetch(uint32_t pos, klog_record_t* out)
+{
+	klog_record_t* rec = &klog_ring[pos & (KLOG_ENTRIES - 1)];
+
+	if( rec->seq != pos + 1 )
+		return 0;
+	memcpy(out, rec, sizeof(klog_record_t));
+	barrier();
+	return rec->seq == pos + 1;
+}
+
+/*
+	klog_format()
+
+	Description: formats a record as "[ticks] level: message\n"
+	Inputs: rec = record, buf/size = output buffer
+	Outputs: number of bytes written
+*/
+static int32_t klog_format(klog_record_t* rec, uint8_t* buf, int32_t size)
+{
+	klog_buf_t b;
+	uint32_t header[2];
+
+	b.buf = buf;
+	b.len = 0;
+	b.size = size;
+
+	header[0] = rec->ticks;
+	header[1] = (uint32_t)klog_level_names[rec->level < KLOG_NUM_LEVELS ? rec->level : KLOG_DEBUG];
+	vformat(klog_buf_emit, &b, "[%u] %s: ", (int32_t*)header);
+	vformat(klog_buf_emit, &b, rec->fmt, (int32_t*)rec->args);
+
+	/* every record ends up on its own line */
+	if( b.len > 0 && buf[b.len - 1] != '\n' )
+	{
+		if( b.len == size )
+			b.len--;
+		buf[b.len++] = '\n';
+	}
+	return b.len;
+}
+
+/*
+	klog_drain()
+
+	Description: prints records the console hasn't seen yet, skipping any
+				 that were overwritten and those below klog_console_level
+	Inputs: max_records = most records to print in this call
+	Outputs: None
+	Side Effects: called from the PIT handler with interrupts off, takes
+				  terminal_lock while printing
+*/
+void klog_drain(int max_records)
+{
+	klog_record_t rec;
+	uint8_t line[KLOG_LINE_LENGTH + 1];
+	int32_t len;
+
+	while( max_records > 0 && klog_tail != klog_head )
+	{
+		/* writers lapped us */
+		if( klog_head - klog_tail > KLOG_ENTRIES )
+		{
+			klog_dropped += (klog_head - klog_tail) - KLOG_ENTRIES;
+			klog_tail = klog_head - KLOG_ENTRIES;
+			klog(KLOG_WARN, "klog: %u records dropped", klog_dropped);
+		}
+
+		if( !klog_fetch(klog_tail, &rec) )
+		{
+			/* still being written, try again next tick */
+			if( klog_head - klog_tail <= KLOG_ENTRIES )
+				break;
+			continue;
+		}
+		klog_tail++;
+
+		if( rec.level > klog_console_level )
+			continue;
+
+		len = klog_format(&rec, line, KLOG_LINE_LENGTH);
+		line[len] = '\0';
+		spin_lock(&terminal_lock);
+		puts((int8_t*)line);
+		spin_unlock(&terminal_lock);
+		max_records--;
+	}
+}
+
+/*
+	klog_read()
+
+	Description: formats every record still in the ring, oldest first
+	Inputs: buf = output buffer, nbytes = its size
+	Outputs: number of bytes written (whole records only)
+*/
+int32_t klog_read(uint8_t* buf, int32_t nbytes)
+{
+	klog_record_t rec;
+	uint8_t line[KLOG_LINE_LENGTH];
+	uint32_t head = klog_head;
+	uint32_t pos = (head > KLOG_ENTRIES) ? head - KLOG_ENTRIES : 0;
+	int32_t total = 0;
+	int32_t len;
+
+	for( ; pos != head; pos++ )
+	{
+		if( !klog_fetch(pos, &rec) )
+			continue;
+
+		len = klog_format(&rec, line, KLOG_LINE_LENGTH);
+		if( total + len > nbytes )
+			break;
+		memcpy(buf + total, line, len);
+		total += len;
+	}
+	return total;
+}
@@ -0,0 +1,47 @@
+/*
+	klog.h
+
+	Kernel log: lock-free ring of binary records, formatted when read
+*/
+
+#ifndef _KLOG_H
+#define _KLOG_H
+
+#include "types.h"
+
+/* log levels, lower is more important */
+#define KLOG_ERR 			0
+#define KLOG_WARN 			1
+#define KLOG_INFO 			2
+#define KLOG_DEBUG 			3
+#define KLOG_NUM_LEVELS 	4
+
+#define KLOG_ENTRIES 		512 	/* must be a power of two */
+#define KLOG_MAX_ARGS 		6 		/* argument dwords captured per record */
+#define KLOG_LINE_LENGTH 	128 	/* longest formatted record */
+#define KLOG_DRAIN_BATCH 	8 		/* records printed per PIT tick */
+
+/*
+	One log record. The format string and any %s arguments are stored as
+	pointers, so they must outlive the record (string literals do).
+*/
+typedef struct klog_record_t {
+	volatile uint32_t seq;      /* ring position + 1 once the record is complete */
+	uint32_t level;
+	uint32_t ticks;             /* PIT ticks since boot */
+	uint64_t tsc;
+	int8_t* fmt;
+	uint32_t args[KLOG_MAX_ARGS];
+} klog_record_t;
+
+/* records at or above this importance are printed by klog_drain() */
+extern uint32_t klog_console_level;
+
+/* appends a record; safe from any context, never blocks */
+void klog(uint32_t level, int8_t* fmt, ...);
+/* prints up to max_records new records to the console */
+void klog_drain(int max_records);
+/* formats every record still in the ring into buf */
+int32_t klog_read(uint8_t* buf, int32_t nbytes);
+
+#endif
@@ -4,6 +4,8 @@
 #include "lib.h"
 #include "terminal.h"
 char* video_mem = (char *)VIDEO;
+int screen_cols = NUM_COLS;
+int screen_rows = NUM_ROWS;
 
 /* void clear(void);
  * Inputs: terminal number
@@ -16,11 +18,12 @@ void clear(int term_num)
     if( term_num != -1 )
     {
       /* clear both the terminal page and physical vid mem */
-      for (i = 0; i < NUM_ROWS * NUM_COLS; i++)
+      for (i = 0; i < screen_rows * screen_cols; i++)
       {
         *(uint8_t *)(terminals[term_num].vidmem_addr + (i << 1)) = ' ';
-        *(uint8_t *)(terminals[term_num].vidmem_addr + (i << 1) + 1) = ATTRIB;
+        *(uint8_t *)(terminals[term_num].vidmem_addr + (i << 1) + 1) = terminals[term_num].attrib;
       }
+      FBCON_DIRTY(term_num, 0, screen_rows * screen_cols);
     }
     else
     {
@@ -50,14 +53,39 @@ void clear(int term_num)
  *       Also note: %x is the only conversion specifier that can use
  *       the "#" modifier to alter output. */
 int32_t printf(int8_t *format, ...) {
+    /* the other parameters follow the format string on the stack */
+    return vformat(console_emit, NULL, format, (int32_t *)&format + 1);
+}
+
+/* void console_emit(uint8_t c, void* ctx);
+ * Inputs: uint8_t c = character, void* ctx = unused
+ * Function: vformat() sink that prints to the visible terminal */
+void console_emit(uint8_t c, void* ctx) {
+    putc(c, visible_terminal);
+}
+
+/* static void emit_string(emit_fn emit, void* ctx, int8_t* s);
+ * Function: passes a NUL terminated string to a vformat() sink */
+static void emit_string(emit_fn emit, void* ctx, int8_t* s) {
+    while (*s != '\0') {
+        emit(*s, ctx);
+        s++;
+    }
+}
+
+/* int32_t vformat(emit_fn emit, void* ctx, int8_t* format, int32_t* esp);
+ * Inputs: emit_fn emit = called with every output character
+ *         void* ctx = passed through to emit
+ *         int8_t* format = printf() format string
+ *         int32_t* esp = the arguments, one dword each
+ * Return Value: number of format characters consumed
+ * Function: the formatting engine behind printf() (same conversions),
+ *           usable with any output sink */
+int32_t vformat(emit_fn emit, void* ctx, int8_t* format, int32_t* esp) {
 
     /* Pointer to the format string */
     int8_t* buf = format;
 
-    /* Stack pointer for the other parameters */
-    int32_t* esp = (void *)&format;
-    esp++;
-
     while (*buf != '\0') {
         switch (*buf) {
             case '%':
@@ -70,7 +98,7 @@ format_char_switch:
                     switch (*buf) {
                         /* Print a literal '%' character */
                         case '%':
-                            putc('%', visible_terminal);
+                            emit('%', ctx);
                             break;
 
                         /* Use alternate formatting */
@@ -88,7 +116,7 @@ format_char_switch:
                                 int8_t conv_buf[64];
                                 if (alternate == 0) {
                                     itoa(*((uint32_t *)esp), conv_buf, 16);
-                                    puts(conv_buf);
+                                    emit_string(emit, ctx, conv_buf);
                                 } else {
                                     int32_t starting_index;
                                     int32_t i;
@@ -98,7 +126,7 @@ format_char_switch:
                                         conv_buf[i] = '0';
                                         i++;
                                     }
-                                    puts(&conv_buf[starting_index]);
+                                    emit_string(emit, ctx, &conv_buf[starting_index]);
                                 }
                                 esp++;
                             }
@@ -109,7 +137,7 @@ format_char_switch:
                             {
                                 int8_t conv_buf[36];
                                 itoa(*((uint32_t *)esp), conv_buf, 10);
-                                puts(conv_buf);
+                                emit_string(emit, ctx, conv_buf);
                                 esp++;
                             }
                             break;
@@ -125,20 +153,20 @@ format_char_switch:
                                 } else {
                                     itoa(value, conv_buf, 10);
                                 }
-                                puts(conv_buf);
+                                emit_string(emit, ctx, conv_buf);
                                 esp++;
                             }
                             break;
 
                         /* Print a single character */
                         case 'c':
-                            putc((uint8_t) *((int32_t *)esp), visible_terminal);
+                            emit((uint8_t) *((int32_t *)esp), ctx);
                             esp++;
                             break;
 
                         /* Print a NULL-terminated string */
                         case 's':
-                            puts(*((int8_t **)esp));
+                            emit_string(emit, ctx, *((int8_t **)esp));
                             esp++;
                             break;
 
@@ -150,7 +178,7 @@ format_char_switch:
                 break;
 
             default:
-                putc(*buf, visible_terminal);
+                emit(*buf, ctx);
                 break;
         }
         buf++;
@@ -179,6 +207,17 @@ int32_t puts(int8_t* s) {
 void putc(uint8_t c, int term_num)
 {
     uint8_t * virt_addr = (uint8_t*)terminals[term_num].vidmem_addr;
+    uint8_t attrib;
+    int cell;
+
+    /* the serial mirror gets the raw stream, escapes included */
+    if( serial.enabled && term_num == serial.term )
+        serial_putc(c);
+
+    /* escape sequences (cursor movement, erase, colors) are handled by the ANSI parser */
+    if( ansi_putc(c, term_num) )
+        return;
+    attrib = terminals[term_num].attrib;
 
     /* new line char, or we are at the far right, need to wrap around */
     if( (c == '\n') || (c == '\r') )
@@ -187,7 +226,7 @@ void putc(uint8_t c, int term_num)
         terminals[term_num].screen_x = 0;
 
         /* if we newline'd at the last line, scroll up */
-        if( terminals[term_num].screen_y == 25 )
+        if( terminals[term_num].screen_y == screen_rows )
             scroll_up(term_num);
 
         /* since enter has been pressed, we must commit the last line */
@@ -196,24 +235,27 @@ void putc(uint8_t c, int term_num)
         return;
     }
     /* bottom right corner, scroll up (resets x and y coords for you) */
-    else if( terminals[term_num].screen_x == 79 && terminals[term_num].screen_y == 24 )
+    else if( terminals[term_num].screen_x == screen_cols - 1 && terminals[term_num].screen_y == screen_rows - 1 )
     {
-        *(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1)) = c;
-        *(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1) + 1) = ATTRIB;
+        *(uint8_t *)(virt_addr + ((screen_cols * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1)) = c;
+        *(uint8_t *)(virt_addr + ((screen_cols * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1) + 1) = attrib;
+        FBCON_DIRTY(term_num, screen_cols * screen_rows - 1, screen_cols * screen_rows);
         scroll_up(term_num);
         terminals[term_num].line_flag--;
         return;
     }
     /* we've reached the far right side, but no new line: wrap around */
-    else if( terminals[term_num].screen_x == 80 )
+    else if( terminals[term_num].screen_x == screen_cols )
     {
         terminals[term_num].screen_y += 1;
         terminals[term_num].screen_x = 0;
     }
     /* sets character to particular location in vid mem */
-    *(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1)) = c;
+    cell = screen_cols * terminals[term_num].screen_y + terminals[term_num].screen_x;
+    *(uint8_t *)(virt_addr + (cell << 1)) = c;
     /* sets character color for this particular character */
-    *(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1) + 1) = ATTRIB;
+    *(uint8_t *)(virt_addr + (cell << 1) + 1) = attrib;
+    FBCON_DIRTY(term_num, cell, cell + 1);
 
     /* update x (y is always updated before printing char) */
     terminals[term_num].screen_x++;
@@ -423,6 +465,10 @@ void* memcpy(void* dest, const void* src, uint32_t n) {
  * Return Value: pointer to dest
  * Function: move n bytes of src to dest */
 void* memmove(void* dest, const void* src, uint32_t n) {
+    /* copying forwards is safe when dest is below src, so use the dword copy */
+    if (dest <= src)
+        return memcpy(dest, src, n);
+
     asm volatile ("                             \n\
             movw    %%ds, %%dx                  \n\
             movw    %%dx, %%es                  \n\
@@ -434,6 +480,7 @@ void* memmove(void* dest, const void* src, uint32_t n) {
             std                                 \n\
             .memmove_go:                        \n\
             rep     movsb                       \n\
+            cld                                 \n\
             "
             :
             : "D"(dest), "S"(src), "c"(n)
@@ -9,20 +9,23 @@
 
 /* Constants and Variables from lib.c */
 #define VIDEO           0xB8000
-#define TERM_1_VIDEO    0x1000
-#define TERM_2_VIDEO    0x2000
-#define TERM_3_VIDEO    0x3000
-#define TERM_1_USER_VID 0x8400000 // 132 MB
-#define TERM_2_USER_VID 0x8800000 // 136 MB
-#define TERM_3_USER_VID 0x8C00000 // 140 MB
+#define TERM_USER_VID_BASE  0x8400000 // 132 MB, each terminal gets its own 4 MB slot after it
+#define TERM_USER_VID(n)    (TERM_USER_VID_BASE + ((n) * 0x400000))
 #define NUM_COLS        80
 #define NUM_ROWS        25
-#define ATTRIB          0x2 /* color of text (0x7 is light-grey on black) */
+#define ATTRIB          0x2 /* default color of text (0x7 is light-grey on black), SGR can change it */
 #define BUFFER_LENGTH   128
 
 char* video_mem;        /* pointer to video memory */
+int screen_cols;        /* text grid: NUM_COLS x NUM_ROWS in VGA text mode, larger under fbcon */
+int screen_rows;
+
+/* output sink for vformat() */
+typedef void (*emit_fn)(uint8_t c, void* ctx);
 
 int32_t printf(int8_t *format, ...);
+int32_t vformat(emit_fn emit, void* ctx, int8_t* format, int32_t* esp);
+void console_emit(uint8_t c, void* ctx);
 void putc(uint8_t c, int term_num);
 int32_t puts(int8_t *s);
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
@@ -113,7 +116,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %k1, (%w0)"     \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
@@ -130,6 +133,9 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* interrupt enable bit of EFLAGS */
+#define EFLAGS_IF 0x200
+
 /* Save flags and then clear interrupt flag
  * Saves the EFLAGS register into the variable "flags", and then
  * disables interrupts on this processor */
@@ -171,4 +177,66 @@ do {                                    \
     );                                  \
 } while (0)
 
+/* Atomically adds val to *ptr and returns the previous value */
+static inline uint32_t atomic_xadd(volatile uint32_t* ptr, uint32_t val) {
+    asm volatile ("lock xaddl %0, %1"
+            : "+r"(val), "+m"(*ptr)
+            :
+            : "memory", "cc"
+    );
+    return val;
+}
+
+/* Atomically stores val in *ptr and returns the old value */
+static inline uint32_t atomic_xchg(volatile uint32_t* ptr, uint32_t val) {
+    asm volatile ("xchgl %0, %1"
+            : "+r"(val), "+m"(*ptr)
+            :
+            : "memory"
+    );
+    return val;
+}
+
+/* Spin-wait hint for the processor */
+#define cpu_relax() asm volatile ("pause" : : : "memory")
+
+/* Keeps the compiler from moving memory accesses across this point */
+#define barrier() asm volatile ("" : : : "memory")
+
+/* Reads the time stamp counter */
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc"
+            : "=a"(lo), "=d"(hi)
+    );
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Reads a model specific register */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    asm volatile ("rdmsr"
+            : "=a"(lo), "=d"(hi)
+            : "c"(msr)
+    );
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t val) {
+    asm volatile ("wrmsr"
+            :
+            : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32))
+            : "memory"
+    );
+}
+
+/* Runs CPUID for a leaf and returns the four result registers */
+static inline void cpuid(uint32_t leaf, uint32_t* a, uint32_t* b, uint32_t* c, uint32_t* d) {
+    asm volatile ("cpuid"
+            : "=a"(*a), "=b"(*b), "=c"(*c), "=d"(*d)
+            : "a"(leaf), "c"(0)
+    );
+}
+
 #endif /* _LIB_H */
@@ -0,0 +1,199 @@
+/*
+	mmap.c
+
+	Read-only file mappings (see mmap.h). Like the shared memory window,
+	a window's page table comes from the frame pool and MMAP_ADDR is one
+	of the process's windows (see paging.h). Nothing in a window is shared with other processes
+	and only the process itself (and its halt) changes it, so there is
+	no lock.
+*/
+
+#include "mmap.h"
+#include "lib.h"
+#include "paging.h"
+#include "file_system.h"
+#include "system_calls.h"
+
+/* no PAGE_RW: user code can only read a mapping */
+#define MMAP_PTE_FLAGS 	(PAGE_PRESENT | PAGE_USER)
+/* available bit: the page is a copy in a frame of our own, free it on unmap */
+#define MMAP_PTE_COPY 	0x200
+#define MMAP_PAGES 		(FOUR_MB / FOUR_KB)
+
+mmap_proc_t mmap_procs[MAX_NUM_PROCS];
+
+/*
+	mmap_clear()
+
+	Description: empties a run of window entries, freeing the pages that
+				 were copies
+	Inputs: pte = first entry, num_pages = entries
+	Outputs: None
+*/
+static void mmap_clear(uint32_t* pte, uint32_t num_pages)
+{
+	uint32_t i;
+
+	for( i = 0; i < num_pages; i++ )
+	{
+		if( pte[i] & MMAP_PTE_COPY )
+			free_frame(pte[i] & PAGE_ADDR_MASK);
+		pte[i] = 0;
+	}
+}
+
+/*
+	mmap_find_run()
+
+	Description: first fit search for num_pages free entries in a window
+	Inputs: table = page table of the window, num_pages
+	Outputs: index of the first entry, -1 if there is no room
+*/
+static int32_t mmap_find_run(uint32_t* table, uint32_t num_pages)
+{
+	uint32_t start, i;
+
+	for( start = 0; start + num_pages <= MMAP_PAGES; start = i + 1 )
+	{
+		for( i = start; i < start + num_pages && !(table[i] & PAGE_PRESENT); i++ );
+		if( i == start + num_pages )
+			return start;
+	}
+	return -1;
+}
+
+/*
+	mmap_file()
+
+	Description: maps part of a file read-only into the process's window.
+				 Every whole data block is mapped where it lies in the file
+				 system image; a block the file only partly fills (the last
+				 one), or one that isn't page aligned, is copied into a
+				 zeroed frame instead.
+	Inputs: pcb = the calling process, inode = the file, offset = page
+			aligned byte offset into it, length = bytes (0 or past the end
+			of the file: up to the end)
+	Outputs: address of the mapping, -1 for failure (bad inode or offset,
+			 no room in the window, too many mappings, no frames left)
+*/
+int32_t mmap_file(pcb_t* pcb, uint32_t inode, uint32_t offset, uint32_t length)
+{
+	mmap_proc_t* proc = &mmap_procs[pcb->process_id];
+	int32_t file_len = file_length(inode);
+	uint32_t num_pages;
+	uint32_t* pte;
+	uint32_t frame;
+	uint8_t* data;
+	int32_t start;
+	int32_t n;
+	uint32_t i;
+	int m;
+
+	if( file_len < 0 || (offset & (FOUR_KB - 1)) != 0 || offset >= (uint32_t)file_len )
+		return -1;
+	if( length == 0 || length > file_len - offset )
+		length = file_len - offset;
+	num_pages = (length + FOUR_KB - 1) / FOUR_KB;
+
+	for( m = 0; m < MMAP_MAX_MAPS && proc->maps[m].addr != 0; m++ );
+	if( m == MMAP_MAX_MAPS )
+		return -1;
+
+	if( proc->table == NULL )
+	{
+		frame = alloc_frame();
+		if( frame == 0 )
+			return -1;
+		proc->table = (uint32_t*)frame;
+	}
+	start = mmap_find_run(proc->table, num_pages);
+	if( start == -1 )
+		return -1;
+	pte = &proc->table[start];
+
+	for( i = 0; i < num_pages; i++ )
+	{
+		n = read_data_span(inode, offset + i * FOUR_KB, &data);
+		if( n <= 0 )
+			break;
+
+		if( n == FOUR_KB && ((uint32_t)data & (FOUR_KB - 1)) == 0 )
+		{
+			pte[i] = (uint32_t)data | MMAP_PTE_FLAGS;
+			continue;
+		}
+
+		/* allocating zeroes the frame: the tail past the file reads as 0 */
+		frame = alloc_frame();
+		if( frame == 0 )
+			break;
+		memcpy((void*)frame, data, n);
+		pte[i] = frame | MMAP_PTE_FLAGS | MMAP_PTE_COPY;
+	}
+
+	if( i != num_pages )
+	{
+		mmap_clear(pte, i);
+		return -1;
+	}
+
+	proc->maps[m].addr = MMAP_ADDR + start * FOUR_KB;
+	proc->maps[m].num_pages = num_pages;
+	user_window_attach(pcb->process_id, USER_WIN_MMAP, (uint32_t)proc->table | MMAP_PTE_FLAGS);
+	return proc->maps[m].addr;
+}
+
+/*
+	mmap_unmap()
+
+	Description: unmaps the file mapping at addr
+	Inputs: pcb = the calling process, addr = address mmap_file() returned
+	Outputs: 0 for success, -1 if nothing is mapped there
+*/
+int32_t mmap_unmap(pcb_t* pcb, uint32_t addr)
+{
+	mmap_proc_t* proc = &mmap_procs[pcb->process_id];
+	int m;
+
+	if( addr == 0 )
+		return -1;
+
+	for( m = 0; m < MMAP_MAX_MAPS && proc->maps[m].addr != addr; m++ );
+	if( m == MMAP_MAX_MAPS )
+		return -1;
+
+	mmap_clear(&proc->table[(addr - MMAP_ADDR) / FOUR_KB], proc->maps[m].num_pages);
+	proc->maps[m].addr = 0;
+	flush_tlb();
+	return 0;
+}
+
+/*
+	mmap_release()
+
+	Description: unmaps everything a process has mapped and frees its
+				 window
+	Inputs: pid = process ID
+	Outputs: None
+*/
+void mmap_release(int pid)
+{
+	mmap_proc_t* proc = &mmap_procs[pid];
+	int m;
+
+	for( m = 0; m < MMAP_MAX_MAPS; m++ )
+	{
+		if( proc->maps[m].addr != 0 )
+		{
+			mmap_clear(&proc->table[(proc->maps[m].addr - MMAP_ADDR) / FOUR_KB], proc->maps[m].num_pages);
+			proc->maps[m].addr = 0;
+		}
+	}
+
+	if( proc->table != NULL )
+	{
+		user_window_set(pid, USER_WIN_MMAP, 0);
+		free_frame((uint32_t)proc->table);
+		proc->table = NULL;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+	mmap.h
+
+	Read-only file mappings. mmap() maps part of a file into the
+	process's file mapping window (the 4 MB at MMAP_ADDR) with 4 KB
+	pages that point straight at the file's data blocks in the file
+	system image, so reading it takes no copy and no system call. Only
+	a last page the file doesn't fill is a copy, in a zeroed frame, so
+	the rest of that page reads as zeros. munmap() takes it out again.
+*/
+
+#ifndef _MMAP_H
+#define _MMAP_H
+
+#include "types.h"
+
+#define MMAP_ADDR 			0x0CC00000 	// 204 MB
+#define MMAP_MAX_MAPS 		4 			/* mappings per process */
+
+/* one file range mapped into a process */
+typedef struct mmap_mapping_t {
+	uint32_t addr;          /* 0 if unused */
+	uint32_t num_pages;
+} mmap_mapping_t;
+
+/* kernel side of a process's window */
+typedef struct mmap_proc_t {
+	uint32_t* table;        /* page table of the window, NULL until the first map */
+	mmap_mapping_t maps[MMAP_MAX_MAPS];
+} mmap_proc_t;
+
+/* indexed by process ID */
+extern mmap_proc_t mmap_procs[];
+
+struct pcb_t;
+
+/* maps length bytes of a file from offset on (mmap); outputs the address or -1 */
+int32_t mmap_file(struct pcb_t* pcb, uint32_t inode, uint32_t offset, uint32_t length);
+/* takes out the mapping at addr (munmap) */
+int32_t mmap_unmap(struct pcb_t* pcb, uint32_t addr);
+/* drops all of a process's mappings and its window (halt) */
+void mmap_release(int pid);
+
+#endif
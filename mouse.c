@@ -1,27 +1,310 @@
+/*
+	mouse.c
+
+	PS/2 mouse driver. IRQ12 bytes are assembled into 3 byte packets (4
+	with an IntelliMouse wheel) and every complete packet is queued for
+	each process that has "mouse" open. Motion that arrives while a
+	reader's newest queued event has the same buttons is added to that
+	event, so a reader gets all movement since its last read() in one
+	event instead of one per packet.
+
+	The queues are shared between the IRQ12 handler (on the CPU the I/O
+	APIC sends it to) and readers on any CPU, so they are protected by
+	mouse_lock, taken with interrupts off.
+*/
+
 #include "mouse.h"
+#include "system_calls.h"
 
+static mouse_reader_t mouse_readers[MOUSE_MAX_READERS];
+static uint8_t packet[MOUSE_PACKET_MAX];
+static int packet_index;
+static int packet_size = 3;
+spinlock_t mouse_lock = SPINLOCK_INIT("mouse");
 
+/*
+	ps2_wait_write() / ps2_wait_read()
+
+	Description: wait until the controller can take a byte / has a byte
+	Outputs: 0 when ready, -1 on timeout
+*/
+static int ps2_wait_write()
+{
+	int i;
+	for( i = 0; i < PS2_TIMEOUT; i++ )
+		if( !(inb(PS2_CMD_PORT) & PS2_STATUS_INPUT) )
+			return 0;
+	return -1;
+}
+
+static int ps2_wait_read()
+{
+	int i;
+	for( i = 0; i < PS2_TIMEOUT; i++ )
+		if( inb(PS2_CMD_PORT) & PS2_STATUS_OUTPUT )
+			return 0;
+	return -1;
+}
+
+/*
+	mouse_write()
+
+	Description: sends a command byte to the mouse and reads its reply
+	Inputs: value = command or argument
+	Outputs: the reply (MOUSE_ACK on success), -1 on timeout
+*/
+static int mouse_write(uint8_t value)
+{
+	if( ps2_wait_write() != 0 )
+		return -1;
+	outb(PS2_CMD_WRITE_AUX, PS2_CMD_PORT);
+	if( ps2_wait_write() != 0 )
+		return -1;
+	outb(value, PS2_DATA_PORT);
+	if( ps2_wait_read() != 0 )
+		return -1;
+	return inb(PS2_DATA_PORT);
+}
 
 /*
 	mouse_init()
 
-	Description: Initializes mouse use
+	Description: Enables the PS/2 aux port and its interrupt, tries to
+				 switch the mouse into IntelliMouse mode (sample rates
+				 200, 100, 80 then ask for the ID) and starts streaming
 	Inputs: None
 	Outputs: None
 	Side Effects: enables mouse IRQs
 */
 void mouse_init()
 {
-    /* enable (unmask) IRQ1 for keyboard interrupts */
-    printf("mouse initialization");
+	uint32_t flags;
+	uint8_t config;
 
-    enable_irq(MOUSE_INT_NUM);
+	/* nothing may steal the replies from the data port */
+	cli_and_save(flags);
+
+	ps2_wait_write();
+	outb(PS2_CMD_ENABLE_AUX, PS2_CMD_PORT);
+
+	ps2_wait_write();
+	outb(PS2_CMD_READ_CONFIG, PS2_CMD_PORT);
+	ps2_wait_read();
+	config = (inb(PS2_DATA_PORT) | PS2_CONFIG_AUX_IRQ) & ~PS2_CONFIG_AUX_CLOCK_OFF;
+	ps2_wait_write();
+	outb(PS2_CMD_WRITE_CONFIG, PS2_CMD_PORT);
+	ps2_wait_write();
+	outb(config, PS2_DATA_PORT);
+
+	mouse_write(MOUSE_SET_DEFAULTS);
+
+	mouse_write(MOUSE_SET_RATE);
+	mouse_write(200);
+	mouse_write(MOUSE_SET_RATE);
+	mouse_write(100);
+	mouse_write(MOUSE_SET_RATE);
+	mouse_write(80);
+	if( mouse_write(MOUSE_GET_ID) == MOUSE_ACK && ps2_wait_read() == 0 &&
+		inb(PS2_DATA_PORT) == MOUSE_ID_INTELLIMOUSE )
+		packet_size = 4;
+
+	mouse_write(MOUSE_SET_RATE);
+	mouse_write(MOUSE_DEFAULT_RATE);
+	mouse_write(MOUSE_ENABLE_STREAM);
+
+	packet_index = 0;
+	restore_flags(flags);
+
+	klog(KLOG_INFO, "mouse: %d byte packets", packet_size);
+	enable_irq(MOUSE_INT_NUM);
 }
 
+/*
+	mouse_queue()
 
+	Description: adds an event to one reader's queue, merging it into the
+				 newest queued event if only the position changed
+	Inputs: r = reader, ev = decoded packet
+*/
+static void mouse_queue(mouse_reader_t* r, mouse_event_t* ev)
+{
+	mouse_event_t* last;
+	uint32_t next;
+	uint32_t flags;
+
+	spin_lock_irqsave(&mouse_lock, flags);
+	if( !r->in_use )
+	{
+		spin_unlock_irqrestore(&mouse_lock, flags);
+		return;
+	}
+
+	if( r->head != r->tail )
+	{
+		last = &r->events[(r->tail - 1) & (MOUSE_QUEUE_SIZE - 1)];
+		if( last->buttons == ev->buttons )
+		{
+			last->dx += ev->dx;
+			last->dy += ev->dy;
+			last->dz += ev->dz;
+			spin_unlock_irqrestore(&mouse_lock, flags);
+			return;
+		}
+	}
+
+	/* full: drop the event (the button state reaches the reader with the next one) */
+	next = (r->tail + 1) & (MOUSE_QUEUE_SIZE - 1);
+	if( next != r->head )
+	{
+		r->events[r->tail] = *ev;
+		r->tail = next;
+	}
+	spin_unlock_irqrestore(&mouse_lock, flags);
+}
+
+/*
+	mouse_handler()
+
+	Description: handler for IRQ12, assembles packets and queues them
+	Inputs: None
+	Outputs: None
+*/
 void mouse_handler() {
-    cli();
-    printf("mouse interrupt");
+    mouse_event_t ev;
+    uint8_t byte;
+    int i;
+
     send_eoi(MOUSE_INT_NUM);
-    sti();
+
+    if( !(inb(PS2_CMD_PORT) & PS2_STATUS_AUX) )
+        return;
+    byte = inb(PS2_DATA_PORT);
+
+    /* resynchronize: the first byte always has bit 3 set */
+    if( packet_index == 0 && !(byte & MOUSE_ALWAYS_ONE) )
+        return;
+    packet[packet_index++] = byte;
+    if( packet_index < packet_size )
+        return;
+    packet_index = 0;
+
+    if( packet[0] & MOUSE_OVERFLOW )
+        return;
+
+    /* X and Y are 9 bit two's complement, the sign is in the first byte */
+    ev.dx = (int32_t)packet[1] - ((packet[0] & MOUSE_X_SIGN) ? 0x100 : 0);
+    ev.dy = (int32_t)packet[2] - ((packet[0] & MOUSE_Y_SIGN) ? 0x100 : 0);
+    ev.dz = (packet_size == 4) ? (int32_t)(int8_t)packet[3] : 0;
+    ev.buttons = packet[0] & MOUSE_BUTTONS;
+
+    for( i = 0; i < MOUSE_MAX_READERS; i++ )
+        if( mouse_readers[i].in_use )
+            mouse_queue(&mouse_readers[i], &ev);
+    sched_wakeup_all();
+}
+
+/*
+	mouse_open()
+
+	Description: gives the new file descriptor its own event queue
+	Inputs: filename (unused)
+	Outputs: the queue, kept as the fd's private_data; -1 if all are taken
+*/
+int32_t mouse_open(const uint8_t* filename)
+{
+	uint32_t flags;
+	int i;
+
+	spin_lock_irqsave(&mouse_lock, flags);
+	for( i = 0; i < MOUSE_MAX_READERS; i++ )
+	{
+		if( !mouse_readers[i].in_use )
+		{
+			mouse_readers[i].head = mouse_readers[i].tail = 0;
+			mouse_readers[i].in_use = 1;
+			spin_unlock_irqrestore(&mouse_lock, flags);
+			return (int32_t)&mouse_readers[i];
+		}
+	}
+	spin_unlock_irqrestore(&mouse_lock, flags);
+	return -1;
+}
+
+/*
+	mouse_close()
+
+	Description: releases the file descriptor's queue
+	Inputs: fd = file descriptor
+	Outputs: 0
+*/
+int32_t mouse_close(int32_t fd)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+	mouse_reader_t* r = (mouse_reader_t*)pcb->fd_array[fd].private_data;
+	uint32_t flags;
+
+	if( r != NULL )
+	{
+		spin_lock_irqsave(&mouse_lock, flags);
+		r->in_use = 0;
+		spin_unlock_irqrestore(&mouse_lock, flags);
+	}
+	return 0;
+}
+
+/*
+	mouse_read()
+
+	Description: waits for mouse input, then copies as many whole events
+				 as fit in buf
+	Inputs: fd = file descriptor, buf = array of mouse_event_t, nbytes = its size
+	Outputs: number of bytes copied, -1 if buf can't hold one event
+*/
+int32_t mouse_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+	mouse_reader_t* r = (mouse_reader_t*)pcb->fd_array[fd].private_data;
+	mouse_event_t* out = (mouse_event_t*)buf;
+	uint32_t flags;
+	int32_t count = 0;
+
+	if( r == NULL || buf == NULL || nbytes < (int32_t)sizeof(mouse_event_t) )
+		return -1;
+
+	while( 1 )
+	{
+		spin_lock_irqsave(&mouse_lock, flags);
+		while( r->head != r->tail && (count + 1) * (int32_t)sizeof(mouse_event_t) <= nbytes )
+		{
+			out[count++] = r->events[r->head];
+			r->head = (r->head + 1) & (MOUSE_QUEUE_SIZE - 1);
+		}
+		spin_unlock_irqrestore(&mouse_lock, flags);
+		if( count != 0 )
+			break;
+
+		/* block until the handler queues an event */
+		sched_sleep(pcb->terminal_number, 0);
+		if( r->head != r->tail )
+			sched_wakeup(pcb->terminal_number);
+		sched_wait(pcb->terminal_number);
+	}
+
+	return count * sizeof(mouse_event_t);
+}
+
+/*
+	mouse_poll()
+
+	Description: poll hook of the mouse device
+	Inputs: pcb = owning process, fd = file descriptor
+	Outputs: POLLIN if an event is queued, 0 otherwise
+*/
+int32_t mouse_poll(struct pcb_t* pcb, int32_t fd)
+{
+	mouse_reader_t* r = (mouse_reader_t*)pcb->fd_array[fd].private_data;
+
+	if( r != NULL && r->head != r->tail )
+		return POLLIN;
+	return 0;
 }
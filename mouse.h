@@ -4,14 +4,74 @@
 #include "lib.h"
 #include "i8259.h"
 #include "terminal.h"
+#include "spinlock.h"
 
 
 #define MOUSE_INT_NUM 12
 
+/* PS/2 controller */
+#define PS2_DATA_PORT 			0x60
+#define PS2_CMD_PORT 			0x64 	/* status when read */
+#define PS2_STATUS_OUTPUT 		0x01 	/* a byte is waiting in the data port */
+#define PS2_STATUS_INPUT 		0x02 	/* controller hasn't taken the last byte yet */
+#define PS2_STATUS_AUX 			0x20 	/* the waiting byte came from the mouse */
+#define PS2_CMD_ENABLE_AUX 		0xA8
+#define PS2_CMD_READ_CONFIG 	0x20
+#define PS2_CMD_WRITE_CONFIG 	0x60
+#define PS2_CMD_WRITE_AUX 		0xD4
+#define PS2_CONFIG_AUX_IRQ 		0x02
+#define PS2_CONFIG_AUX_CLOCK_OFF 0x20
+#define PS2_TIMEOUT 			100000
+
+/* mouse commands */
+#define MOUSE_SET_DEFAULTS 		0xF6
+#define MOUSE_ENABLE_STREAM 	0xF4
+#define MOUSE_SET_RATE 			0xF3
+#define MOUSE_GET_ID 			0xF2
+#define MOUSE_ACK 				0xFA
+#define MOUSE_ID_INTELLIMOUSE 	3 		/* 4 byte packets with a scroll wheel */
+#define MOUSE_DEFAULT_RATE 		100
+
+/* first byte of every packet */
+#define MOUSE_BUTTONS 			0x07
+#define MOUSE_ALWAYS_ONE 		0x08 	/* used to find packet boundaries */
+#define MOUSE_X_SIGN 			0x10
+#define MOUSE_Y_SIGN 			0x20
+#define MOUSE_OVERFLOW 			0xC0
+
+#define MOUSE_PACKET_MAX 		4
+#define MOUSE_MAX_READERS 		4 		/* open "mouse" file descriptors */
+#define MOUSE_QUEUE_SIZE 		32 		/* events per reader, power of two */
+
+/* what read() returns: one or more of these */
+typedef struct mouse_event_t {
+	int32_t dx;         /* right is positive */
+	int32_t dy;         /* up is positive */
+	int32_t dz;         /* scroll wheel, IntelliMouse only */
+	uint32_t buttons;   /* bit 0 left, bit 1 right, bit 2 middle */
+} mouse_event_t;
+
+/* per open file descriptor event queue */
+typedef struct mouse_reader_t {
+	int in_use;
+	mouse_event_t events[MOUSE_QUEUE_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} mouse_reader_t;
+
+/* protects every reader's event queue */
+extern spinlock_t mouse_lock;
 
 /* mouse initializer */
 void mouse_init();
 
 void mouse_handler();
 
+/* file operations for the "mouse" device */
+int32_t mouse_open(const uint8_t* filename);
+int32_t mouse_close(int32_t fd);
+int32_t mouse_read(int32_t fd, void* buf, int32_t nbytes);
+struct pcb_t;
+int32_t mouse_poll(struct pcb_t* pcb, int32_t fd);
+
 #endif
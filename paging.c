@@ -5,6 +5,25 @@
 */
 
 #include "paging.h"
+#include "system_calls.h"
+
+/* 1 if the pool frame at that index is handed out */
+static uint8_t frame_used[FRAME_POOL_FRAMES];
+
+spinlock_t paging_lock = SPINLOCK_INIT("paging");
+
+/* memory type of each PAT entry (power-on values until pat_init() runs) */
+static uint8_t pat_types[PAT_NUM_ENTRIES] = {
+	MEM_TYPE_WB, MEM_TYPE_WT, MEM_TYPE_UC_MINUS, MEM_TYPE_UC,
+	MEM_TYPE_WB, MEM_TYPE_WT, MEM_TYPE_UC_MINUS, MEM_TYPE_UC
+};
+
+/* where each USER_WIN_* window sits */
+static const uint32_t user_window_addr[NUM_USER_WINDOWS] = {
+	IORING_ADDR, IPC_ADDR, SHM_ADDR, MMAP_ADDR, FB_USER_ADDR
+};
+/* directory entry of every process's windows, 0 where it has none */
+static uint32_t user_windows[MAX_NUM_PROCS][NUM_USER_WINDOWS];
 
 /*
 		paging_init()
@@ -23,6 +42,9 @@ void paging_init()
 {
 	//set each entry to not present
 	int i;
+
+	pat_init();
+
 	for(i = 0; i < ONE_KB; i++) // 1KB entries of 4KB size
 	{
     	//this sets up each index in the directory, allowing R/W but marked as NOT present for now
@@ -40,12 +62,9 @@ void paging_init()
 	page_directory[1] = (KERNEL_START_ADDR | 0x83);
 
 	// put video memory pointer in the correct page_table entry
-	page_table[VIDMEM_START_ADDR>>12] = (VIDMEM_START_ADDR + 3);
+	page_table[VIDMEM_START_ADDR>>12] = (VIDMEM_START_ADDR + 3) | page_wc_bits;
 
-	/* set up 3 pages for each terminal's video memory */
-	page_table[TERM_1_VIDEO>>12] = (TERM_1_VIDEO + 3);
-	page_table[TERM_2_VIDEO>>12] = (TERM_2_VIDEO + 3);
-	page_table[TERM_3_VIDEO>>12] = (TERM_3_VIDEO + 3);
+	/* terminal video pages are allocated from the frame pool when a terminal is created */
 
 	asm volatile("						\n\
 	movl %0, %%eax						\n\
@@ -64,6 +83,76 @@ void paging_init()
 }
 
 
+/*
+		pat_init()
+
+		Description: if the CPU has a PAT, turns PA1 into write-combining
+		Inputs: None
+		Outputs: None
+		Side Effects: sets page_wc_bits; writes back and invalidates the caches
+
+*/
+void pat_init()
+{
+	uint32_t a, b, c, d;
+	uint32_t flags;
+
+	cpuid(CPUID_FEATURES, &a, &b, &c, &d);
+	if( !(d & CPUID_EDX_PAT) )
+	{
+		/* no PAT: PWT would mean write-through, fall back to uncached */
+		page_wc_bits = PAGE_PCD | PAGE_PWT;
+		return;
+	}
+
+	/* no stale lines of the old type may survive the change */
+	cli_and_save(flags);
+	asm volatile ("wbinvd" : : : "memory");
+	wrmsr(MSR_PAT, PAT_VALUE);
+	asm volatile ("wbinvd" : : : "memory");
+	restore_flags(flags);
+
+	pat_types[1] = MEM_TYPE_WC;
+	pat_types[5] = MEM_TYPE_WC;
+	page_wc_bits = PAGE_PWT;
+}
+
+/*
+		paging_mem_type()
+
+		Description: looks up the memory type a mapping's PAT/PCD/PWT bits
+					 select (an MTRR can still make WB memory uncached)
+		Inputs: vaddr = virtual address
+		Outputs: MEM_TYPE_* value, -1 if vaddr is not mapped
+
+*/
+int32_t paging_mem_type(uint32_t vaddr)
+{
+	uint32_t entry = cpu_page_directory()[vaddr / FOUR_MB];
+	uint32_t* table;
+	int index;
+
+	if( !(entry & PAGE_PRESENT) )
+		return -1;
+
+	if( entry & PAGE_SIZE_4MB )
+		index = (entry & PAGE_PAT_4MB) ? 4 : 0;
+	else
+	{
+		table = (uint32_t*)(entry & PAGE_ADDR_MASK);
+		entry = table[(vaddr >> PAGE_SHIFT) & (ONE_KB - 1)];
+		if( !(entry & PAGE_PRESENT) )
+			return -1;
+		index = (entry & PAGE_PAT) ? 4 : 0;
+	}
+
+	if( entry & PAGE_PCD )
+		index += 2;
+	if( entry & PAGE_PWT )
+		index += 1;
+	return pat_types[index];
+}
+
 /*
 Unlike Linux, we will provide you with set physical addresses
 for the images of the two tasks, and will stipulate that they
@@ -78,14 +167,20 @@ single page for each task's user-level memory
 		Description: Maps program image
 		Inputs: Physical and virtual address
 		Outputs: None
-		Side Effects: Maps program at virtual address into physical address
+		Side Effects: Maps program at virtual address into physical address.
+					  Not preemptible: a switch between finding this CPU's
+					  directory and flushing could move the task to another
+					  CPU and leave the entry in the old CPU's directory.
 
 */
 void map_task(uint32_t virtual_address, uint32_t physical_address)
 {
 	uint32_t pd_entry = virtual_address / FOUR_MB ; // 128 MB / 4 MB to find index 32
-	page_directory[pd_entry] = (physical_address | 0x87); // sets Present bit, User-level, R/W and 4 MB page size
+
+	preempt_disable();
+	cpu_page_directory()[pd_entry] = (physical_address | 0x87); // sets Present bit, User-level, R/W and 4 MB page size
 	flush_tlb();
+	preempt_enable();
 
 }
 
@@ -94,17 +189,143 @@ void map_task(uint32_t virtual_address, uint32_t physical_address)
 		map_vidmem()
 
 		Description: Maps video memory
-		Inputs: Physical and virtual address, as well as the terminal number for this process
+		Inputs: terminal number whose vidmap slot is mapped, physical address of its cells
 		Outputs: None
-		Side Effects: Maps vidmem into user space (pre-set virtual address per terminal)
+		Side Effects: Maps vidmem into user space (pre-set virtual address per terminal).
+					  Does nothing until the terminal's vidmap table has been allocated
+					  by the first vidmap() call on it. Not preemptible, like map_task().
 
 */
-void map_vidmem(uint32_t virtual_address, uint32_t physical_address)
+void map_vidmem(int term_num, uint32_t physical_address)
 {
-	uint32_t pd_entry = virtual_address / FOUR_MB ;
-	page_directory[pd_entry] = (unsigned int)vidmap_page_table | 0x7 ; //sets present bit, user-level, R/W
-	vidmap_page_table[0] = physical_address | 0x7;
+	uint32_t* table = terminals[term_num].vidmap_table;
+	uint32_t pd_entry = terminals[term_num].user_vidmem_addr / FOUR_MB;
+	/* under fbcon the cell grid is larger than a page (contiguous frames) */
+	uint32_t num_pages = ((screen_cols * screen_rows * 2) + FOUR_KB - 1) / FOUR_KB;
+	uint32_t i;
+
+	if( table == NULL )
+		return;
+
+	preempt_disable();
+	cpu_page_directory()[pd_entry] = (unsigned int)table | 0x7 ; //sets present bit, user-level, R/W
+	for( i = 0; i < num_pages; i++ )
+	{
+		table[i] = (physical_address + (i * FOUR_KB)) | 0x7;
+		/* the visible terminal's screen is write-combined like the kernel's mapping */
+		if( physical_address == VIDMEM_START_ADDR )
+			table[i] |= page_wc_bits;
+	}
 	flush_tlb();
+	preempt_enable();
+}
+
+/*
+
+		alloc_frames()
+
+		Description: hands out n physically contiguous, zeroed 4 KB frames
+					 from the frame pool (first fit)
+		Inputs: n = number of frames
+		Outputs: physical (= kernel virtual) address of the first frame, 0 if
+				 no run of n free frames is left
+		Side Effects: marks the frames present in the kernel's first page table
+
+*/
+uint32_t alloc_frames(uint32_t n)
+{
+	uint32_t i;
+	uint32_t j;
+	uint32_t addr;
+	uint32_t flags;
+
+	if( n == 0 || n > FRAME_POOL_FRAMES )
+		return 0;
+
+	spin_lock_irqsave(&paging_lock, flags);
+	for( i = 0; i + n <= FRAME_POOL_FRAMES; i++ )
+	{
+		for( j = 0; j < n && !frame_used[i + j]; j++ );
+		if( j < n )
+		{
+			/* frame i + j is taken, resume the search after it */
+			i += j;
+			continue;
+		}
+
+		for( j = 0; j < n; j++ )
+			frame_used[i + j] = 1;
+		spin_unlock_irqrestore(&paging_lock, flags);
+
+		addr = FRAME_POOL_START + (i * FOUR_KB);
+		for( j = 0; j < n; j++ )
+			page_table[(addr >> PAGE_SHIFT) + j] = (addr + (j * FOUR_KB)) | PAGE_RW | PAGE_PRESENT;
+		flush_tlb();
+		memset((void*)addr, 0, n * FOUR_KB);
+		return addr;
+	}
+	spin_unlock_irqrestore(&paging_lock, flags);
+	return 0;
+}
+
+/*
+
+		alloc_frame()
+
+		Description: hands out a zeroed 4 KB frame from the frame pool
+		Inputs: None
+		Outputs: physical (= kernel virtual) address of the frame, 0 if the pool is empty
+		Side Effects: marks the frame present in the kernel's first page table
+
+*/
+uint32_t alloc_frame()
+{
+	return alloc_frames(1);
+}
+
+/*
+
+		free_frames()
+
+		Description: returns n contiguous frames to the frame pool
+		Inputs: addr = address returned by alloc_frames(), n = number of frames
+		Outputs: None
+		Side Effects: unmaps the frames from the kernel's first page table
+
+*/
+void free_frames(uint32_t addr, uint32_t n)
+{
+	uint32_t i;
+	uint32_t flags;
+
+	if( addr < FRAME_POOL_START || addr + (n * FOUR_KB) > FRAME_POOL_END || (addr & (FOUR_KB - 1)) )
+		return;
+
+	for( i = 0; i < n; i++ )
+		page_table[(addr >> PAGE_SHIFT) + i] = (addr + (i * FOUR_KB)) | PAGE_RW;
+	smp_flush_tlb();
+
+	/* smp_flush_tlb() has waited for every CPU to flush, so no CPU can
+	   reach the frames any more and they may be handed out again */
+	spin_lock_irqsave(&paging_lock, flags);
+	for( i = 0; i < n; i++ )
+		frame_used[((addr - FRAME_POOL_START) / FOUR_KB) + i] = 0;
+	spin_unlock_irqrestore(&paging_lock, flags);
+}
+
+/*
+
+		free_frame()
+
+		Description: returns a frame to the frame pool
+		Inputs: addr = address returned by alloc_frame()
+		Outputs: None
+		Side Effects: unmaps the frame from the kernel's first page table
+
+*/
+void free_frame(uint32_t addr)
+{
+	free_frames(addr, 1);
 }
 
 /*
@@ -117,6 +338,9 @@ void map_vidmem(uint32_t virtual_address, uint32_t physical_address)
 								 physical Video Memory, but will then point the terminal's virtual
 								 address to physical Video Memory, to then write to the screen.
 
+		Under the framebuffer console nothing is remapped, the newly
+		visible terminal is simply redrawn from its own pages.
+
 		Inputs: current terminal number, previous terminal number
 		Outputs: None
 
@@ -126,6 +350,12 @@ void display_terminal(int curr_term_num, int prev_term_num)
 	if( curr_term_num == prev_term_num )
 		return;
 
+	if( fbcon.enabled )
+	{
+		fbcon_redraw();
+		return;
+	}
+
 	uint32_t num_bytes = (NUM_COLS * NUM_ROWS * 2);
 
 	int curr_pt_index = (terminals[curr_term_num].vidmem_addr >> 12);
@@ -135,15 +365,107 @@ void display_terminal(int curr_term_num, int prev_term_num)
 		int prev_pt_index = (terminals[prev_term_num].vidmem_addr >> 12);
 		/* restore previous terminal's pointer and video memory */
 		page_table[prev_pt_index] = (terminals[prev_term_num].vidmem_addr + 3);
-		flush_tlb();
+		/* returns once no CPU writes through the old mapping any more */
+		smp_flush_tlb();
 		/* map user video memory back to the specific terminal's page */
 		memcpy((uint8_t*)(terminals[prev_term_num].vidmem_addr), (uint8_t*)(VIDMEM_START_ADDR), num_bytes);
 	}
 
 	/* copy visible terminal's data over and point to physical video memory */
 	memcpy((uint8_t*)(VIDMEM_START_ADDR), (uint8_t*)(terminals[curr_term_num].vidmem_addr), num_bytes);
-	page_table[curr_pt_index] = (VIDMEM_START_ADDR + 3);
+	page_table[curr_pt_index] = (VIDMEM_START_ADDR + 3) | page_wc_bits;
+	smp_flush_tlb();
+}
+
+/*
+
+		cpu_page_directory()
+
+		Description: the running CPU's page directory. The program and
+					 vidmap() mappings are per CPU; everything else is the
+					 same in all of them.
+		Inputs: None
+		Outputs: the directory (page_directory on the boot CPU)
+
+*/
+uint32_t* cpu_page_directory()
+{
+	return this_cpu()->page_directory;
+}
+
+/*
+
+		set_pde_all()
+
+		Description: sets a directory entry on every CPU, for mappings that
+					 must not depend on where a process runs. The caller
+					 flushes with smp_flush_tlb().
+		Inputs: index = directory index, entry = new entry
+		Outputs: None
+
+*/
+void set_pde_all(uint32_t index, uint32_t entry)
+{
+	uint32_t flags;
+	int i;
+
+	spin_lock_irqsave(&paging_lock, flags);
+	page_directory[index] = entry;
+	for( i = 1; i < APIC_MAX_CPUS; i++ )
+		if( cpus[i].page_directory != NULL )
+			cpus[i].page_directory[index] = entry;
+	spin_unlock_irqrestore(&paging_lock, flags);
+}
+
+/*
+	user_window_set()
+
+	Description: records the directory entry of one of a process's
+				 windows, for the next user_windows_map()
+	Inputs: pid = process ID, win = USER_WIN_*, pde = page table address
+			and flags, 0 when the process has no such window
+	Outputs: None
+*/
+void user_window_set(int pid, int win, uint32_t pde)
+{
+	user_windows[pid][win] = pde;
+}
+
+/*
+	user_window_attach()
+
+	Description: records a window's entry and installs it in this CPU's
+				 directory right away, for the process that is running
+	Inputs: pid = process ID, win = USER_WIN_*, pde = entry (0 removes it)
+	Outputs: None
+	Side Effects: flushes the TLB. Not preemptible, like map_task().
+*/
+void user_window_attach(int pid, int win, uint32_t pde)
+{
+	user_windows[pid][win] = pde;
+
+	preempt_disable();
+	cpu_page_directory()[user_window_addr[win] / FOUR_MB] = pde;
 	flush_tlb();
+	preempt_enable();
+}
+
+/*
+	user_windows_map()
+
+	Description: points this CPU's window directory entries at a
+				 process's windows, clearing those it doesn't have
+	Inputs: pid = process ID
+	Outputs: None
+	Side Effects: the caller flushes the TLB and keeps the task on this CPU
+*/
+void user_windows_map(int pid)
+{
+	uint32_t* dir = cpu_page_directory();
+	int i;
+
+	for( i = 0; i < NUM_USER_WINDOWS; i++ )
+		dir[user_window_addr[i] / FOUR_MB] = user_windows[pid][i];
 }
 
 /*
@@ -5,6 +5,8 @@
 #include "x86_desc.h"
 #include "lib.h"
 #include "terminal.h"
+#include "smp.h"
+#include "spinlock.h"
 
 /* page/directory/table relevant constants */
 #define FOUR_MB 			0x400000
@@ -18,22 +20,105 @@
 #define KERNEL_START_ADDR 	0x400000
 #define VIDMEM_START_ADDR   0xB8000
 
+/*
+	Page frame pool: the 1 MB - 4 MB part of the first page table is
+	otherwise unused, so it is handed out in 4 KB frames on demand
+	(terminal video pages, vidmap page tables, ...). Frames are identity
+	mapped for the kernel while they are allocated.
+*/
+#define FRAME_POOL_START 	0x100000
+#define FRAME_POOL_END 		0x400000
+#define FRAME_POOL_FRAMES 	((FRAME_POOL_END - FRAME_POOL_START) / FOUR_KB)
+#define PAGE_SHIFT 			12
+
+/* user mapping of the linear framebuffer's back buffer (fbmap), after the terminal vidmap slots */
+#define FB_USER_ADDR 		0x0B800000 	// 184 MB
+#define FB_USER_MAX_SIZE 	FOUR_MB
+
+/*
+	Per-process windows: 4 MB regions whose page table belongs to one
+	process. The owning module records a window's directory entry with
+	user_window_set() / user_window_attach(); user_windows_map() puts all
+	of a process's entries into the running CPU's directory whenever that
+	process starts running there (scheduler, execute, halt).
+*/
+#define USER_WIN_IORING 	0 			/* IORING_ADDR */
+#define USER_WIN_IPC 		1 			/* IPC_ADDR */
+#define USER_WIN_SHM 		2 			/* SHM_ADDR */
+#define USER_WIN_MMAP 		3 			/* MMAP_ADDR */
+#define USER_WIN_FB 		4 			/* FB_USER_ADDR */
+#define NUM_USER_WINDOWS 	5
+
+/* page directory / table entry bits */
+#define PAGE_PRESENT 		0x1
+#define PAGE_RW 			0x2
+#define PAGE_USER 			0x4
+#define PAGE_SIZE_4MB 		0x80
+#define PAGE_ADDR_MASK 		0xFFFFF000
+#define PAGE_PWT 			0x08
+#define PAGE_PCD 			0x10
+#define PAGE_PAT 			0x80 	/* PAT bit of a 4 KB entry */
+#define PAGE_PAT_4MB 		0x1000 	/* PAT bit of a 4 MB directory entry */
+
+/*
+	Page Attribute Table. PA1 (selected by PWT alone) is reprogrammed from
+	write-through to write-combining; the other entries keep their power-on
+	types, so existing mappings are unaffected. Video memory and the linear
+	framebuffer are mapped with page_wc_bits.
+*/
+#define MSR_PAT 			0x277
+#define CPUID_FEATURES 		1
+#define CPUID_EDX_PAT 		(1 << 16)
+#define PAT_VALUE 			0x0007010600070106ULL 	/* WB, WC, UC-, UC in both halves */
+#define PAT_NUM_ENTRIES 	8
+
+/* memory types, as encoded in the PAT and MTRRs */
+#define MEM_TYPE_UC 		0x00
+#define MEM_TYPE_WC 		0x01
+#define MEM_TYPE_WT 		0x04
+#define MEM_TYPE_WP 		0x05
+#define MEM_TYPE_WB 		0x06
+#define MEM_TYPE_UC_MINUS 	0x07
+
 //pulled from http://wiki.osdev.org/Setting_Up_Paging
 //every index in directory is a pointer to a separate page table
 //page directory describes entry format http://wiki.osdev.org/Paging
 uint32_t page_directory[ONE_KB] __attribute__((aligned(FOUR_KB)));
 uint32_t page_table[ONE_KB] __attribute__((aligned(FOUR_KB)));
 
-uint32_t vidmap_page_table[ONE_KB] __attribute__((aligned(FOUR_KB)));
+/* frame pool and the entries shared by every CPU's page directory */
+extern spinlock_t paging_lock;
+
+/* entry bits giving write-combining (PWT with the PAT, uncached without it) */
+uint32_t page_wc_bits;
 
 /* Initializes Paging */
 void paging_init();
+/* Programs the PAT so PWT selects write-combining */
+void pat_init();
+/* Returns the memory type the page attributes give vaddr, -1 if unmapped */
+int32_t paging_mem_type(uint32_t vaddr);
 /* Maps from virtual to physical */
 void map_task(uint32_t virtual_address, uint32_t physical_address);
-/* Maps vidmem into user space (pre-set virtual address) */
-void map_vidmem(uint32_t virtual_address, uint32_t physical_address);
+/* Maps vidmem into user space (pre-set virtual address per terminal) */
+void map_vidmem(int term_num, uint32_t physical_address);
+/* Allocates / frees 4 KB frames (or contiguous runs of them) from the frame pool */
+uint32_t alloc_frame();
+uint32_t alloc_frames(uint32_t n);
+void free_frame(uint32_t addr);
+void free_frames(uint32_t addr, uint32_t n);
 /* displays terminal based on ALT + F# */
 void display_terminal(int curr_term_num, int prev_term_num);
+/* The running CPU's page directory */
+uint32_t* cpu_page_directory();
+/* Sets a page directory entry on every CPU */
+void set_pde_all(uint32_t index, uint32_t entry);
+/* Records a process's window entry (0: no window) */
+void user_window_set(int pid, int win, uint32_t pde);
+/* Records it and installs it on this CPU, for the running process */
+void user_window_attach(int pid, int win, uint32_t pde);
+/* Installs all of a process's windows on this CPU; the caller flushes the TLB */
+void user_windows_map(int pid);
 /* Flushes TLB */
 void flush_tlb();
 #endif
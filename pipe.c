@@ -0,0 +1,280 @@
+/*
+	pipe.c
+
+	Pipes (see pipe.h). The buffer frames come from the frame pool, so
+	the kernel can reach a pipe's data from any process. pipe_lock is a
+	plain spin lock: only system calls take it, so the copies under it
+	leave interrupts on.
+*/
+
+#include "pipe.h"
+#include "lib.h"
+#include "paging.h"
+#include "system_calls.h"
+
+static pipe_t pipes[PIPE_MAX];
+spinlock_t pipe_lock = SPINLOCK_INIT("pipe");
+
+/*
+	pipe_create()
+
+	Description: takes a free pipe
+	Inputs: None
+	Outputs: the pipe, with one reader and one writer; NULL if all are taken
+*/
+pipe_t* pipe_create()
+{
+	int i;
+
+	spin_lock(&pipe_lock);
+	for( i = 0; i < PIPE_MAX; i++ )
+	{
+		if( !pipes[i].in_use )
+		{
+			memset(&pipes[i], 0, sizeof(pipe_t));
+			pipes[i].in_use = 1;
+			pipes[i].readers = 1;
+			pipes[i].writers = 1;
+			spin_unlock(&pipe_lock);
+			return &pipes[i];
+		}
+	}
+	spin_unlock(&pipe_lock);
+	return NULL;
+}
+
+/*
+	pipe_drop()
+
+	Description: closes one end of a pipe. Once both sides are gone the
+				 buffered frames are freed.
+	Inputs: p = pipe, end = PIPE_READ_END or PIPE_WRITE_END
+	Outputs: None
+*/
+void pipe_drop(pipe_t* p, int end)
+{
+	spin_lock(&pipe_lock);
+	if( end == PIPE_READ_END )
+		p->readers--;
+	else
+		p->writers--;
+
+	if( p->readers == 0 && p->writers == 0 )
+	{
+		for( ; p->head != p->tail; p->head++ )
+			free_frame((uint32_t)p->bufs[p->head & (PIPE_BUFS - 1)].page);
+		p->in_use = 0;
+	}
+	spin_unlock(&pipe_lock);
+}
+
+/*
+	pipe_put()
+
+	Description: copies data into a pipe: first the room left in the
+				 last frame, then into new frames, a page at a time
+	Inputs: p = pipe, buf = data, nbytes = its length
+	Outputs: bytes copied (0 if the pipe is full)
+*/
+int32_t pipe_put(pipe_t* p, const uint8_t* buf, int32_t nbytes)
+{
+	pipe_buf_t* b;
+	int32_t done = 0;
+	int32_t n;
+	uint32_t page;
+
+	spin_lock(&pipe_lock);
+	if( p->head != p->tail )
+	{
+		b = &p->bufs[(p->tail - 1) & (PIPE_BUFS - 1)];
+		n = FOUR_KB - b->end;
+		if( n > nbytes )
+			n = nbytes;
+		memcpy(b->page + b->end, buf, n);
+		b->end += n;
+		done = n;
+	}
+
+	while( done < nbytes && p->tail - p->head < PIPE_BUFS )
+	{
+		page = alloc_frame();
+		if( page == 0 )
+			break;
+		n = nbytes - done;
+		if( n > FOUR_KB )
+			n = FOUR_KB;
+
+		b = &p->bufs[p->tail & (PIPE_BUFS - 1)];
+		b->page = (uint8_t*)page;
+		b->start = 0;
+		b->end = n;
+		memcpy(b->page, buf + done, n);
+		p->tail++;
+		done += n;
+	}
+	p->bytes += done;
+	spin_unlock(&pipe_lock);
+
+	return done;
+}
+
+/*
+	pipe_get()
+
+	Description: copies buffered data out of a pipe, freeing each frame
+				 once it has been read
+	Inputs: p = pipe, buf = destination, nbytes = its size
+	Outputs: bytes copied (0 if the pipe is empty)
+*/
+int32_t pipe_get(pipe_t* p, uint8_t* buf, int32_t nbytes)
+{
+	pipe_buf_t* b;
+	int32_t done = 0;
+	int32_t n;
+
+	spin_lock(&pipe_lock);
+	while( done < nbytes && p->head != p->tail )
+	{
+		b = &p->bufs[p->head & (PIPE_BUFS - 1)];
+		n = b->end - b->start;
+		if( n > nbytes - done )
+			n = nbytes - done;
+		memcpy(buf + done, b->page + b->start, n);
+		b->start += n;
+		done += n;
+
+		if( b->start == b->end )
+		{
+			free_frame((uint32_t)b->page);
+			p->head++;
+		}
+	}
+	p->bytes -= done;
+	spin_unlock(&pipe_lock);
+
+	return done;
+}
+
+/*
+	pipe_writable()
+
+	Description: tells whether pipe_put() would copy anything
+	Inputs: p = pipe
+	Outputs: nonzero if there is room
+*/
+static int pipe_writable(pipe_t* p)
+{
+	return p->tail - p->head < PIPE_BUFS ||
+		   p->bufs[(p->tail - 1) & (PIPE_BUFS - 1)].end < FOUR_KB;
+}
+
+/*
+	pipe_read()
+
+	Description: reads what a pipe holds
+	Inputs: fd = read end, buf = destination, nbytes = its size
+	Outputs: bytes read, 0 at end of file, -1 for failure (also when the
+			 pipe is empty but its write end is still open: only the
+			 caller could fill it)
+*/
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+	pipe_t* p = (pipe_t*)pcb->fd_array[fd].private_data;
+	int32_t n;
+
+	if( p == NULL || buf == NULL || nbytes < 0 )
+		return -1;
+
+	n = pipe_get(p, (uint8_t*)buf, nbytes);
+	if( n == 0 && nbytes != 0 && p->writers != 0 )
+		return -1;
+	return n;
+}
+
+/*
+	pipe_write()
+
+	Description: writes as much of buf as fits in a pipe
+	Inputs: fd = write end, buf = data, nbytes = its length
+	Outputs: bytes written (less than nbytes once the pipe is full), -1
+			 if there is no reader left or nothing fit
+*/
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+	pipe_t* p = (pipe_t*)pcb->fd_array[fd].private_data;
+	int32_t done;
+
+	if( p == NULL || buf == NULL || nbytes < 0 || p->readers == 0 )
+		return -1;
+
+	done = pipe_put(p, (const uint8_t*)buf, nbytes);
+	if( done == 0 && nbytes != 0 )
+		return -1;
+	return done;
+}
+
+/*
+	pipe_read_close()
+
+	Description: close hook of the read end
+	Inputs: fd = file descriptor
+	Outputs: 0
+*/
+int32_t pipe_read_close(int32_t fd)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+
+	pipe_drop((pipe_t*)pcb->fd_array[fd].private_data, PIPE_READ_END);
+	return 0;
+}
+
+/*
+	pipe_write_close()
+
+	Description: close hook of the write end
+	Inputs: fd = file descriptor
+	Outputs: 0
+*/
+int32_t pipe_write_close(int32_t fd)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+
+	pipe_drop((pipe_t*)pcb->fd_array[fd].private_data, PIPE_WRITE_END);
+	return 0;
+}
+
+/*
+	pipe_read_poll()
+
+	Description: poll hook of the read end
+	Inputs: pcb = owning process, fd = file descriptor
+	Outputs: POLLIN if data is buffered or there is no writer (end of file)
+*/
+int32_t pipe_read_poll(struct pcb_t* pcb, int32_t fd)
+{
+	pipe_t* p = (pipe_t*)pcb->fd_array[fd].private_data;
+
+	if( p->bytes != 0 || p->writers == 0 )
+		return POLLIN;
+	return 0;
+}
+
+/*
+	pipe_write_poll()
+
+	Description: poll hook of the write end
+	Inputs: pcb = owning process, fd = file descriptor
+	Outputs: POLLOUT if there is room, POLLERR if there is no reader
+*/
+int32_t pipe_write_poll(struct pcb_t* pcb, int32_t fd)
+{
+	pipe_t* p = (pipe_t*)pcb->fd_array[fd].private_data;
+
+	if( p->readers == 0 )
+		return POLLERR;
+	if( pipe_writable(p) )
+		return POLLOUT;
+	return 0;
+}
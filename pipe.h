@@ -0,0 +1,73 @@
+/*
+	pipe.h
+
+	Pipes. pipe() gives a process a read end and a write end over a
+	kernel buffer made of up to PIPE_BUFS page frames. A write fills the
+	last frame and then takes fresh ones, so a write of a whole page goes
+	into a frame of its own with one copy, and that frame moves to the
+	reader as a unit and is freed once read.
+
+	Pipes are single-process: execute() doesn't pass fds on, so both ends
+	stay in the process that created the pipe and nothing else could ever
+	empty or fill it. A read of an empty pipe or a write to a full one
+	therefore fails instead of waiting (a partial write returns what was
+	written).
+*/
+
+#ifndef _PIPE_H
+#define _PIPE_H
+
+#include "types.h"
+#include "spinlock.h"
+
+#define PIPE_MAX 		8
+#define PIPE_BUFS 		16 		/* frames per pipe: 64 KB buffered at most */
+
+#define PIPE_READ_END 	0
+#define PIPE_WRITE_END 	1
+
+/* one page of a pipe's buffer, bytes start..end not read yet */
+typedef struct pipe_buf_t {
+	uint8_t* page;
+	uint32_t start;
+	uint32_t end;
+} pipe_buf_t;
+
+/*
+	bufs is a queue: the reader takes from head, the writer fills slot
+	tail - 1 and adds at tail. The counters run freely, a slot is the
+	counter masked by PIPE_BUFS.
+*/
+typedef struct pipe_t {
+	int in_use;
+	int readers;            /* open read ends */
+	int writers;            /* open write ends */
+	pipe_buf_t bufs[PIPE_BUFS];
+	uint32_t head;
+	uint32_t tail;
+	uint32_t bytes;         /* buffered, not read yet */
+} pipe_t;
+
+/* protects every pipe; no interrupt handler takes it */
+extern spinlock_t pipe_lock;
+
+struct pcb_t;
+
+/* takes a free pipe with one reader and one writer, NULL if none is left */
+pipe_t* pipe_create();
+/* closes one end (PIPE_READ_END / PIPE_WRITE_END); the last one frees the pipe */
+void pipe_drop(pipe_t* p, int end);
+/* copies in as much as fits, outputs the count */
+int32_t pipe_put(pipe_t* p, const uint8_t* buf, int32_t nbytes);
+/* copies out as much as is buffered, up to nbytes, outputs the count */
+int32_t pipe_get(pipe_t* p, uint8_t* buf, int32_t nbytes);
+
+/* file operations of the two ends */
+int32_t pipe_read(int32_t fd, void* buf, int32_t nbytes);
+int32_t pipe_write(int32_t fd, const void* buf, int32_t nbytes);
+int32_t pipe_read_close(int32_t fd);
+int32_t pipe_write_close(int32_t fd);
+int32_t pipe_read_poll(struct pcb_t* pcb, int32_t fd);
+int32_t pipe_write_poll(struct pcb_t* pcb, int32_t fd);
+
+#endif
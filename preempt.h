@@ -0,0 +1,24 @@
+/*
+	preempt.h
+
+	Kernel preemption. A timer tick may switch tasks anywhere in the
+	kernel while interrupts are on and the running CPU's preempt count is
+	zero. Holding a spinlock raises the count; a tick that arrives while it
+	is raised only marks a switch as pending, and preempt_enable() makes
+	the switch once the count drops back to zero.
+
+	The count lives with the CPU, but a task is only ever switched out with
+	a count of zero, so while nonzero it always belongs to the running task.
+	A task with a count of zero may move to another CPU at any tick, so
+	both functions update the count with interrupts off.
+*/
+
+#ifndef _PREEMPT_H
+#define _PREEMPT_H
+
+/* keeps the timer from switching tasks until the matching preempt_enable() */
+void preempt_disable();
+/* drops the count and makes a switch that came due in the meantime */
+void preempt_enable();
+
+#endif
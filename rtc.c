@@ -5,6 +5,8 @@
 
 #include "rtc.h"
 #include "keyboard.h"
+
+spinlock_t rtc_lock = SPINLOCK_INIT("rtc");
 #define HZ  0xF //2
 #define USR_LIMIT_HZ 1024
 #define RTC_PORT 0x70
@@ -31,9 +33,10 @@
 void RTC_init(){
 
 	char prev;
+	uint32_t flags;
 
     /*marks start of critical section*/
-    cli();//Masking all interrupts excluding NMI
+    spin_lock_irqsave(&rtc_lock, flags);
 
     //writing to Register A to specify the Hz
 
@@ -49,7 +52,7 @@ void RTC_init(){
     outb(B_REGISTER,RTC_PORT);                  //Accessing Register B
     outb(prev | ENABLE_PERIODIC_INT,CMOS_PORT); //write to bit 6 in Register B to enable periodic Interrupts
 
-    sti();//unmasking all interrupts excluding NMI
+    spin_unlock_irqrestore(&rtc_lock, flags);
     /*marks end of critical section*/
 
     enable_irq(RTC_INT_NUM);
@@ -65,18 +68,19 @@ void RTC_init(){
 */
 void RTC_handler()
 {
-  cli();
-
 	int i;
-  for( i = 0; i < 3; i++ )
+  for( i = 0; i < MAX_TERMINALS; i++ )
 	{
-		terminals[i].rtc_flag = ACTIVE;
+		if( terminals[i].is_created )
+			terminals[i].rtc_flag = ACTIVE;
 	}
+	/* any of them may be sleeping in poll() on the RTC */
+	sched_wakeup_all();
+	spin_lock(&rtc_lock);
 	outb(C_REGISTER, RTC_PORT);
 	// From OSDev: don't care about what's in Reg C
 	inb(CMOS_PORT);
-
-  sti();
+	spin_unlock(&rtc_lock);
 
 	send_eoi(RTC_INT_NUM);
 }
@@ -146,6 +150,26 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes) {
 
 
 
+/*
+	rtc_poll()
+
+	Description: poll hook of the RTC
+	Inputs: owning process, file descriptor
+	Outputs: POLLOUT, plus POLLIN if rtc_read() wouldn't wait
+	Side Effects: None
+
+*/
+
+
+int32_t rtc_poll(struct pcb_t* pcb, int32_t fd) {
+
+    if(terminals[pcb->terminal_number].rtc_flag)
+        return POLLIN | POLLOUT;
+    return POLLOUT;
+}
+
+
+
 /*
 	rtc_write()
 
@@ -170,6 +194,7 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
 
     uint8_t prev;
     uint8_t value;
+    uint32_t flags;
 
     //check whether it's in bounds and a power of 2
 
@@ -219,7 +244,7 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
     //put frequency(in proper bits) into Register A
 
 
-    cli();//Masking all interrupts excluding NMI
+    spin_lock_irqsave(&rtc_lock, flags);
 
     //writing to Register A to specify the Hz
 
@@ -229,8 +254,98 @@ int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes) {
     value = value | (prev & CLEAR_REG); //clearing the last 4 bits of Reg. A
     outb(value,CMOS_PORT);  //writing frequency into Register A
 
-    sti();
+    spin_unlock_irqrestore(&rtc_lock, flags);
 
 
     return RTC_WRITE_SUCCESS; //returns 4, the number of bytes written
 }
+
+/*
+	cmos_read()
+
+	Description: reads a CMOS register (rtc_lock held)
+	Inputs: reg = register index, NMI disable bit included
+	Outputs: its value
+*/
+static uint8_t cmos_read(uint8_t reg)
+{
+	outb(reg, RTC_PORT);
+	return inb(CMOS_PORT);
+}
+
+/*
+	bcd_to_bin()
+
+	Description: converts a two digit BCD value
+*/
+static uint32_t bcd_to_bin(uint8_t v)
+{
+	return (v & 0x0F) + (v >> 4) * 10;
+}
+
+/*
+	rtc_read_time()
+
+	Description: reads the date and time from the CMOS clock, which is
+				 taken to keep UTC
+	Inputs: None
+	Outputs: seconds since 1970-01-01 00:00 UTC
+	Side Effects: none
+*/
+uint32_t rtc_read_time()
+{
+	/* days before the first of each month in a common year */
+	static const uint32_t month_days[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+	static const uint8_t regs[6] = { CMOS_SECONDS, CMOS_MINUTES, CMOS_HOURS, CMOS_DAY, CMOS_MONTH, CMOS_YEAR };
+	uint8_t t[6], again[6];
+	uint8_t status_b;
+	uint32_t sec, min, hour, day, month, year, days;
+	uint32_t flags;
+	int i, same;
+
+	spin_lock_irqsave(&rtc_lock, flags);
+	/* read until two passes agree, so an update can't tear the values */
+	do {
+		while( cmos_read(A_REGISTER) & CMOS_UPDATING )
+			;
+		for( i = 0; i < 6; i++ )
+			t[i] = cmos_read(regs[i]);
+		while( cmos_read(A_REGISTER) & CMOS_UPDATING )
+			;
+		same = 1;
+		for( i = 0; i < 6; i++ )
+		{
+			again[i] = cmos_read(regs[i]);
+			if( again[i] != t[i] )
+				same = 0;
+		}
+	} while( !same );
+	status_b = cmos_read(B_REGISTER);
+	spin_unlock_irqrestore(&rtc_lock, flags);
+
+	hour = t[2] & ~CMOS_PM;
+	if( status_b & CMOS_BINARY )
+	{
+		sec = t[0]; min = t[1]; day = t[3]; month = t[4]; year = t[5];
+	}
+	else
+	{
+		sec = bcd_to_bin(t[0]); min = bcd_to_bin(t[1]); hour = bcd_to_bin(hour);
+		day = bcd_to_bin(t[3]); month = bcd_to_bin(t[4]); year = bcd_to_bin(t[5]);
+	}
+	/* 12 AM is hour 12 */
+	if( !(status_b & CMOS_24_HOUR) )
+		hour = (hour % 12) + ((t[2] & CMOS_PM) ? 12 : 0);
+
+	if( month < 1 || month > 12 )
+		month = 1;
+	year += CMOS_CENTURY_BASE;
+
+	/* every fourth year is a leap year from 1901 to 2099 */
+	days = (year - UNIX_EPOCH_YEAR) * 365 + (year - UNIX_EPOCH_YEAR + 1) / 4;
+	days += month_days[month - 1] + day - 1;
+	if( year % 4 == 0 && month > 2 )
+		days++;
+
+	return days * SECS_PER_DAY + hour * 3600 + min * 60 + sec;
+}
@@ -5,6 +5,7 @@
 #include "lib.h"
 #include "i8259.h"
 #include "system_calls.h"
+#include "spinlock.h"
 
 /* RTC relevant constants */
 #define HZ  0xF //2
@@ -48,6 +49,24 @@
 #define HEX_1024 0x6
 #define CLEAR_REG 0xF0
 
+/* CMOS clock registers (read with the NMI disable bit, like A-C above) */
+#define CMOS_SECONDS 		0x80
+#define CMOS_MINUTES 		0x82
+#define CMOS_HOURS 			0x84
+#define CMOS_DAY 			0x87
+#define CMOS_MONTH 			0x88
+#define CMOS_YEAR 			0x89
+#define CMOS_UPDATING 		0x80 	/* register A: clock update in progress */
+#define CMOS_BINARY 		0x04 	/* register B: values are binary, not BCD */
+#define CMOS_24_HOUR 		0x02 	/* register B: 24 hour clock */
+#define CMOS_PM 			0x80 	/* hours register in 12 hour mode */
+#define CMOS_CENTURY_BASE 	2000 	/* the CMOS year is taken to be in the 2000s */
+#define UNIX_EPOCH_YEAR 	1970
+#define SECS_PER_DAY 		86400
+
+
+/* CMOS index / data port pair */
+extern spinlock_t rtc_lock;
 
 /* Initializes the RTC */
 void RTC_init();
@@ -67,4 +86,11 @@ int32_t rtc_read(int32_t fd, void* buf, int32_t nbytes);
 /*writes a frequency into the register*/
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes);
 
+struct pcb_t;
+/* POLLIN once an interrupt has come since the last read */
+int32_t rtc_poll(struct pcb_t* pcb, int32_t fd);
+
+/* reads the CMOS clock as seconds since 1970 */
+uint32_t rtc_read_time();
+
 #endif
@@ -7,6 +7,13 @@
 
 #include "scheduler.h"
 
+/* run_queue holds one bit per terminal */
+#if MAX_TERMINALS > 32
+#error "MAX_TERMINALS must fit in the 32-bit run queue masks"
+#endif
+
+sched_latency_t sched_latency;
+
 /*
 	pit_init()
 
@@ -47,10 +54,161 @@ void pit_init(){
 }
 
 
+/*
+	sched_tick()
+
+	Description: saves the interrupted process's kernel stack pointers and
+				 calls the scheduler. scheduler() returns through the frame
+				 of this function saved for the next process, so every
+				 switch must go through here. Inside a preempt_disable()
+				 section the switch is only marked as pending.
+	Inputs: None
+	Outputs: None
+*/
+static void __attribute__((noinline)) sched_tick()
+{
+  cpu_t* cpu = this_cpu();
+  int term = cpu->curr_term;
+
+  if( cpu->preempt_count != 0 )
+  {
+      if( !cpu->need_resched )
+      {
+          cpu->need_resched = 1;
+          cpu->resched_tsc = rdtsc();
+      }
+      return;
+  }
+  cpu->need_resched = 0;
+
+  /* an idle AP has no process to save */
+  if( term != -1 )
+  {
+      /* condition to prevent Terminal 1 from producing errors */
+      if( terminals[term].current_process == -1 )
+          return;
+
+      pcb_t * old_pcb = (pcb_t*)(MB8 - (KB8 * (terminals[term].current_process + 1)));
+
+      /* execute() may be loading a child's image at 128 MB */
+      old_pcb->prog_phys = cpu_page_directory()[MB128 / FOUR_MB] & ~(FOUR_MB - 1);
+
+      //pre-context switch, storing the important information of the process
+      asm volatile("  \n\
+       movl %%esp, %0 \n\
+       movl %%ebp, %1 \n\
+      "
+      : "=g"(old_pcb->esp), "=g"(old_pcb->ebp)
+      );
+  }
+
+  scheduler();
+}
+
+
+/*
+	preempt_disable()
+
+	Description: raises the running CPU's preempt count. Interrupts are
+				 off from looking the CPU up to the increment: a tick in
+				 between could move the task to another CPU and the count
+				 would land on the old one.
+	Inputs: None
+	Outputs: None
+*/
+void preempt_disable()
+{
+  uint32_t flags;
+
+  cli_and_save(flags);
+  this_cpu()->preempt_count++;
+  restore_flags(flags);
+  barrier();
+}
+
+
+/*
+	preempt_enable()
+
+	Description: lowers the preempt count. If a tick wanted to switch
+				 tasks while it was raised, switches now, unless interrupts
+				 were off (then the next tick does it). The decrement and
+				 the check happen with interrupts off, so both use the CPU
+				 the task is on: once the count is zero a tick may move it.
+	Inputs: None
+	Outputs: None
+*/
+void preempt_enable()
+{
+  cpu_t* cpu;
+  uint32_t flags;
+  uint32_t waited;
+
+  barrier();
+  cli_and_save(flags);
+  cpu = this_cpu();
+  if( --cpu->preempt_count == 0 && cpu->need_resched && (flags & EFLAGS_IF) )
+  {
+      waited = (uint32_t)(rdtsc() - cpu->resched_tsc);
+      if( waited > sched_latency.defer_max )
+          sched_latency.defer_max = waited;
+      sched_tick();
+  }
+  restore_flags(flags);
+}
+
+
+/*
+	sched_latency_sample()
+
+	Description: records the TSC time since the previous PIT interrupt.
+				 The shortest interval is close to the PIT period; anything
+				 longer is how late the interrupt was taken because the
+				 kernel had interrupts off.
+	Inputs: None
+	Outputs: None
+*/
+static void sched_latency_sample()
+{
+  uint64_t now = rdtsc();
+  uint32_t interval;
+
+  if( sched_latency.last_tick != 0 )
+  {
+      interval = (uint32_t)(now - sched_latency.last_tick);
+      if( sched_latency.tick_min == 0 || interval < sched_latency.tick_min )
+          sched_latency.tick_min = interval;
+      if( interval > sched_latency.tick_max )
+          sched_latency.tick_max = interval;
+  }
+  sched_latency.last_tick = now;
+}
+
+
+/*
+	sched_timeouts()
+
+	Description: wakes the terminals whose poll() timeout has run out
+	Inputs: None
+	Outputs: None
+*/
+static void sched_timeouts()
+{
+  int i;
+
+  for( i = 0; i < MAX_TERMINALS; i++ )
+  {
+      if( terminals[i].sleeping && terminals[i].wake_tick != 0 &&
+          (int32_t)(pit_ticks - terminals[i].wake_tick) >= 0 )
+          sched_wakeup(i);
+  }
+}
+
+
 /*
 	pit_handler()
 
-	Description: handler for a PIT interrupt
+	Description: handler for a PIT interrupt (boot CPU)
 	Inputs: None
 	Outputs: None
 	Side Effects: handles PIT interrupt
@@ -58,34 +216,100 @@ void pit_init(){
 
 void pit_handler(){
 
+  /* interrupt gate: IF is already clear */
   send_eoi(PIT_IRQ);
 
-  cli();
+  pit_ticks++;
+  sched_latency_sample();
+  vdso_update();
+  sched_timeouts();
+
+  /* print a few pending kernel log records */
+  klog_drain(KLOG_DRAIN_BATCH);
 
-  /* condition to prevent Terminal 1 from producing errors */
-  if( terminals[curr_idx].current_process == -1 )
+  /* draw console text that hasn't been flushed by a cursor update yet */
+  if( fbcon.enabled )
   {
-      sti();
-      return;
+      if( terminals[visible_terminal].vidmap_table != NULL )
+          fbcon_sync();
+      else
+          fbcon_flush();
   }
 
-  pcb_t * old_pcb = (pcb_t*)(MB8 - (KB8 * (terminals[curr_idx].current_process + 1)));
+  sched_tick();
+}
 
-  //pre-context switch, storing the important information of the process
-  asm volatile("  \n\
-   movl %%esp, %0 \n\
-   movl %%ebp, %1 \n\
-  "
-  : "=g"(old_pcb->esp), "=g"(old_pcb->ebp)
-  );
 
-  scheduler();
+/*
+	lapic_timer_handler()
+
+	Description: handler for the local APIC timer, the scheduling tick of
+				 the application processors
+	Inputs: None
+	Outputs: None
+*/
+void lapic_timer_handler()
+{
+  lapic_eoi();
+
+  this_cpu()->ticks++;
+
+  sched_tick();
+}
+
 
-  /* HANDLER SHOULD NEVER REACH THIS POINT. THIS IS CONSIDERED A FAILURE*/
+/*
+  sched_balance()
+
+  Description: takes a terminal from the busiest CPU if it has at least
+               two more than this one. Only terminals that are not running
+               and whose process has been preempted once (so its kernel
+               stack is saved) can move.
+  Inputs: cpu = the running CPU
+  Outputs: None
+  Side Effects: called with run_queue_lock held
+*/
+static void sched_balance(cpu_t* cpu)
+{
+  int mine = 0;
+  int most = 0;
+  int busiest = -1;
+  int count;
+  int i, t;
 
-  sti();
+  for( t = 0; t < MAX_TERMINALS; t++ )
+      if( cpu->run_queue & (1 << t) )
+          mine++;
 
-  return;
+  for( i = 0; i < APIC_MAX_CPUS; i++ )
+  {
+      if( !cpus[i].online || &cpus[i] == cpu )
+          continue;
+      count = 0;
+      for( t = 0; t < MAX_TERMINALS; t++ )
+          if( cpus[i].run_queue & (1 << t) )
+              count++;
+      if( count > most )
+      {
+          most = count;
+          busiest = i;
+      }
+  }
+
+  if( busiest == -1 || most < mine + 2 )
+      return;
+
+  for( t = 0; t < MAX_TERMINALS; t++ )
+  {
+      if( (cpus[busiest].run_queue & (1 << t)) && t != cpus[busiest].curr_term &&
+          terminals[t].has_been_launched && terminals[t].current_process != -1 )
+      {
+          cpus[busiest].run_queue &= ~(1 << t);
+          cpu->run_queue |= (1 << t);
+          cpu->migrations++;
+          return;
+      }
+  }
 }
 
 
@@ -93,6 +317,9 @@ void pit_handler(){
   scheduler()
 
   Description: This function switches from one process to another process
+               on this CPU's run queue. run_queue_lock is held until the
+               switch is done, so no other CPU can pick up the terminal
+               we are leaving while we still run on its stack.
   Inputs: None
   Outputs: None
   Side Effects: Context switches to the next scheduled process
@@ -101,37 +328,55 @@ void pit_handler(){
 
 void scheduler()
 {
+    cpu_t* cpu = this_cpu();
+
+    /* raw: the lock is handed over with the switch, so it must not touch
+       the preempt count */
+    raw_spin_lock(&run_queue_lock);
+
+    if( smp_enabled )
+        sched_balance(cpu);
+
     /* update curr_idx */
-    curr_idx = find_next_process();
+    int next = find_next_process();
+
+    /* idle AP with nothing to take over */
+    if( next == -1 )
+    {
+        raw_spin_unlock(&run_queue_lock);
+        return;
+    }
+    cpu->curr_term = next;
 
     /* determine the process ID of this terminal's current process */
-    int term_process = terminals[curr_idx].current_process;
+    int term_process = terminals[next].current_process;
 
     /* find the next PCB so we can switch the ESP and EBP */
     pcb_t * next_pcb = (pcb_t*)(MB8 - (KB8 * (term_process + 1)));
 
     /* set necessary TSS information (really only esp0 matters) */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = (MB8 - (KB8 * term_process)) - 4;
+    cpu->tss->ss0 = KERNEL_DS;
+    cpu->tss->esp0 = (MB8 - (KB8 * term_process)) - 4;
 
-    /* restore paging and user video memory mapping for the new process */
-    map_task(MB128, (MB8 + (term_process * MB4)));
-    if( terminals[curr_idx].is_visible )
-        map_vidmem(terminals[curr_idx].user_vidmem_addr, VIDMEM_START_ADDR);
-    else
-        map_vidmem(terminals[curr_idx].user_vidmem_addr, terminals[curr_idx].vidmem_addr);
-
-    sti();
+    /* restore paging, the process's windows (see paging.h) and user
+       video memory mapping for the new process (whatever
+       was at 128 MB when it was switched out: a child's image if it was
+       preempted inside execute()) */
+    user_windows_map(term_process);
+    map_task(MB128, next_pcb->prog_phys);
+    map_vidmem(next, terminal_vid_phys(next));
 
     asm volatile("							                   \n\
     mov %0, %%esp							                     \n\
 	  mov %1, %%ebp							                     \n\
+    movl $0, %2 		# release run_queue_lock       \n\
     # jump back to current process program counter \n\
 	  leave 						                             \n\
     ret                                            \n\
    	"
     :
-    : "r"(next_pcb->esp), "r"(next_pcb->ebp)
+    : "r"(next_pcb->esp), "r"(next_pcb->ebp), "m"(run_queue_lock.locked)
+    : "memory"
     );
 }
 
@@ -139,19 +384,25 @@ void scheduler()
 
   find_next_process()
 
-  Description: finds the terminal index of the next scheduled process
+  Description: finds the terminal index of the next scheduled process on
+               this CPU's run queue
   Inputs: None
-  Outputs: index to the terminal array
+  Outputs: index to the terminal array, -1 if an idle CPU has none
 
 */
 int find_next_process()
 {
-  int temp = curr_idx;
-  int i;
-  for( i = ((curr_idx + 1) % NUM_TERMINALS); i != curr_idx; i = ((i + 1) % NUM_TERMINALS) )
+  cpu_t* cpu = this_cpu();
+  int temp = cpu->curr_term;
+  int i, n;
+
+  /* the current terminal is checked last */
+  for( n = 1; n <= MAX_TERMINALS; n++ )
   {
-      /* check to see if the terminal is even running */
-      if( terminals[i].has_been_launched )
+      i = (cpu->curr_term + n + MAX_TERMINALS) % MAX_TERMINALS;
+      /* check to see if the terminal is even running, and not asleep */
+      if( (cpu->run_queue & (1 << i)) && terminals[i].has_been_launched &&
+          terminals[i].current_process != -1 && !terminals[i].sleeping )
       {
           temp = i;
           break;
@@ -161,6 +412,135 @@ int find_next_process()
 
 }
 
+/*
+  sched_add_terminal()
+
+  Description: puts a terminal whose base shell is being launched on this
+               CPU's run queue and makes it the current one
+  Inputs: term_num = terminal
+  Outputs: None
+*/
+void sched_add_terminal(int term_num)
+{
+    cpu_t* cpu = this_cpu();
+
+    spin_lock(&run_queue_lock);
+    cpu->run_queue |= (1 << term_num);
+    cpu->curr_term = term_num;
+    spin_unlock(&run_queue_lock);
+}
+
+/*
+  sched_remove_terminal()
+
+  Description: takes a terminal off the run queue holding it (its shell
+               failed to launch)
+  Inputs: term_num = terminal
+  Outputs: None
+*/
+void sched_remove_terminal(int term_num)
+{
+    int i;
+
+    spin_lock(&run_queue_lock);
+    for( i = 0; i < APIC_MAX_CPUS; i++ )
+        cpus[i].run_queue &= ~(1 << term_num);
+    spin_unlock(&run_queue_lock);
+}
+
+/*
+  sched_sleep()
+
+  Description: marks a terminal's process as waiting for an event, so
+               the scheduler passes it over until sched_wakeup(). The
+               process itself still has to halt until then.
+  Inputs: term_num = terminal, deadline = pit_ticks to wake up at
+          anyway, 0 for none
+  Outputs: None
+*/
+void sched_sleep(int term_num, uint32_t deadline)
+{
+    terminals[term_num].wake_tick = deadline;
+    barrier();
+    terminals[term_num].sleeping = 1;
+}
+
+/*
+  sched_wakeup()
+
+  Description: makes a sleeping terminal runnable again (from the
+               interrupt handlers that produce its input)
+  Inputs: term_num = terminal
+  Outputs: None
+*/
+void sched_wakeup(int term_num)
+{
+    terminals[term_num].sleeping = 0;
+}
+
+/*
+  sched_wait()
+
+  Description: halts the calling process until its terminal is woken.
+               sti; hlt can't lose an interrupt in between, so a wakeup
+               after the check still ends the wait.
+  Inputs: term_num = the caller's terminal, after sched_sleep()
+  Outputs: None
+*/
+void sched_wait(int term_num)
+{
+    cli();
+    while( terminals[term_num].sleeping )
+        asm volatile ("sti; hlt; cli" : : : "memory");
+    sti();
+}
+
+/*
+  sched_wakeup_all()
+
+  Description: wakes every sleeping terminal, for events (RTC, mouse)
+               that aren't tied to one; each rechecks its own fds
+  Inputs: None
+  Outputs: None
+*/
+void sched_wakeup_all()
+{
+    int i;
+
+    for( i = 0; i < MAX_TERMINALS; i++ )
+        terminals[i].sleeping = 0;
+}
+
+/*
+  sched_latency_report()
+
+  Description: logs the worst scheduling latency seen since the last
+               report: how late a PIT tick was taken, and how long a
+               switch it asked for waited on a preempt count. Then starts
+               a new measurement.
+  Inputs: None
+  Outputs: None
+  Side Effects: adds records to the kernel log
+*/
+void sched_latency_report()
+{
+    /* the shortest interval is about one period */
+    uint32_t cycles_per_us = sched_latency.tick_min / PIT_TICK_US;
+
+    if( cycles_per_us == 0 )
+    {
+        klog(KLOG_INFO, "sched: no latency samples yet");
+        return;
+    }
+
+    klog(KLOG_INFO, "sched: worst tick delay %u us, worst preempt delay %u us",
+         (sched_latency.tick_max - sched_latency.tick_min) / cycles_per_us,
+         sched_latency.defer_max / cycles_per_us);
+
+    sched_latency.tick_max = 0;
+    sched_latency.defer_max = 0;
+}
+
 /*
   scheduler_init()
 
@@ -4,6 +4,9 @@
 #include "lib.h"
 #include "i8259.h"
 #include "system_calls.h"
+#include "klog.h"
+#include "smp.h"
+#include "vdso.h"
 
 #define SET_PIT_1 0x36
 #define SET_PIT_2 0x30
@@ -14,12 +17,32 @@
 #define HZ_31 0x965A
 #define HZ_18 0xFFFF
 #define HZ_40 0x7486
+#define PIT_TICK_US 25000   /* period at HZ_40 */
+#define PIT_TICK_NS 25000377  /* 0x7486 / 1193182 Hz */
+
+/*
+	Scheduling latency in TSC cycles, from the PIT interrupts: tick_min is
+	about the PIT period, tick_max - tick_min the longest the kernel kept
+	the interrupt waiting, and defer_max the longest a switch waited for a
+	preempt count to drop.
+*/
+typedef struct sched_latency_t {
+	uint64_t last_tick;
+	uint32_t tick_min;
+	uint32_t tick_max;
+	uint32_t defer_max;
+} sched_latency_t;
+
+extern sched_latency_t sched_latency;
 
 /* stores previous value of curr_idx to restore if shell execution fails */
 int restore_curr_idx;
 
-/* variable used to determine which scheduled process to switch to */
-int curr_idx;
+/* PIT interrupts since boot */
+volatile uint32_t pit_ticks;
+
+/* terminal whose process the running CPU is executing (-1 on an idle AP) */
+#define curr_idx 	(this_cpu()->curr_term)
 
 /* initializes scheduler variables and the PIT */
 void scheduler_init();
@@ -30,6 +53,21 @@ int find_next_process();
 /* initializes the PIT device */
 void pit_init();
 void pit_handler();
+/* scheduling tick of the application processors */
+void lapic_timer_handler();
+/* puts a newly launched terminal on this CPU's run queue and makes it current */
+void sched_add_terminal(int term_num);
+/* takes a terminal off whichever run queue holds it */
+void sched_remove_terminal(int term_num);
+/* takes a terminal off scheduling until woken or pit_ticks reaches deadline (0: never) */
+void sched_sleep(int term_num, uint32_t deadline);
+/* halts until the terminal put to sleep is woken */
+void sched_wait(int term_num);
+/* makes a sleeping terminal runnable */
+void sched_wakeup(int term_num);
+void sched_wakeup_all();
+/* logs the worst scheduling latency since the last report and resets it */
+void sched_latency_report();
 int isEmpty();
 
 
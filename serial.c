@@ -0,0 +1,232 @@
+/*
+	serial.c
+
+	COM1 driver for headless runs (e.g. QEMU -nographic). One terminal is
+	mirrored to the port: everything putc() writes to it is queued in the
+	TX ring and sent from the THR-empty interrupt, a FIFO's worth at a
+	time. Characters received on the port are fed to the same terminal as
+	if they had been typed, so a script on the host can drive the shell.
+
+	Enabled with "serial" on the kernel command line.
+
+	Every CPU may print, so the rings and the UART registers are covered
+	by serial_lock, taken with interrupts off since the handler takes it
+	too.
+*/
+
+#include "serial.h"
+#include "terminal.h"
+
+serial_t serial;
+spinlock_t serial_lock = SPINLOCK_INIT("serial");
+
+/*
+	serial_tx_fill()
+
+	Description: moves up to one FIFO's worth of queued bytes into the UART;
+				 turns the THR-empty interrupt off once the ring is empty
+	Inputs: None
+	Outputs: None
+	Side Effects: call with serial_lock held
+*/
+static void serial_tx_fill()
+{
+	int i;
+
+	for( i = 0; i < UART_FIFO_SIZE && serial.tx_head != serial.tx_tail; i++ )
+	{
+		outb(serial.tx_buf[serial.tx_head], SERIAL_PORT + UART_DATA);
+		serial.tx_head = (serial.tx_head + 1) & (SERIAL_TX_SIZE - 1);
+	}
+
+	if( serial.tx_head == serial.tx_tail && (serial.ier & UART_IER_THRE) )
+	{
+		serial.ier &= ~UART_IER_THRE;
+		outb(serial.ier, SERIAL_PORT + UART_IER);
+	}
+}
+
+/*
+	serial_init()
+
+	Description: programs COM1 for 115200 8N1 with FIFOs, checks that the
+				 UART is there with a loopback test and enables RX interrupts
+	Inputs: term_num = terminal to mirror and feed
+	Outputs: 0 for success, -1 if there is no UART
+	Side Effects: enables IRQ4
+*/
+int32_t serial_init(int term_num)
+{
+	uint32_t divisor = UART_BAUD_BASE / SERIAL_BAUD;
+
+	outb(0, SERIAL_PORT + UART_IER);
+	outb(UART_LCR_DLAB, SERIAL_PORT + UART_LCR);
+	outb(divisor & 0xFF, SERIAL_PORT + UART_DATA);
+	outb(divisor >> 8, SERIAL_PORT + UART_IER);
+	outb(UART_LCR_8N1, SERIAL_PORT + UART_LCR);
+	outb(UART_FCR_ENABLE, SERIAL_PORT + UART_FCR);
+
+	/* a missing UART reads back 0xFF */
+	outb(UART_MCR_LOOPBACK, SERIAL_PORT + UART_MCR);
+	outb(UART_TEST_BYTE, SERIAL_PORT + UART_DATA);
+	if( inb(SERIAL_PORT + UART_DATA) != UART_TEST_BYTE )
+		return -1;
+	outb(UART_MCR_NORMAL, SERIAL_PORT + UART_MCR);
+
+	serial.term = term_num;
+	serial.tx_head = serial.tx_tail = 0;
+	serial.rx_head = serial.rx_tail = 0;
+	serial.ier = UART_IER_RX;
+	outb(serial.ier, SERIAL_PORT + UART_IER);
+	serial.enabled = 1;
+
+	enable_irq(SERIAL_INT_NUM);
+	return 0;
+}
+
+/*
+	serial_queue()
+
+	Description: adds one byte to the TX ring
+	Inputs: c = byte
+	Outputs: None
+	Side Effects: call with serial_lock held. If the ring is full
+				  (interrupts off for a long stretch), the oldest bytes are
+				  pushed out by polling instead of being dropped
+*/
+static void serial_queue(uint8_t c)
+{
+	uint32_t next;
+
+	next = (serial.tx_tail + 1) & (SERIAL_TX_SIZE - 1);
+	if( next == serial.tx_head )
+	{
+		while( !(inb(SERIAL_PORT + UART_LSR) & UART_LSR_THRE) );
+		serial_tx_fill();
+	}
+
+	serial.tx_buf[serial.tx_tail] = c;
+	serial.tx_tail = next;
+
+	/* the interrupt fires right away if the transmitter is idle */
+	if( !(serial.ier & UART_IER_THRE) )
+	{
+		serial.ier |= UART_IER_THRE;
+		outb(serial.ier, SERIAL_PORT + UART_IER);
+	}
+}
+
+/*
+	serial_putc()
+
+	Description: queues one character, translating '\n' to "\r\n" (both
+				 under one lock hold, so another CPU can't get in between)
+	Inputs: c = character
+	Outputs: None
+*/
+void serial_putc(uint8_t c)
+{
+	uint32_t flags;
+
+	if( !serial.enabled )
+		return;
+
+	spin_lock_irqsave(&serial_lock, flags);
+	if( c == '\n' )
+		serial_queue('\r');
+	serial_queue(c);
+	spin_unlock_irqrestore(&serial_lock, flags);
+}
+
+/*
+	serial_puts()
+
+	Description: queues a NUL terminated string
+*/
+void serial_puts(const int8_t* s)
+{
+	while( *s != '\0' )
+		serial_putc(*s++);
+}
+
+/*
+	serial_handler()
+
+	Description: handler for a COM1 interrupt. Empties the RX FIFO into the
+				 RX ring, refills the TX FIFO, then hands received
+				 characters to the terminal.
+	Inputs: None
+	Outputs: None
+	Side Effects: may echo to the screen and commit a line for terminal_read()
+*/
+void serial_handler()
+{
+	uint8_t iir;
+	uint8_t c;
+	uint32_t next;
+	uint32_t flags;
+	int got;
+
+	send_eoi(SERIAL_INT_NUM);
+
+	spin_lock_irqsave(&serial_lock, flags);
+
+	while( !((iir = inb(SERIAL_PORT + UART_IIR)) & UART_IIR_NONE) )
+	{
+		switch( iir & UART_IIR_MASK )
+		{
+			case UART_IIR_RX:
+			case UART_IIR_TIMEOUT:
+				while( inb(SERIAL_PORT + UART_LSR) & UART_LSR_DR )
+				{
+					c = inb(SERIAL_PORT + UART_DATA);
+					next = (serial.rx_tail + 1) & (SERIAL_RX_SIZE - 1);
+					/* drop input when the ring is full */
+					if( next != serial.rx_head )
+					{
+						serial.rx_buf[serial.rx_tail] = c;
+						serial.rx_tail = next;
+					}
+				}
+				break;
+
+			case UART_IIR_THRE:
+				serial_tx_fill();
+				break;
+
+			case UART_IIR_LINE:
+				inb(SERIAL_PORT + UART_LSR);
+				break;
+
+			default:
+				inb(SERIAL_PORT + UART_MSR);
+				break;
+		}
+	}
+
+	spin_unlock_irqrestore(&serial_lock, flags);
+
+	/* feed the terminal like the keyboard would: CR is Enter, DEL is
+	   backspace. Not under the lock: the echo comes back to serial_putc() */
+	while( 1 )
+	{
+		spin_lock_irqsave(&serial_lock, flags);
+		got = serial.rx_head != serial.rx_tail;
+		if( got )
+		{
+			c = serial.rx_buf[serial.rx_head];
+			serial.rx_head = (serial.rx_head + 1) & (SERIAL_RX_SIZE - 1);
+		}
+		spin_unlock_irqrestore(&serial_lock, flags);
+		if( !got )
+			break;
+
+		if( c == '\r' )
+			c = ENTER;
+		else if( c == DEL )
+			c = BACKSPACE;
+		terminal_input(c, serial.term);
+	}
+
+	sti();
+}
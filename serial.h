@@ -0,0 +1,80 @@
+/*
+	serial.h
+
+	Interrupt driven 16550 UART driver for COM1
+*/
+
+#ifndef _SERIAL_H
+#define _SERIAL_H
+
+#include "lib.h"
+#include "i8259.h"
+#include "spinlock.h"
+
+/* COM1 */
+#define SERIAL_PORT 			0x3F8
+#define SERIAL_INT_NUM 			4
+
+/* UART registers (offsets from SERIAL_PORT) */
+#define UART_DATA 				0 	/* RX / TX holding register, divisor low with DLAB */
+#define UART_IER 				1 	/* interrupt enable, divisor high with DLAB */
+#define UART_IIR 				2 	/* interrupt identification (read) */
+#define UART_FCR 				2 	/* FIFO control (write) */
+#define UART_LCR 				3
+#define UART_MCR 				4
+#define UART_LSR 				5
+#define UART_MSR 				6
+
+#define UART_IER_RX 			0x01
+#define UART_IER_THRE 			0x02
+#define UART_IIR_NONE 			0x01 	/* no interrupt pending */
+#define UART_IIR_MASK 			0x0E
+#define UART_IIR_MODEM 			0x00
+#define UART_IIR_THRE 			0x02
+#define UART_IIR_RX 			0x04
+#define UART_IIR_LINE 			0x06
+#define UART_IIR_TIMEOUT 		0x0C
+#define UART_FCR_ENABLE 		0xC7 	/* enable and clear FIFOs, RX trigger at 14 bytes */
+#define UART_LCR_DLAB 			0x80
+#define UART_LCR_8N1 			0x03
+#define UART_MCR_LOOPBACK 		0x1E
+#define UART_MCR_NORMAL 		0x0B 	/* DTR, RTS, OUT2 (routes the IRQ) */
+#define UART_LSR_DR 			0x01 	/* data ready */
+#define UART_LSR_THRE 			0x20 	/* transmit holding register empty */
+#define UART_TEST_BYTE 			0xAE
+#define UART_FIFO_SIZE 			16
+#define UART_BAUD_BASE 			115200
+#define SERIAL_BAUD 			115200
+
+/* ring buffers (sizes must be powers of two) */
+#define SERIAL_TX_SIZE 			4096
+#define SERIAL_RX_SIZE 			256
+
+#define DEL 					0x7F
+
+typedef struct serial_t {
+	int enabled;                        /* 1 once the UART passed its loopback test */
+	int term;                           /* terminal mirrored to / fed from the port */
+	uint8_t ier;                        /* current interrupt enable register */
+	uint8_t tx_buf[SERIAL_TX_SIZE];
+	uint32_t tx_head;                   /* next byte to send */
+	uint32_t tx_tail;                   /* next free slot */
+	uint8_t rx_buf[SERIAL_RX_SIZE];
+	uint32_t rx_head;
+	uint32_t rx_tail;
+} serial_t;
+
+extern serial_t serial;
+/* protects the rings and the UART registers */
+extern spinlock_t serial_lock;
+
+/* sets up COM1 and mirrors / feeds terminal term_num */
+int32_t serial_init(int term_num);
+/* queues one character for transmission */
+void serial_putc(uint8_t c);
+/* queues a string for transmission */
+void serial_puts(const int8_t* s);
+/* IRQ4 handler */
+void serial_handler();
+
+#endif
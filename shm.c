@@ -0,0 +1,282 @@
+/*
+	shm.c
+
+	Shared memory segments (see shm.h). Segment frames and each window's
+	page table come from the frame pool; like the I/O ring and the
+	message window, SHM_ADDR is one of the process's windows (see
+	paging.h).
+*/
+
+#include "shm.h"
+#include "lib.h"
+#include "paging.h"
+#include "system_calls.h"
+
+#define SHM_PTE_FLAGS 	(PAGE_PRESENT | PAGE_RW | PAGE_USER)
+
+shm_segment_t shm_segments[SHM_MAX_SEGMENTS];
+shm_proc_t shm_procs[MAX_NUM_PROCS];
+spinlock_t shm_lock = SPINLOCK_INIT("shm");
+
+/*
+	shm_free()
+
+	Description: frees a segment's frames and its slot
+	Inputs: seg = segment
+	Outputs: None
+	Side Effects: called with shm_lock held
+*/
+static void shm_free(shm_segment_t* seg)
+{
+	uint32_t i;
+
+	for( i = 0; i < seg->num_pages; i++ )
+		free_frame(seg->frames[i]);
+	seg->in_use = 0;
+}
+
+/*
+	shm_find()
+
+	Description: looks a segment up by key
+	Inputs: key
+	Outputs: its index, -1 if there is none
+	Side Effects: called with shm_lock held
+*/
+static int32_t shm_find(uint32_t key)
+{
+	int32_t i;
+
+	for( i = 0; i < SHM_MAX_SEGMENTS; i++ )
+	{
+		if( shm_segments[i].in_use && shm_segments[i].key == key )
+			return i;
+	}
+	return -1;
+}
+
+/*
+	shm_get()
+
+	Description: finds the segment with a key, or creates it with zeroed
+				 frames if there is none
+	Inputs: pcb = the calling process, key = chosen by the programs,
+			size = bytes needed (a new segment is rounded up to pages)
+	Outputs: segment ID, -1 for failure (bad size, an existing segment
+			 is too small, no slots or frames left)
+*/
+int32_t shm_get(pcb_t* pcb, uint32_t key, uint32_t size)
+{
+	uint32_t frames[SHM_MAX_PAGES];
+	uint32_t num_pages = (size + FOUR_KB - 1) / FOUR_KB;
+	shm_segment_t* seg;
+	uint32_t flags;
+	int32_t id;
+	uint32_t i;
+
+	if( size == 0 || size > SHM_MAX_PAGES * FOUR_KB )
+		return -1;
+
+	spin_lock_irqsave(&shm_lock, flags);
+	id = shm_find(key);
+	if( id != -1 && shm_segments[id].num_pages * FOUR_KB < size )
+	{
+		spin_unlock_irqrestore(&shm_lock, flags);
+		return -1;
+	}
+	spin_unlock_irqrestore(&shm_lock, flags);
+	if( id != -1 )
+		return id;
+
+	/* allocating zeroes the frames: not under the lock */
+	for( i = 0; i < num_pages; i++ )
+	{
+		frames[i] = alloc_frame();
+		if( frames[i] == 0 )
+		{
+			while( i-- > 0 )
+				free_frame(frames[i]);
+			return -1;
+		}
+	}
+
+	spin_lock_irqsave(&shm_lock, flags);
+	/* someone may have created it in the meantime */
+	id = shm_find(key);
+	if( id == -1 )
+	{
+		for( id = 0; id < SHM_MAX_SEGMENTS && shm_segments[id].in_use; id++ );
+		if( id < SHM_MAX_SEGMENTS )
+		{
+			seg = &shm_segments[id];
+			seg->in_use = 1;
+			seg->key = key;
+			seg->owner = pcb->process_id;
+			seg->refs = 1;
+			seg->num_pages = num_pages;
+			memcpy(seg->frames, frames, sizeof(frames));
+			spin_unlock_irqrestore(&shm_lock, flags);
+			return id;
+		}
+		id = -1;
+	}
+	else if( shm_segments[id].num_pages * FOUR_KB < size )
+	{
+		id = -1;
+	}
+	spin_unlock_irqrestore(&shm_lock, flags);
+
+	for( i = 0; i < num_pages; i++ )
+		free_frame(frames[i]);
+	return id;
+}
+
+/*
+	shm_attach()
+
+	Description: maps a segment into the process's window
+	Inputs: pcb = the calling process, id = segment, addr = page aligned
+			user address in the window
+	Outputs: addr, -1 for failure (bad segment or address, the range
+			 overlaps another mapping, too many mappings)
+*/
+int32_t shm_attach(pcb_t* pcb, int32_t id, uint32_t addr)
+{
+	shm_proc_t* proc = &shm_procs[pcb->process_id];
+	shm_segment_t* seg;
+	uint32_t* pte;
+	uint32_t flags;
+	uint32_t table;
+	uint32_t i;
+	int m;
+	int32_t ret = -1;
+
+	if( id < 0 || id >= SHM_MAX_SEGMENTS || addr < SHM_ADDR || (addr & (FOUR_KB - 1)) != 0 )
+		return -1;
+
+	/* only the process itself (and its halt) touches its window */
+	if( proc->table == NULL )
+	{
+		table = alloc_frame();
+		if( table == 0 )
+			return -1;
+		proc->table = (uint32_t*)table;
+	}
+	pte = &proc->table[(addr - SHM_ADDR) / FOUR_KB];
+
+	spin_lock_irqsave(&shm_lock, flags);
+	seg = &shm_segments[id];
+	for( m = 0; m < SHM_MAX_MAPS && proc->maps[m].addr != 0; m++ );
+
+	if( seg->in_use && m < SHM_MAX_MAPS && addr - SHM_ADDR <= FOUR_MB - seg->num_pages * FOUR_KB )
+	{
+		for( i = 0; i < seg->num_pages && !(pte[i] & PAGE_PRESENT); i++ );
+		if( i == seg->num_pages )
+		{
+			for( i = 0; i < seg->num_pages; i++ )
+				pte[i] = seg->frames[i] | SHM_PTE_FLAGS;
+			seg->refs++;
+			proc->maps[m].addr = addr;
+			proc->maps[m].seg = id;
+			ret = addr;
+		}
+	}
+	spin_unlock_irqrestore(&shm_lock, flags);
+
+	if( ret != -1 )
+	{
+		user_window_attach(pcb->process_id, USER_WIN_SHM, (uint32_t)proc->table | SHM_PTE_FLAGS);
+	}
+	return ret;
+}
+
+/*
+	shm_unmap_one()
+
+	Description: takes one mapping out of a window and drops its segment
+				 reference, freeing the segment with the last one (the
+				 creator's reference keeps it alive while the creator runs)
+	Inputs: proc = the process's window, m = mapping index
+	Outputs: None
+	Side Effects: called with shm_lock held
+*/
+static void shm_unmap_one(shm_proc_t* proc, int m)
+{
+	shm_segment_t* seg = &shm_segments[proc->maps[m].seg];
+	uint32_t* pte = &proc->table[(proc->maps[m].addr - SHM_ADDR) / FOUR_KB];
+	uint32_t i;
+
+	for( i = 0; i < seg->num_pages; i++ )
+		pte[i] = 0;
+	proc->maps[m].addr = 0;
+
+	if( --seg->refs == 0 )
+		shm_free(seg);
+}
+
+/*
+	shm_detach()
+
+	Description: unmaps the segment mapped at addr
+	Inputs: pcb = the calling process, addr = address given to shm_attach()
+	Outputs: 0 for success, -1 if nothing is mapped there
+*/
+int32_t shm_detach(pcb_t* pcb, uint32_t addr)
+{
+	shm_proc_t* proc = &shm_procs[pcb->process_id];
+	uint32_t flags;
+	int m;
+
+	if( addr == 0 )
+		return -1;
+
+	spin_lock_irqsave(&shm_lock, flags);
+	for( m = 0; m < SHM_MAX_MAPS && proc->maps[m].addr != addr; m++ );
+	if( m < SHM_MAX_MAPS )
+		shm_unmap_one(proc, m);
+	spin_unlock_irqrestore(&shm_lock, flags);
+
+	if( m == SHM_MAX_MAPS )
+		return -1;
+	flush_tlb();
+	return 0;
+}
+
+/*
+	shm_release()
+
+	Description: unmaps everything a process has mapped, drops the
+				 reference it holds on the segments it created (freeing
+				 those nobody has mapped) and frees its window
+	Inputs: pid = process ID
+	Outputs: None
+*/
+void shm_release(int pid)
+{
+	shm_proc_t* proc = &shm_procs[pid];
+	uint32_t table;
+	uint32_t flags;
+	int i;
+
+	spin_lock_irqsave(&shm_lock, flags);
+	for( i = 0; i < SHM_MAX_MAPS; i++ )
+	{
+		if( proc->maps[i].addr != 0 )
+			shm_unmap_one(proc, i);
+	}
+	for( i = 0; i < SHM_MAX_SEGMENTS; i++ )
+	{
+		if( !shm_segments[i].in_use || shm_segments[i].owner != pid )
+			continue;
+		shm_segments[i].owner = -1;
+		if( --shm_segments[i].refs == 0 )
+			shm_free(&shm_segments[i]);
+	}
+	table = (uint32_t)proc->table;
+	proc->table = NULL;
+	spin_unlock_irqrestore(&shm_lock, flags);
+	user_window_set(pid, USER_WIN_SHM, 0);
+
+	if( table != 0 )
+		free_frame(table);
+}
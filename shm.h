@@ -0,0 +1,62 @@
+/*
+	shm.h
+
+	Shared memory segments. shm_create() finds or makes a segment of
+	page frames under a key; shm_map() maps it, page aligned, anywhere in
+	a process's shared memory window (the 4 MB at SHM_ADDR) and
+	shm_unmap() takes it out again. Every process that maps a segment
+	sees the same frames. The creator holds a reference of its own, so a
+	segment lives until its creator has halted and its last mapping is
+	gone.
+*/
+
+#ifndef _SHM_H
+#define _SHM_H
+
+#include "types.h"
+#include "spinlock.h"
+
+#define SHM_ADDR 			0x0C800000 	// 200 MB
+#define SHM_MAX_SEGMENTS 	8
+#define SHM_MAX_PAGES 		16 			/* 64 KB per segment */
+#define SHM_MAX_MAPS 		4 			/* mappings per process */
+
+typedef struct shm_segment_t {
+	int in_use;
+	uint32_t key;
+	int owner;              /* creating process, -1 once it has halted */
+	int refs;               /* mappings in all processes, plus the owner's */
+	uint32_t num_pages;
+	uint32_t frames[SHM_MAX_PAGES];
+} shm_segment_t;
+
+/* one segment mapped into a process */
+typedef struct shm_mapping_t {
+	uint32_t addr;          /* 0 if unused */
+	int seg;                /* index into shm_segments */
+} shm_mapping_t;
+
+/* kernel side of a process's window */
+typedef struct shm_proc_t {
+	uint32_t* table;        /* page table of the window, NULL until the first map */
+	shm_mapping_t maps[SHM_MAX_MAPS];
+} shm_proc_t;
+
+extern shm_segment_t shm_segments[];
+/* indexed by process ID */
+extern shm_proc_t shm_procs[];
+/* protects the segments and every process's mappings */
+extern spinlock_t shm_lock;
+
+struct pcb_t;
+
+/* finds the segment with a key or creates it; outputs its ID or -1 */
+int32_t shm_get(struct pcb_t* pcb, uint32_t key, uint32_t size);
+/* maps segment id at addr (shm_map); outputs addr or -1 */
+int32_t shm_attach(struct pcb_t* pcb, int32_t id, uint32_t addr);
+/* takes out the mapping at addr (shm_unmap) */
+int32_t shm_detach(struct pcb_t* pcb, uint32_t addr);
+/* drops all of a process's mappings and its creator references (halt) */
+void shm_release(int pid);
+
+#endif
@@ -0,0 +1,342 @@
+/*
+	smp.c
+
+	Starts the application processors (APs) listed in the MADT with the
+	INIT / startup IPI sequence. Each AP gets its own TSS (in the shared
+	GDT), its own idle stack and its own copy of the page directory, since
+	the 128 MB program mapping is different on every CPU. Once online an
+	AP runs the scheduler from its local APIC timer; terminals move to it
+	from busier CPUs' run queues (see scheduler.c).
+
+	Kernel mappings that every CPU sees go through set_pde_all(), and any
+	change to a shared mapping is followed by smp_flush_tlb(), which has
+	the other CPUs flush their TLBs with an IPI and waits until each has
+	acknowledged the shootdown's generation (cpu_t.tlb_seen), so that on
+	return no CPU can still reach the old mapping.
+*/
+
+#include "smp.h"
+#include "lib.h"
+#include "paging.h"
+#include "scheduler.h"
+
+/* the boot CPU runs terminal 0's first shell */
+cpu_t cpus[APIC_MAX_CPUS] = {
+	{ 1, 0, 0, 0, KERNEL_TSS, &tss, page_directory, MB8, 0, 0 }
+};
+uint32_t num_cpus_online = 1;
+spinlock_t run_queue_lock = SPINLOCK_INIT("run_queue");
+spinlock_t tlb_lock = SPINLOCK_INIT("tlb");
+/* generation of the latest TLB shootdown, under tlb_lock */
+static volatile uint32_t tlb_gen;
+uint8_t cpu_index[256];
+int smp_enabled;
+
+static tss_t ap_tss[APIC_MAX_CPUS];
+/* local APIC timer count for one PIT tick */
+static uint32_t lapic_timer_count;
+
+/*
+	smp_delay()
+
+	Description: waits for the PIT to tick a number of times (interrupts
+				 must be on)
+*/
+static void smp_delay(uint32_t ticks)
+{
+	uint32_t start = pit_ticks;
+
+	while( pit_ticks - start < ticks )
+		cpu_relax();
+}
+
+/*
+	lapic_ipi()
+
+	Description: sends an interprocessor interrupt
+	Inputs: apic_id = destination, icr = delivery mode / vector / shorthand
+*/
+static void lapic_ipi(uint32_t apic_id, uint32_t icr)
+{
+	while( lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING )
+		cpu_relax();
+	lapic_write(LAPIC_ICR_HIGH, apic_id << ICR_DEST_SHIFT);
+	lapic_write(LAPIC_ICR_LOW, icr);
+}
+
+/*
+	lapic_timer_calibrate()
+
+	Description: counts local APIC timer decrements over a few PIT ticks
+	Outputs: timer count for one PIT tick
+*/
+static uint32_t lapic_timer_calibrate()
+{
+	uint32_t start;
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_LVT_MASKED);
+
+	/* start on a tick boundary */
+	start = pit_ticks;
+	while( pit_ticks == start )
+		cpu_relax();
+
+	lapic_write(LAPIC_TIMER_INIT, 0xFFFFFFFF);
+	smp_delay(SMP_CALIBRATE_TICKS);
+	start = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+	lapic_write(LAPIC_TIMER_INIT, 0);
+
+	return start / SMP_CALIBRATE_TICKS;
+}
+
+/*
+	smp_setup_tss()
+
+	Description: fills in an AP's TSS and its GDT descriptor
+	Inputs: n = CPU index (1 and up)
+*/
+static void smp_setup_tss(uint32_t n)
+{
+	seg_desc_t desc = tss_desc_ptr;
+
+	/* the boot CPU's descriptor is marked busy by now */
+	desc.type = 0x9;
+	SET_TSS_PARAMS(desc, &ap_tss[n], tss_size);
+	ap_tss_desc_ptr[n - 1] = desc;
+
+	memset(&ap_tss[n], 0, sizeof(tss_t));
+	ap_tss[n].ldt_segment_selector = KERNEL_LDT;
+	ap_tss[n].ss0 = KERNEL_DS;
+	ap_tss[n].esp0 = cpus[n].idle_stack;
+}
+
+/*
+	smp_boot_ap()
+
+	Description: sets up per-CPU state for an AP and starts it
+	Inputs: n = CPU index to give it, apic_id = its local APIC ID
+	Outputs: 0 once it is online, -1 if it never came up
+*/
+static int32_t smp_boot_ap(uint32_t n, uint32_t apic_id)
+{
+	cpu_t* cpu = &cpus[n];
+	uint32_t dir = alloc_frame();
+	uint32_t stack = alloc_frames(AP_STACK_FRAMES);
+	uint32_t start;
+
+	if( dir == 0 || stack == 0 )
+	{
+		if( dir != 0 )
+			free_frame(dir);
+		if( stack != 0 )
+			free_frames(stack, AP_STACK_FRAMES);
+		return -1;
+	}
+
+	memcpy((void*)dir, page_directory, FOUR_KB);
+	cpu->apic_id = apic_id;
+	cpu->curr_term = -1;
+	cpu->run_queue = 0;
+	cpu->tss_selector = AP_TSS(n);
+	cpu->tss = &ap_tss[n];
+	cpu->page_directory = (uint32_t*)dir;
+	cpu->idle_stack = stack + (AP_STACK_FRAMES * FOUR_KB);
+	cpu_index[apic_id] = n;
+	smp_setup_tss(n);
+
+	ap_boot_cr3 = dir;
+	ap_boot_stack = cpu->idle_stack;
+
+	/* INIT, then startup IPIs pointing at the trampoline page */
+	lapic_ipi(apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+	smp_delay(1);
+	lapic_ipi(apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> PAGE_SHIFT));
+	smp_delay(1);
+	if( !cpu->online )
+		lapic_ipi(apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_ADDR >> PAGE_SHIFT));
+
+	start = pit_ticks;
+	while( !cpu->online && pit_ticks - start < SMP_BOOT_TIMEOUT )
+		cpu_relax();
+
+	if( !cpu->online )
+	{
+		cpu_index[apic_id] = 0;
+		cpu->page_directory = NULL;
+		free_frame(dir);
+		free_frames(stack, AP_STACK_FRAMES);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	smp_init()
+
+	Description: starts every other enabled CPU in the MADT. Needs the
+				 APICs and the PIT running and interrupts on.
+	Inputs: None
+	Outputs: 0 if at least one AP came up, -1 otherwise
+	Side Effects: uses the page at SMP_TRAMPOLINE_ADDR while starting them
+*/
+int32_t smp_init()
+{
+	uint32_t bsp;
+	uint32_t i;
+	uint32_t n = 1;
+	uint32_t tramp_page = SMP_TRAMPOLINE_ADDR >> PAGE_SHIFT;
+
+	if( !apic.enabled || apic.num_cpus < 2 )
+		return -1;
+
+	bsp = lapic_id();
+	cpus[0].apic_id = bsp;
+	cpu_index[bsp] = 0;
+	lapic_timer_count = lapic_timer_calibrate();
+
+	/* the trampoline carries its own copy of the GDT pointer (real mode
+	   can't reach the kernel's) */
+	memcpy(ap_gdt_desc, &gdt_desc_ptr, 6);
+	page_table[tramp_page] |= PAGE_PRESENT;
+	flush_tlb();
+	memcpy((void*)SMP_TRAMPOLINE_ADDR, ap_trampoline, ap_trampoline_end - ap_trampoline);
+
+	smp_enabled = 1;
+	for( i = 0; i < apic.num_cpus && n <= NUM_AP_TSS; i++ )
+	{
+		if( apic.cpu_apic_ids[i] == bsp )
+			continue;
+		if( smp_boot_ap(n, apic.cpu_apic_ids[i]) == 0 )
+			n++;
+		else
+			klog(KLOG_WARN, "smp: CPU with APIC ID %u didn't start", apic.cpu_apic_ids[i]);
+	}
+
+	page_table[tramp_page] &= ~PAGE_PRESENT;
+	flush_tlb();
+
+	if( n == 1 )
+	{
+		smp_enabled = 0;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	ap_main()
+
+	Description: C entry point of an AP (from smp_boot.S, paging on, on its
+				 idle stack). Loads its TSS, enables its local APIC and
+				 timer, then idles until the scheduler gives it a terminal.
+	Inputs: None
+	Outputs: never returns
+*/
+void ap_main()
+{
+	cpu_t* cpu = this_cpu();
+
+	ltr(cpu->tss_selector);
+	lldt(KERNEL_LDT);
+	pat_init();
+	lapic_init();
+	if( sysenter_enabled )
+		sysenter_init();
+
+	lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIV_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_PERIODIC | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INIT, lapic_timer_count);
+
+	atomic_xadd(&num_cpus_online, 1);
+	cpu->online = 1;
+	klog(KLOG_INFO, "smp: CPU %u online (APIC ID %u)", (uint32_t)(cpu - cpus), cpu->apic_id);
+
+	sti();
+	while( 1 )
+		asm volatile ("hlt");
+}
+
+/*
+	smp_tlb_ack()
+
+	Description: flushes this CPU's TLB and acknowledges the current
+				 shootdown generation. The generation is read before the
+				 flush, so the flush comes after whatever change it covers.
+	Inputs: None
+	Outputs: None
+*/
+static void smp_tlb_ack()
+{
+	uint32_t gen = tlb_gen;
+
+	barrier();
+	flush_tlb();
+	this_cpu()->tlb_seen = gen;
+}
+
+/*
+	smp_tlb_poll()
+
+	Description: acknowledges a pending shootdown without waiting for its
+				 IPI, for CPUs spinning with interrupts off (spinlock.h)
+	Inputs: None
+	Outputs: None
+*/
+void smp_tlb_poll()
+{
+	if( smp_enabled && this_cpu()->tlb_seen != tlb_gen )
+		smp_tlb_ack();
+}
+
+/*
+	smp_flush_tlb()
+
+	Description: flushes this CPU's TLB and sends the others an IPI to
+				 flush theirs (after a change to a shared mapping), then
+				 waits until every other online CPU has flushed
+	Inputs: None
+	Outputs: None
+	Side Effects: may be called with interrupts off; CPUs waiting on a lock
+				  meanwhile answer through smp_tlb_poll()
+*/
+void smp_flush_tlb()
+{
+	uint8_t waiting[APIC_MAX_CPUS];
+	cpu_t* self = this_cpu();
+	uint32_t gen;
+	uint32_t i;
+
+	flush_tlb();
+	if( num_cpus_online <= 1 )
+		return;
+
+	raw_spin_lock(&tlb_lock);
+	gen = ++tlb_gen;
+	self->tlb_seen = gen;
+
+	/* a CPU coming online later loads its directory after the change */
+	for( i = 0; i < APIC_MAX_CPUS; i++ )
+		waiting[i] = cpus[i].online && &cpus[i] != self;
+
+	lapic_ipi(0, ICR_ALL_BUT_SELF | IPI_TLB_VECTOR);
+
+	for( i = 0; i < APIC_MAX_CPUS; i++ )
+	{
+		while( waiting[i] && cpus[i].tlb_seen != gen )
+			cpu_relax();
+	}
+	raw_spin_unlock(&tlb_lock);
+}
+
+/*
+	ipi_tlb_handler()
+
+	Description: handler for the TLB shootdown IPI: flushes and
+				 acknowledges the current generation
+*/
+void ipi_tlb_handler()
+{
+	smp_tlb_ack();
+	lapic_eoi();
+}
@@ -0,0 +1,89 @@
+/*
+	smp.h
+
+	Multiprocessor bring-up and per-CPU state
+*/
+
+#ifndef _SMP_H
+#define _SMP_H
+
+#include "types.h"
+#include "x86_desc.h"
+#include "apic.h"
+#include "spinlock.h"
+
+/* real mode startup code for the application processors is copied here */
+#define SMP_TRAMPOLINE_ADDR 	0x8000
+#define AP_STACK_FRAMES 		2 		/* 8 KB idle stack per AP */
+
+/* interrupt command register */
+#define ICR_INIT 				0x00500
+#define ICR_STARTUP 			0x00600
+#define ICR_DELIVERY_PENDING 	0x01000
+#define ICR_LEVEL_ASSERT 		0x04000
+#define ICR_ALL_BUT_SELF 		0xC0000
+#define ICR_DEST_SHIFT 			24
+
+/* local APIC timer, used for scheduling on the APs */
+#define LAPIC_TIMER_PERIODIC 	0x20000
+#define LAPIC_TIMER_DIV_16 		0x3
+#define LAPIC_TIMER_VECTOR 		0xF0
+#define SMP_CALIBRATE_TICKS 	4 		/* PIT ticks to measure the APIC timer over */
+
+/* TLB shootdown IPI */
+#define IPI_TLB_VECTOR 			0xF1
+
+#define SMP_BOOT_TIMEOUT 		8 		/* PIT ticks to wait for an AP */
+
+typedef struct cpu_t {
+	int online;                 /* 1 once the CPU runs the scheduler */
+	uint32_t apic_id;
+	int curr_term;              /* terminal whose process this CPU runs, -1 while idle */
+	uint32_t run_queue;         /* bit n set: terminal n is scheduled on this CPU */
+	uint16_t tss_selector;
+	tss_t* tss;
+	uint32_t* page_directory;   /* the program mapping differs per CPU */
+	uint32_t idle_stack;        /* top of the stack the CPU booted on */
+	volatile uint32_t ticks;    /* timer interrupts taken */
+	uint32_t migrations;        /* terminals this CPU took from another */
+	volatile int preempt_count; /* > 0: the running task may not be switched out */
+	volatile int need_resched;  /* a tick came while preempt_count was raised */
+	uint64_t resched_tsc;       /* when need_resched was set */
+	volatile uint32_t tlb_seen; /* last TLB shootdown generation this CPU flushed for */
+} cpu_t;
+
+extern cpu_t cpus[APIC_MAX_CPUS];
+extern uint32_t num_cpus_online;
+/* protects every CPU's run_queue and curr_term */
+extern spinlock_t run_queue_lock;
+/* one TLB shootdown at a time */
+extern spinlock_t tlb_lock;
+/* local APIC ID -> index into cpus[] */
+extern uint8_t cpu_index[256];
+/* set once a second CPU is online; until then every path is CPU 0 */
+extern int smp_enabled;
+
+/* the running CPU */
+static inline cpu_t* this_cpu() {
+    if (!smp_enabled)
+        return &cpus[0];
+    return &cpus[cpu_index[lapic_id()]];
+}
+
+/* starts the other CPUs listed in the MADT */
+int32_t smp_init();
+/* C entry point of an application processor */
+void ap_main();
+/* flushes this CPU's TLB and waits until the others have flushed theirs */
+void smp_flush_tlb();
+/* handler for the TLB shootdown IPI */
+void ipi_tlb_handler();
+
+/* startup code in smp_boot.S */
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_gdt_desc[];
+extern uint32_t ap_boot_cr3;
+extern uint32_t ap_boot_stack;
+
+#endif
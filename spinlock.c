@@ -0,0 +1,57 @@
+/*
+	spinlock.c
+
+	Lock statistics. Every subsystem lock is listed in lock_registry so
+	spinlock_report() can show where CPUs wait on each other.
+*/
+
+#include "spinlock.h"
+#include "klog.h"
+#include "smp.h"
+#include "paging.h"
+#include "terminal.h"
+#include "system_calls.h"
+#include "rtc.h"
+#include "ioring.h"
+#include "pipe.h"
+#include "ipc.h"
+#include "shm.h"
+#include "serial.h"
+#include "mouse.h"
+
+static spinlock_t* lock_registry[] = {
+	&run_queue_lock,
+	&tlb_lock,
+	&terminal_lock,
+	&process_lock,
+	&paging_lock,
+	&rtc_lock,
+	&ioring_lock,
+	&pipe_lock,
+	&ipc_lock,
+	&shm_lock,
+	&serial_lock,
+	&mouse_lock
+};
+
+/*
+	spinlock_report()
+
+	Description: logs acquisitions, contended acquisitions and the total
+				 wait (in units of 1024 TSC cycles) of every registered lock
+				 (all zero without LOCK_STATS)
+	Inputs: None
+	Outputs: None
+*/
+void spinlock_report()
+{
+	spinlock_t* lock;
+	uint32_t i;
+
+	for( i = 0; i < sizeof(lock_registry) / sizeof(lock_registry[0]); i++ )
+	{
+		lock = lock_registry[i];
+		klog(KLOG_INFO, "lock %s: %u taken, %u contended, %uK cycles waiting",
+			 lock->name, lock->acquired, lock->contended, (uint32_t)(lock->wait_cycles >> 10));
+	}
+}
@@ -0,0 +1,154 @@
+/*
+	spinlock.h
+
+	Spinlocks for data shared between processors. The _irqsave variants
+	also disable interrupts on the local CPU, for data an interrupt handler
+	takes the same lock for. cli() alone only keeps the local CPU out.
+
+	With LOCK_STATS each lock counts how often it was taken, how often it
+	had to wait and the TSC cycles spent waiting; spinlock_report() logs
+	the counters of the locks in lock_registry.
+
+	A held lock also keeps the holder from being preempted (preempt.h).
+	The raw_ variants leave the preempt count alone, for the scheduler,
+	which hands its lock over across a task switch.
+
+	A CPU spinning on a lock may have interrupts off, so it answers TLB
+	shootdowns itself while it waits (smp_tlb_poll()); otherwise a lock
+	holder waiting in smp_flush_tlb() could wait on it forever.
+*/
+
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "lib.h"
+#include "preempt.h"
+
+/* build with -DLOCK_STATS=0 to leave the counters out of the fast path */
+#ifndef LOCK_STATS
+#define LOCK_STATS 	1
+#endif
+
+typedef struct spinlock_t {
+	volatile uint32_t locked;
+	int8_t* name;
+	uint32_t acquired;      /* times taken */
+	uint32_t contended;     /* times it was already held */
+	uint64_t wait_cycles;   /* TSC cycles spent spinning */
+} spinlock_t;
+
+#define SPINLOCK_INIT(name) 	{ 0, name, 0, 0, 0 }
+
+/* flushes this CPU's TLB if a shootdown is waiting for it (smp.c) */
+void smp_tlb_poll();
+
+/* spins until the lock is ours (test and test-and-set) */
+static inline void raw_spin_lock(spinlock_t* lock) {
+#if LOCK_STATS
+    uint64_t start;
+#endif
+
+    if (atomic_xchg(&lock->locked, 1) != 0) {
+#if LOCK_STATS
+        start = rdtsc();
+#endif
+        do {
+            while (lock->locked) {
+                smp_tlb_poll();
+                cpu_relax();
+            }
+        } while (atomic_xchg(&lock->locked, 1) != 0);
+#if LOCK_STATS
+        lock->contended++;
+        lock->wait_cycles += rdtsc() - start;
+#endif
+    }
+#if LOCK_STATS
+    lock->acquired++;
+#endif
+}
+
+/* 1 if the lock was taken, 0 if someone else holds it */
+static inline int raw_spin_trylock(spinlock_t* lock) {
+    if (atomic_xchg(&lock->locked, 1) != 0)
+        return 0;
+#if LOCK_STATS
+    lock->acquired++;
+#endif
+    return 1;
+}
+
+static inline void raw_spin_unlock(spinlock_t* lock) {
+    barrier();
+    lock->locked = 0;
+}
+
+static inline void spin_lock(spinlock_t* lock) {
+    preempt_disable();
+    raw_spin_lock(lock);
+}
+
+static inline int spin_trylock(spinlock_t* lock) {
+    preempt_disable();
+    if (raw_spin_trylock(lock))
+        return 1;
+    preempt_enable();
+    return 0;
+}
+
+static inline void spin_unlock(spinlock_t* lock) {
+    raw_spin_unlock(lock);
+    preempt_enable();
+}
+
+/* takes the lock with local interrupts off; flags keeps the old EFLAGS */
+#define spin_lock_irqsave(lock, flags)      \
+do {                                        \
+    cli_and_save(flags);                    \
+    spin_lock(lock);                        \
+} while (0)
+
+#define spin_unlock_irqrestore(lock, flags) \
+do {                                        \
+    spin_unlock(lock);                      \
+    restore_flags(flags);                   \
+} while (0)
+
+/*
+	Sequence counter for data with a single writer: readers never block,
+	they retry if the count was odd (write in progress) or changed while
+	they read.
+*/
+typedef struct seqcount_t {
+	volatile uint32_t seq;
+} seqcount_t;
+
+static inline void write_seqcount_begin(seqcount_t* s) {
+    s->seq++;
+    barrier();
+}
+
+static inline void write_seqcount_end(seqcount_t* s) {
+    barrier();
+    s->seq++;
+}
+
+static inline uint32_t read_seqcount_begin(seqcount_t* s) {
+    uint32_t seq;
+
+    while ((seq = s->seq) & 1)
+        cpu_relax();
+    barrier();
+    return seq;
+}
+
+/* nonzero if the data read since read_seqcount_begin() may be torn */
+static inline int read_seqcount_retry(seqcount_t* s, uint32_t seq) {
+    barrier();
+    return s->seq != seq;
+}
+
+/* logs every registered lock's counters */
+void spinlock_report();
+
+#endif
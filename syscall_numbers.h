@@ -0,0 +1,48 @@
+/*
+	syscall_numbers.h
+
+	System call numbers (EAX for int 0x80 and SYSENTER). Shared by the C
+	code and int_handler.S, whose jumptable must list the handlers in
+	this order.
+*/
+
+#ifndef _SYSCALL_NUMBERS_H
+#define _SYSCALL_NUMBERS_H
+
+#define SYS_HALT                 1
+#define SYS_EXECUTE              2
+#define SYS_READ                 3
+#define SYS_WRITE                4
+#define SYS_OPEN                 5
+#define SYS_CLOSE                6
+#define SYS_GETARGS              7
+#define SYS_VIDMAP               8
+#define SYS_SET_HANDLER          9
+#define SYS_SIGRETURN            10
+#define SYS_FBMAP                11
+#define SYS_FBFLIP               12
+#define SYS_DMESG                13
+#define SYS_SYSCALL_BATCH        14
+#define SYS_IO_SETUP             15
+#define SYS_IO_ENTER             16
+#define SYS_POLL                 17
+#define SYS_PIPE                 18
+#define SYS_MSG_SETUP            19
+#define SYS_MSG_SEND             20
+#define SYS_MSG_RECV             21
+#define SYS_SHM_CREATE           22
+#define SYS_SHM_MAP              23
+#define SYS_SHM_UNMAP            24
+#define SYS_SENDFILE             25       // 4th argument in ESI
+#define SYS_LSEEK                26
+#define SYS_PREAD                27       // 4th argument in ESI
+#define SYS_READV                28
+#define SYS_WRITEV               29
+#define SYS_GETDENTS             30
+#define SYS_MMAP                 31
+#define SYS_MUNMAP               32
+
+/* highest valid number; numbers run 1 - NUM_SYSCALLS */
+#define NUM_SYSCALLS             SYS_MUNMAP
+
+#endif
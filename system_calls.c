@@ -10,11 +10,13 @@
 
 /* bitmap array which tells if a process id (the array index) is free or not */
 int processes[MAX_NUM_PROCS] = {0, 0, 0, 0, 0, 0};
+int sysenter_enabled;
+spinlock_t process_lock = SPINLOCK_INIT("process");
 
 /*
 	File Operations Tables
 
-	These 5 tables specify which read/write/open/close is to
+	These tables specify which read/write/open/close is to
 	be used with the respective prototype, depending on the
 	file type it is associated with:
 
@@ -23,18 +25,47 @@ int processes[MAX_NUM_PROCS] = {0, 0, 0, 0, 0, 0};
 	3) rtc file type
 	4) directory file type
 	5) other file
+	6) the mouse device
+	7) the two ends of a pipe (opened by pipe(), not open())
 */
-file_op stdin_fops = {terminal_read, failure, terminal_open, terminal_close};
+file_op stdin_fops = {terminal_read, failure, terminal_open, terminal_close, terminal_poll,
+					  default_readv, failure};
 
-file_op stdout_fops = {failure, terminal_write, terminal_open, terminal_close};
+file_op stdout_fops = {failure, terminal_write, terminal_open, terminal_close, terminal_poll,
+					   failure, terminal_writev};
 
-file_op rtc_fops = {rtc_read, rtc_write, rtc_open, rtc_close};
+file_op rtc_fops = {rtc_read, rtc_write, rtc_open, rtc_close, rtc_poll,
+					default_readv, default_writev};
 
-file_op dir_fops = {directory_read, directory_write, directory_open, directory_close};
+file_op dir_fops = {directory_read, directory_write, directory_open, directory_close, file_poll,
+					default_readv, default_writev};
 
-file_op file_fops = {file_read, file_write, file_open, file_close};
+file_op file_fops = {file_read, file_write, file_open, file_close, file_poll,
+					 default_readv, default_writev};
 
-file_op fail_fops = {failure, failure, failure, failure};
+file_op fail_fops = {failure, failure, failure, failure, failure, failure, failure};
+
+file_op mouse_fops = {mouse_read, failure, mouse_open, mouse_close, mouse_poll,
+					  default_readv, failure};
+
+file_op pipe_read_fops = {pipe_read, failure, failure, pipe_read_close, pipe_read_poll,
+						  default_readv, failure};
+
+file_op pipe_write_fops = {failure, pipe_write, failure, pipe_write_close, pipe_write_poll,
+						   failure, default_writev};
+
+/*
+	Devices that have no file system entry and are opened by name
+*/
+typedef struct device_t {
+	int8_t* name;
+	file_op* fops;
+} device_t;
+
+static device_t devices[] = {
+	{ "mouse", &mouse_fops }
+};
+#define NUM_DEVICES (sizeof(devices) / sizeof(device_t))
 
 /*
 	failure()
@@ -51,6 +82,82 @@ int32_t failure()
 	return -1;
 }
 
+/*
+	iov_read_each()
+
+	Description: reads into several buffers with one read() per buffer,
+				 stopping early after a short read
+	Inputs: ops = the file's operations, fd, iov / iovcnt = the buffers
+	Outputs: total bytes read, -1 if the first read failed
+*/
+int32_t iov_read_each(const file_op* ops, int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	int32_t total = 0;
+	int32_t n;
+	int32_t i;
+
+	for( i = 0; i < iovcnt; i++ )
+	{
+		n = ops->read(fd, iov[i].base, iov[i].len);
+		if( n < 0 )
+			return (total != 0) ? total : -1;
+		total += n;
+		if( n < iov[i].len )
+			break;
+	}
+	return total;
+}
+
+/*
+	iov_write_each()
+
+	Description: writes several buffers with one write() per buffer,
+				 stopping early after a short write
+	Inputs: ops = the file's operations, fd, iov / iovcnt = the buffers
+	Outputs: total bytes written, -1 if the first write failed
+*/
+int32_t iov_write_each(const file_op* ops, int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	int32_t total = 0;
+	int32_t n;
+	int32_t i;
+
+	for( i = 0; i < iovcnt; i++ )
+	{
+		n = ops->write(fd, iov[i].base, iov[i].len);
+		if( n < 0 )
+			return (total != 0) ? total : -1;
+		total += n;
+		if( n < iov[i].len )
+			break;
+	}
+	return total;
+}
+
+/*
+	default_readv()
+
+	Description: readv hook of files with no vectored read of their own
+	Inputs: fd, iov, iovcnt
+	Outputs: see iov_read_each()
+*/
+int32_t default_readv(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	return iov_read_each(&get_PCB_from_stack()->fd_array[fd].f_op, fd, iov, iovcnt);
+}
+
+/*
+	default_writev()
+
+	Description: writev hook of files with no vectored write of their own
+	Inputs: fd, iov, iovcnt
+	Outputs: see iov_write_each()
+*/
+int32_t default_writev(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	return iov_write_each(&get_PCB_from_stack()->fd_array[fd].f_op, fd, iov, iovcnt);
+}
+
 /*
 	check_exec()
 
@@ -118,6 +225,9 @@ int find_free_process()
 {
 	int ret = -1;
 	int i;
+	uint32_t flags;
+
+	spin_lock_irqsave(&process_lock, flags);
 	for( i = 0; i < MAX_NUM_PROCS; i++ )
 	{
 		/* check each index until a free one is found */
@@ -128,10 +238,31 @@ int find_free_process()
 				break;
 		}
 	}
+	spin_unlock_irqrestore(&process_lock, flags);
 
 	return ret;
 }
 
+/*
+	execute_abort()
+
+	Description: undoes execute() after a failed image load: frees the
+				 process ID and maps the caller's image back at 128 MB
+				 (the parent, or the process a terminal switch interrupted)
+	Inputs: process = process ID the load was for
+	Outputs: None
+*/
+static void execute_abort(int process)
+{
+	/* the caller's PCB, not curr_idx: the task may have changed CPUs */
+	pcb_t* caller = get_PCB_from_stack();
+
+	processes[process] = FREE;
+	if( caller->process_id >= 0 && caller->process_id < MAX_NUM_PROCS &&
+		processes[caller->process_id] == BUSY )
+		map_task(MB128, MB8 + (caller->process_id * MB4));
+}
+
 /*
 	execute()
 
@@ -154,15 +285,13 @@ int32_t execute(const uint8_t* command)
 	uint32_t point_of_entry = 0;																					// actual address of executable's first instruction
 	int done_parsing = 0;																									// flag if we end parsing early
 
-	cli();
-
 	/* if this Terminal is launched for first time, take appropriate actions */
 	if( terminals[visible_terminal].has_been_launched == 0 )
 	{
 			terminals[visible_terminal].has_been_launched = 1;
 			/* set curr_idx (scheduling) to the new terminal */
 			restore_curr_idx = curr_idx;
-			curr_idx = visible_terminal;
+			sched_add_terminal(visible_terminal);
 	}
 
 
@@ -269,10 +398,11 @@ int32_t execute(const uint8_t* command)
 	/* local process ID variable */
 	int process = find_free_process();
 
-	/* check if we can support another process */
+	/* check if we can support another process (logged, a terminal switch
+	   runs this from the keyboard handler) */
 	if( process == -1 )
 	{
-		printf("Max number of processes reached.\n");
+		klog(KLOG_WARN, "Max number of processes reached.");
 		return 0;
 	}
 
@@ -282,6 +412,10 @@ int32_t execute(const uint8_t* command)
 
 	*/
 
+	/* the image is loaded with interrupts on: if the parent is preempted
+	   meanwhile, sched_tick() saves this mapping with it and the scheduler
+	   puts it back on whichever CPU resumes the load */
+
 	/* set the mapping from virtual to physical memory FOR THIS PARTICULAR PROCESS */
 	map_task(MB128, MB8 + (process * MB4));
 
@@ -294,17 +428,21 @@ int32_t execute(const uint8_t* command)
 	/* read from the filesystem and copy the program image into physical memory */
 	if( read_data(prog_img.inode, 0, (uint8_t*)PROG_IMG_ADDR, MB4) == -1 )
 	{
-		processes[process] = FREE;
+		execute_abort(process);
 		return -1;
 	}
 
 	/* Determine entry point (4 bytes) into the file */
 	if( read_data(prog_img.inode, FILE_ENTRY_OFFSET, entry_point, FOUR_BYTES) == -1 )
 	{
-		processes[process] = FREE;
+		execute_abort(process);
 		return -1;
 	}
 
+	/* from here on the terminal's process changes; nothing may be
+	   scheduled until the new process runs */
+	cli();
+
 	/* set up the 32-bit address of the first instruction in the program image */
 	point_of_entry = (entry_point[BYTE3] << SHIFT_24) + (entry_point[BYTE2] << SHIFT_16) + (entry_point[BYTE1] << SHIFT_8) + entry_point[BYTE0];
 
@@ -318,7 +456,8 @@ int32_t execute(const uint8_t* command)
 	// create a PCB for the current process
 	pcb_t* current_pcb = (pcb_t *)(MB8 - (KB8 * (process + 1)));
 	current_pcb->process_id = process;
-	current_pcb->terminal_number = visible_terminal;
+	/* the terminal this CPU is running (the visible one for a new base shell) */
+	current_pcb->terminal_number = curr_idx;
 
 	// if this is the very first process (per terminal)
 	if( terminals[current_pcb->terminal_number].current_process == -1 ) {
@@ -359,6 +498,7 @@ int32_t execute(const uint8_t* command)
 		}
 		current_pcb->fd_array[i].file_position = FILE_POS_EMPTY_FD;
 		current_pcb->fd_array[i].inode_num = FAIL_INODE_NUM;
+		current_pcb->fd_array[i].private_data = NULL;
 
 	}
 
@@ -368,9 +508,13 @@ int32_t execute(const uint8_t* command)
 
 	*/
 
+	/* the new process has no windows yet (see paging.h) */
+	user_windows_map(current_pcb->process_id);
+	flush_tlb();
+
 	/* set up the Task State Segment */
-	tss.ss0 = KERNEL_DS;																		// Kernel Data Segment
-	tss.esp0 = (MB8 - (KB8 * current_pcb->process_id) - 4);	// bottom of this process' kernel stack
+	this_cpu()->tss->ss0 = KERNEL_DS;											// Kernel Data Segment
+	this_cpu()->tss->esp0 = (MB8 - (KB8 * current_pcb->process_id) - 4);	// bottom of this process' kernel stack
 
 	/*
 		set up IRET context (artificial stack) and call IRET
@@ -427,11 +571,18 @@ int32_t execute(const uint8_t* command)
 */
 int32_t halt(uint8_t status)
 {
-	cli();
-
 	/* get the current process's PCB */
 	pcb_t * current_pcb = get_PCB_from_stack();
 
+	/* its I/O ring and any requests still pending on it go away */
+	ioring_release(current_pcb->process_id);
+	/* and so do its mailbox and message window */
+	ipc_release(current_pcb->process_id);
+	/* and its shared memory mappings */
+	shm_release(current_pcb->process_id);
+	/* and its file mappings */
+	mmap_release(current_pcb->process_id);
+
 	/* if this is the base shell, reset and execute shell again */
 	if( current_pcb->parent == NULL )
 	{
@@ -439,7 +590,6 @@ int32_t halt(uint8_t status)
 		terminals[current_pcb->terminal_number].current_process = -1;
 		clear_screen(current_pcb->terminal_number);
 		current_pcb->terminal_number = -1;
-		sti();
 		execute((uint8_t*)"shell");
 	}
 
@@ -460,11 +610,18 @@ int32_t halt(uint8_t status)
 			close(i);
 	}
 
+	/* give up the framebuffer if this process had it mapped */
+	vbe_release(current_pcb->process_id);
+
+	/* from here on this CPU's mapping and TSS are the parent's */
+	cli();
+
 	/*
 
 		Restore Parent Paging (Mapping)
 
 	*/
+	user_windows_map(current_pcb->parent->process_id);
 	map_task(MB128, (MB8 + (current_pcb->parent->process_id * MB4)));
 
 	/*
@@ -478,7 +635,7 @@ int32_t halt(uint8_t status)
 	/* set esp back to the parent process */
 	//tss.ss0 = KERNEL_DS;
 	/* THIS FIXED THE STACK OVERFLOW BUG */
-	tss.esp0 = MB8 - (KB8 * current_pcb->parent->process_id) - 4; // = current_pcb->parent_esp
+	this_cpu()->tss->esp0 = MB8 - (KB8 * current_pcb->parent->process_id) - 4; // = current_pcb->parent_esp
 	processes[current_pcb->process_id] = FREE;
 	current_pcb->terminal_number = -1;
 
@@ -606,35 +763,60 @@ int32_t open(const uint8_t* filename)
 	if(fd == TEMP_VALUE)
 		return -1;
 
-	if(read_dentry_by_name(filename, &dentry) == -1)
-		return -1;
+	int32_t ret;
+	uint32_t d;
 
-	switch(dentry.filetype)
+	/* devices first, then the file system */
+	for( d = 0; d < NUM_DEVICES; d++ )
 	{
-		case RTC_DENTRY_VAL:
-			pcb->fd_array[fd].f_op = rtc_fops;
-			pcb->fd_array[fd].inode_num = PRESET_INODE_NUM;
+		if( strncmp((int8_t*)filename, devices[d].name, strlen(devices[d].name) + 1) == 0 )
 			break;
+	}
 
-		case DIR_DENTRY_VAL:
-			pcb->fd_array[fd].f_op = dir_fops;
-			pcb->fd_array[fd].inode_num = PRESET_INODE_NUM;
-			break;
+	if( d < NUM_DEVICES )
+	{
+		pcb->fd_array[fd].f_op = *devices[d].fops;
+		pcb->fd_array[fd].inode_num = PRESET_INODE_NUM;
+	}
+	else
+	{
+		if(read_dentry_by_name(filename, &dentry) == -1)
+			return -1;
 
-		case FILE_DENTRY_VAL:
-			pcb->fd_array[fd].f_op = file_fops;
-			pcb->fd_array[fd].inode_num = dentry.inode;
-			break;
-		default:
-			//should never reach this
-			return FAILED;
+		switch(dentry.filetype)
+		{
+			case RTC_DENTRY_VAL:
+				pcb->fd_array[fd].f_op = rtc_fops;
+				pcb->fd_array[fd].inode_num = PRESET_INODE_NUM;
+				break;
+
+			case DIR_DENTRY_VAL:
+				pcb->fd_array[fd].f_op = dir_fops;
+				pcb->fd_array[fd].inode_num = PRESET_INODE_NUM;
+				break;
+
+			case FILE_DENTRY_VAL:
+				pcb->fd_array[fd].f_op = file_fops;
+				pcb->fd_array[fd].inode_num = dentry.inode;
+				break;
+			default:
+				//should never reach this
+				return FAILED;
+		}
 	}
 
 	pcb->fd_array[fd].file_position = FILE_POS_EMPTY_FD;
+	pcb->fd_array[fd].private_data = NULL;
 	pcb->fd_array[fd].flags = BUSY;
 
-	if( pcb->fd_array[fd].f_op.open(filename) == -1 )
+	/* anything but -1 from the open hook is kept as the fd's private data */
+	ret = pcb->fd_array[fd].f_op.open(filename);
+	if( ret == -1 )
+	{
+		pcb->fd_array[fd].flags = FREE;
 		return -1;
+	}
+	pcb->fd_array[fd].private_data = (void*)ret;
 
 	return fd;
 }
@@ -724,11 +906,20 @@ int32_t vidmap(uint8_t** screen_start)
 	}
 
 	pcb_t * current_pcb = get_PCB_from_stack();
+	int term_num = current_pcb->terminal_number;
 
-	uint32_t terminal_user_vid = terminals[current_pcb->terminal_number].user_vidmem_addr;
+	uint32_t terminal_user_vid = terminals[term_num].user_vidmem_addr;
+
+	/* the terminal's vidmap page table is only allocated once somebody asks for it */
+	if( terminals[term_num].vidmap_table == NULL )
+	{
+		terminals[term_num].vidmap_table = (uint32_t*)alloc_frame();
+		if( terminals[term_num].vidmap_table == NULL )
+			return -1;
+	}
 
 	/* Set up page mapping (pointing) so user can safely access video memory */
-	map_vidmem(terminal_user_vid, VIDMEM_START_ADDR);
+	map_vidmem(term_num, terminal_vid_phys(term_num));
 	*screen_start = ((uint8_t*)terminal_user_vid);
 	return terminal_user_vid;
 }
@@ -758,3 +949,701 @@ int32_t sigreturn(void)
 {
 	return -1;
 }
+
+/*
+	fbmap()
+
+	Description: Maps the linear framebuffer's back buffer into user space
+				 at FB_USER_ADDR, switching to the default VBE mode if the
+				 display is still in text mode
+	Inputs: info - user struct filled with the mapping's address and geometry
+	Outputs: FB_USER_ADDR for success, -1 for failure
+	Side Effects: the calling process owns the display until it halts
+*/
+int32_t fbmap(fb_info_t* info)
+{
+	if ((uint32_t)info < MB128 || (uint32_t)info > (MB128 + MB4 - sizeof(fb_info_t)))
+		return -1;
+
+	pcb_t * current_pcb = get_PCB_from_stack();
+
+	if( !vbe.enabled && vbe_set_mode(FB_DEFAULT_XRES, FB_DEFAULT_YRES, FB_DEFAULT_BPP) != 0 )
+		return -1;
+
+	if( vbe_map_user(current_pcb->process_id) != 0 )
+		return -1;
+
+	info->addr = (uint8_t*)FB_USER_ADDR;
+	info->xres = vbe.xres;
+	info->yres = vbe.yres;
+	info->bpp = vbe.bpp;
+	info->pitch = vbe.pitch;
+	return FB_USER_ADDR;
+}
+
+/*
+	fbflip()
+
+	Description: Presents the back buffer mapped by fbmap() by swapping the
+				 VBE Y offset; the mapping then points at the other buffer
+	Inputs: none
+	Outputs: 0 for success, -1 if the caller doesn't own the framebuffer
+	Side Effects: changes the displayed frame
+*/
+int32_t fbflip(void)
+{
+	pcb_t * current_pcb = get_PCB_from_stack();
+
+	if( vbe.owner != current_pcb->process_id )
+		return -1;
+
+	return vbe_flip();
+}
+
+/*
+	dmesg()
+
+	Description: Copies the kernel log still held in the ring, one
+				 formatted line per record, oldest first
+	Inputs: buf = user buffer, nbytes = its size
+	Outputs: number of bytes copied, -1 if buf isn't in the user page
+	Side Effects: none
+*/
+int32_t dmesg(uint8_t* buf, int32_t nbytes)
+{
+	if( nbytes < 0 || (uint32_t)buf < MB128 || (uint32_t)buf + nbytes > MB128 + MB4 )
+		return -1;
+
+	return klog_read(buf, nbytes);
+}
+
+/*
+	syscall_batch()
+
+	Description: Runs several system calls for one kernel entry. Each
+				 descriptor's call goes through the same jump table as
+				 int 0x80; its return value is stored in the descriptor.
+				 halt, execute, sigreturn and syscall_batch can't be
+				 batched (they don't return to the caller in the normal
+				 way) and fail with -1 like an unknown number.
+	Inputs: descs = user array of descriptors, count = how many,
+			flags = BATCH_STOP_ON_ERROR to stop at the first failure
+	Outputs: number of descriptors run, -1 if the array isn't in the
+			 user page or count is out of range
+	Side Effects: those of the batched calls
+*/
+int32_t syscall_batch(syscall_desc_t* descs, int32_t count, int32_t flags)
+{
+	int32_t (*call)(int32_t, int32_t, int32_t);
+	syscall_desc_t* d;
+	int32_t i;
+
+	if( count < 0 || count > SYSCALL_BATCH_MAX || (uint32_t)descs < MB128 ||
+		(uint32_t)descs - MB128 > MB4 - count * sizeof(syscall_desc_t) )
+		return -1;
+
+	for( i = 0; i < count; i++ )
+	{
+		d = &descs[i];
+		/* sendfile and pread take a fourth argument, which a descriptor doesn't have */
+		if( d->number < 1 || d->number > NUM_SYSCALLS || d->number == SYS_HALT ||
+			d->number == SYS_EXECUTE || d->number == SYS_SIGRETURN || d->number == SYS_SYSCALL_BATCH ||
+			d->number == SYS_SENDFILE || d->number == SYS_PREAD )
+		{
+			d->result = -1;
+		}
+		else
+		{
+			call = (int32_t (*)(int32_t, int32_t, int32_t))jumptable[d->number];
+			d->result = call(d->args[0], d->args[1], d->args[2]);
+		}
+
+		if( d->result < 0 && (flags & BATCH_STOP_ON_ERROR) )
+			return i + 1;
+	}
+	return count;
+}
+
+/*
+	io_setup()
+
+	Description: Gives the process an I/O ring (ioring.h) and maps it
+	Inputs: none
+	Outputs: user address of the ring, -1 for failure
+	Side Effects: allocates two frames, freed when the process halts
+*/
+int32_t io_setup(void)
+{
+	return ioring_setup(get_PCB_from_stack());
+}
+
+/*
+	io_enter()
+
+	Description: Submits requests from the process's I/O ring and waits
+				 for completions
+	Inputs: to_submit = most requests to take, min_complete = unread
+			completions to wait for
+	Outputs: number of requests taken, -1 without a ring
+	Side Effects: those of the requests that complete
+*/
+int32_t io_enter(int32_t to_submit, int32_t min_complete)
+{
+	return ioring_enter(get_PCB_from_stack(), to_submit, min_complete);
+}
+
+/*
+	msg_setup()
+
+	Description: Opens the process's mailbox and maps its message window
+	Inputs: None
+	Outputs: IPC_ADDR, -1 for failure
+*/
+int32_t msg_setup()
+{
+	return ipc_setup(get_PCB_from_stack());
+}
+
+/*
+	msg_send()
+
+	Description: Sends a message, moving its payload pages to the receiver
+	Inputs: pid = receiving process, msg = the message
+	Outputs: 0 for success, -1 for failure
+*/
+int32_t msg_send(int32_t pid, ipc_msg_t* msg)
+{
+	return ipc_send(get_PCB_from_stack(), pid, msg);
+}
+
+/*
+	msg_recv()
+
+	Description: Waits for a message and takes it
+	Inputs: msg = filled in with the message
+	Outputs: 0 for success, -1 for failure
+	Side Effects: maps the payload pages at the start of the window
+*/
+int32_t msg_recv(ipc_msg_t* msg)
+{
+	return ipc_recv(get_PCB_from_stack(), msg);
+}
+
+/*
+	shm_create()
+
+	Description: Finds or creates the shared memory segment with a key
+	Inputs: key = agreed on by the programs, size = bytes
+	Outputs: segment ID, -1 for failure
+*/
+int32_t shm_create(uint32_t key, uint32_t size)
+{
+	return shm_get(get_PCB_from_stack(), key, size);
+}
+
+/*
+	shm_map()
+
+	Description: Maps a shared memory segment into the process
+	Inputs: id = segment, addr = page aligned address in the shared
+			memory window (SHM_ADDR to SHM_ADDR + 4 MB)
+	Outputs: addr, -1 for failure
+*/
+int32_t shm_map(int32_t id, uint32_t addr)
+{
+	return shm_attach(get_PCB_from_stack(), id, addr);
+}
+
+/*
+	shm_unmap()
+
+	Description: Unmaps a shared memory segment; the last unmap frees it
+	Inputs: addr = where it was mapped
+	Outputs: 0 for success, -1 for failure
+*/
+int32_t shm_unmap(uint32_t addr)
+{
+	return shm_detach(get_PCB_from_stack(), addr);
+}
+
+/*
+	sendfile_fds()
+
+	Description: Copies part of a file to another fd without a user
+				 buffer: the destination's write is handed the file's
+				 bytes straight from the file system image, a data block
+				 at a time. A write that takes fewer bytes than it was
+				 given ends the copy, so the destination's write must
+				 return the bytes it took (terminal_write() does).
+	Inputs: pcb = the process, out_fd = destination, in_fd = a regular
+			file, offset = where to start in it (-1: its file position,
+			which is then advanced), count = most bytes to send
+	Outputs: bytes sent, -1 for failure
+*/
+int32_t sendfile_fds(pcb_t* pcb, int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count)
+{
+	fd_t* in;
+	fd_t* out;
+	uint32_t pos;
+	uint8_t* data;
+	int32_t sent = 0;
+	int32_t n, w;
+
+	if( out_fd < MIN_FD_NUM || out_fd >= FD_ARRAY_SIZE || in_fd < MIN_FD_NUM || in_fd >= FD_ARRAY_SIZE ||
+		count < 0 || offset < -1 )
+		return -1;
+	in = &pcb->fd_array[in_fd];
+	out = &pcb->fd_array[out_fd];
+	if( in->flags == FREE || out->flags == FREE || in->f_op.read != file_read )
+		return -1;
+
+	pos = (offset == -1) ? in->file_position : (uint32_t)offset;
+	while( sent < count )
+	{
+		n = read_data_span(in->inode_num, pos, &data);
+		if( n <= 0 )
+		{
+			if( n < 0 && sent == 0 )
+				return -1;
+			break;
+		}
+		if( n > count - sent )
+			n = count - sent;
+
+		w = out->f_op.write(out_fd, data, n);
+		if( w < 0 )
+		{
+			if( sent == 0 )
+				return -1;
+			break;
+		}
+		sent += w;
+		pos += w;
+		if( w < n )
+			break;
+	}
+
+	if( offset == -1 )
+		in->file_position = pos;
+	return sent;
+}
+
+/*
+	sendfile()
+
+	Description: sendfile system call, see sendfile_fds(). The fourth
+				 argument comes in ESI.
+	Inputs: out_fd, in_fd, offset (-1 for the file position), count
+	Outputs: bytes sent, -1 for failure
+*/
+int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count)
+{
+	return sendfile_fds(get_PCB_from_stack(), out_fd, in_fd, offset, count);
+}
+
+/*
+	lseek_fd()
+
+	Description: Moves an fd's file position. A file's position is a byte
+				 offset, a directory's the number of the entry the next
+				 read returns.
+	Inputs: pcb = the process, fd, offset, whence = SEEK_SET / SEEK_CUR /
+			SEEK_END
+	Outputs: the new position, -1 for failure (not a file or directory,
+			 position outside 0 to the end)
+*/
+int32_t lseek_fd(pcb_t* pcb, int32_t fd, int32_t offset, int32_t whence)
+{
+	fd_t* f;
+	int32_t end;
+	int32_t pos;
+
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE )
+		return -1;
+	f = &pcb->fd_array[fd];
+
+	if( f->f_op.read == file_read )
+		end = file_length(f->inode_num);
+	else if( f->f_op.read == directory_read )
+		end = directory_length();
+	else
+		return -1;
+
+	switch( whence )
+	{
+		case SEEK_SET:
+			pos = offset;
+			break;
+		case SEEK_CUR:
+			pos = f->file_position + offset;
+			break;
+		case SEEK_END:
+			pos = end + offset;
+			break;
+		default:
+			return -1;
+	}
+
+	if( end < 0 || pos < 0 || pos > end )
+		return -1;
+	f->file_position = pos;
+	return pos;
+}
+
+/*
+	pread_fd()
+
+	Description: Reads from a file or directory at a given position,
+				 leaving the fd's file position alone
+	Inputs: pcb = the process, fd, buf, nbytes, offset = byte offset for
+			a file, entry number for a directory
+	Outputs: what read() would have returned there, -1 for failure
+*/
+int32_t pread_fd(pcb_t* pcb, int32_t fd, void* buf, int32_t nbytes, int32_t offset)
+{
+	fd_t* f;
+
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE ||
+		buf == NULL || nbytes < 0 || offset < 0 )
+		return -1;
+	f = &pcb->fd_array[fd];
+
+	if( f->f_op.read == file_read )
+		return read_data(f->inode_num, offset, (uint8_t*)buf, nbytes);
+	if( f->f_op.read == directory_read )
+		return directory_entry(offset, buf, nbytes);
+	return -1;
+}
+
+/*
+	lseek()
+
+	Description: lseek system call, see lseek_fd()
+	Inputs: fd, offset, whence
+	Outputs: the new position, -1 for failure
+*/
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence)
+{
+	return lseek_fd(get_PCB_from_stack(), fd, offset, whence);
+}
+
+/*
+	pread()
+
+	Description: pread system call, see pread_fd(). The fourth argument
+				 comes in ESI.
+	Inputs: fd, buf, nbytes, offset
+	Outputs: bytes read, -1 for failure
+*/
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, int32_t offset)
+{
+	return pread_fd(get_PCB_from_stack(), fd, buf, nbytes, offset);
+}
+
+/*
+	getdents_fd()
+
+	Description: Fills buf with as many dirent_t records as fit, starting
+				 at a directory fd's file position, and moves the position
+				 past them
+	Inputs: pcb = the process, fd = directory, buf, nbytes = size of buf
+	Outputs: bytes used in buf, 0 at the end of the directory, -1 for
+			 failure (not a directory, buf too small for one entry)
+*/
+int32_t getdents_fd(pcb_t* pcb, int32_t fd, void* buf, int32_t nbytes)
+{
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE ||
+		buf == NULL || nbytes < 0 || pcb->fd_array[fd].f_op.read != directory_read )
+		return -1;
+	return directory_getdents(&pcb->fd_array[fd].file_position, buf, nbytes);
+}
+
+/*
+	getdents()
+
+	Description: getdents system call, see getdents_fd()
+	Inputs: fd, buf, nbytes
+	Outputs: bytes used in buf, 0 at the end, -1 for failure
+*/
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes)
+{
+	return getdents_fd(get_PCB_from_stack(), fd, buf, nbytes);
+}
+
+/*
+	mmap()
+
+	Description: Maps part of an open file read-only into the process's
+				 file mapping window, see mmap_file()
+	Inputs: fd = a file (not the directory or a device), offset = page
+			aligned byte offset, length = bytes, 0 for the rest of the file
+	Outputs: address of the mapping, -1 for failure
+*/
+int32_t mmap(int32_t fd, int32_t offset, int32_t length)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE ||
+		pcb->fd_array[fd].f_op.read != file_read || offset < 0 || length < 0 )
+		return -1;
+	return mmap_file(pcb, pcb->fd_array[fd].inode_num, offset, length);
+}
+
+/*
+	munmap()
+
+	Description: Unmaps a file mapping
+	Inputs: addr = address mmap() returned
+	Outputs: 0 for success, -1 for failure
+*/
+int32_t munmap(uint32_t addr)
+{
+	return mmap_unmap(get_PCB_from_stack(), addr);
+}
+
+/*
+	iov_copy()
+
+	Description: checks a user iovec array and copies it into the kernel,
+				 so the program can't change it while the hook uses it
+	Inputs: iov = user array, iovcnt = its length, copy = IOV_MAX entries
+	Outputs: 0 if the array is good, -1 if not
+*/
+static int32_t iov_copy(const iovec_t* iov, int32_t iovcnt, iovec_t* copy)
+{
+	int32_t i;
+
+	if( iovcnt < 0 || iovcnt > IOV_MAX || (uint32_t)iov < MB128 ||
+		(uint32_t)iov - MB128 > MB4 - iovcnt * sizeof(iovec_t) )
+		return -1;
+
+	for( i = 0; i < iovcnt; i++ )
+	{
+		copy[i] = iov[i];
+		if( copy[i].base == NULL || copy[i].len < 0 )
+			return -1;
+	}
+	return 0;
+}
+
+/*
+	readv_fd()
+
+	Description: Reads into several buffers with one call to the fd's
+				 readv hook
+	Inputs: pcb = the process, fd, iov = user iovec array, iovcnt = its
+			length (at most IOV_MAX)
+	Outputs: total bytes read, -1 for failure
+*/
+int32_t readv_fd(pcb_t* pcb, int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	iovec_t copy[IOV_MAX];
+
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE ||
+		iov_copy(iov, iovcnt, copy) != 0 )
+		return -1;
+	return pcb->fd_array[fd].f_op.readv(fd, copy, iovcnt);
+}
+
+/*
+	writev_fd()
+
+	Description: Writes several buffers with one call to the fd's writev
+				 hook (for the terminal: one lock hold and one cursor update)
+	Inputs: pcb = the process, fd, iov = user iovec array, iovcnt = its
+			length (at most IOV_MAX)
+	Outputs: total bytes written, -1 for failure
+*/
+int32_t writev_fd(pcb_t* pcb, int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	iovec_t copy[IOV_MAX];
+
+	if( fd < MIN_FD_NUM || fd >= FD_ARRAY_SIZE || pcb->fd_array[fd].flags == FREE ||
+		iov_copy(iov, iovcnt, copy) != 0 )
+		return -1;
+	return pcb->fd_array[fd].f_op.writev(fd, copy, iovcnt);
+}
+
+/*
+	readv()
+
+	Description: readv system call, see readv_fd()
+	Inputs: fd, iov, iovcnt
+	Outputs: total bytes read, -1 for failure
+*/
+int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	return readv_fd(get_PCB_from_stack(), fd, iov, iovcnt);
+}
+
+/*
+	writev()
+
+	Description: writev system call, see writev_fd()
+	Inputs: fd, iov, iovcnt
+	Outputs: total bytes written, -1 for failure
+*/
+int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	return writev_fd(get_PCB_from_stack(), fd, iov, iovcnt);
+}
+
+/*
+	pipe()
+
+	Description: Creates a pipe and opens its two ends
+	Inputs: fds = user array of two: gets the read end, then the write end
+	Outputs: 0 for success, -1 for failure (bad array, no free fds or pipes)
+	Side Effects: fills two fd entries in the PCB's fd_array
+*/
+int32_t pipe(int32_t* fds)
+{
+	pcb_t * pcb = get_PCB_from_stack();
+	int32_t ends[2];
+	pipe_t* p;
+	int i, n = 0;
+
+	if( (uint32_t)fds < MB128 || (uint32_t)fds - MB128 > MB4 - sizeof(ends) )
+		return -1;
+
+	for( i = FD_OFFSET; i < FD_ARRAY_SIZE && n < 2; i++ )
+	{
+		if( pcb->fd_array[i].flags == FREE )
+			ends[n++] = i;
+	}
+	if( n < 2 )
+		return -1;
+
+	p = pipe_create();
+	if( p == NULL )
+		return -1;
+
+	for( i = 0; i < 2; i++ )
+	{
+		pcb->fd_array[ends[i]].f_op = (i == PIPE_READ_END) ? pipe_read_fops : pipe_write_fops;
+		pcb->fd_array[ends[i]].inode_num = PRESET_INODE_NUM;
+		pcb->fd_array[ends[i]].file_position = FILE_POS_EMPTY_FD;
+		pcb->fd_array[ends[i]].private_data = p;
+		pcb->fd_array[ends[i]].flags = BUSY;
+		fds[i] = ends[i];
+	}
+	return 0;
+}
+
+/*
+	poll_scan()
+
+	Description: fills in revents for every entry of a poll() array
+	Inputs: pcb = the calling process, fds / nfds = the array
+	Outputs: number of entries with events
+*/
+static int32_t poll_scan(pcb_t* pcb, pollfd_t* fds, int32_t nfds)
+{
+	int32_t ready = 0;
+	int32_t mask;
+	int32_t i;
+
+	for( i = 0; i < nfds; i++ )
+	{
+		if( fds[i].fd < MIN_FD_NUM || fds[i].fd >= FD_ARRAY_SIZE || pcb->fd_array[fds[i].fd].flags == FREE )
+		{
+			fds[i].revents = POLLNVAL;
+		}
+		else
+		{
+			mask = pcb->fd_array[fds[i].fd].f_op.poll(pcb, fds[i].fd);
+			if( mask < 0 )
+				mask = POLLERR;
+			fds[i].revents = mask & (fds[i].events | POLLERR);
+		}
+		if( fds[i].revents != 0 )
+			ready++;
+	}
+	return ready;
+}
+
+/*
+	poll_fds()
+
+	Description: Waits until one of a process's fds is ready. While
+				 nothing is, the process sleeps: the scheduler passes its
+				 terminal over until the keyboard, RTC or mouse interrupt
+				 (or the timeout) wakes it.
+	Inputs: pcb = the process, fds = user array of pollfd_t, nfds = its
+			length, timeout = milliseconds to wait at most, -1 for no limit
+	Outputs: number of fds with events (0 on timeout), -1 for failure
+	Side Effects: fills in revents
+*/
+int32_t poll_fds(pcb_t* pcb, pollfd_t* fds, int32_t nfds, int32_t timeout)
+{
+	int term = pcb->terminal_number;
+	uint32_t deadline = 0;
+	int32_t ready;
+
+	if( nfds < 0 || nfds > POLL_MAX_FDS || (uint32_t)fds < MB128 ||
+		(uint32_t)fds - MB128 > MB4 - nfds * sizeof(pollfd_t) )
+		return -1;
+
+	/* 0 means no deadline to the scheduler */
+	if( timeout > 0 )
+	{
+		deadline = pit_ticks + (timeout + POLL_TICK_MS - 1) / POLL_TICK_MS;
+		if( deadline == 0 )
+			deadline = 1;
+	}
+
+	while( 1 )
+	{
+		ready = poll_scan(pcb, fds, nfds);
+		if( ready != 0 || timeout == 0 || (deadline != 0 && (int32_t)(pit_ticks - deadline) >= 0) )
+			return ready;
+
+		sched_sleep(term, deadline);
+		/* an event between the scan and the sleep must not be missed */
+		if( poll_scan(pcb, fds, nfds) != 0 )
+			sched_wakeup(term);
+
+		sched_wait(term);
+	}
+}
+
+/*
+	poll()
+
+	Description: poll system call, see poll_fds()
+	Inputs: fds = array of pollfd_t, nfds = its length, timeout = ms, -1 for none
+	Outputs: number of fds with events, -1 for failure
+*/
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout)
+{
+	return poll_fds(get_PCB_from_stack(), fds, nfds, timeout);
+}
+
+/*
+	sysenter_init()
+
+	Description: sets up the running CPU for SYSENTER. The stack MSR points
+				 at this CPU's tss.esp0 rather than at a stack: the entry
+				 code loads its stack from there, so whatever keeps esp0
+				 up to date (execute, halt, the scheduler) serves both
+				 ways into the kernel.
+	Inputs: None
+	Outputs: 0 for success, -1 if the CPU has no SYSENTER
+	Side Effects: writes the SYSENTER MSRs
+*/
+int32_t sysenter_init()
+{
+	uint32_t a, b, c, d;
+
+	cpuid(CPUID_FEATURES, &a, &b, &c, &d);
+	if( !(d & CPUID_EDX_SEP) )
+		return -1;
+	/* the first Pentium Pro steppings report SEP without having it */
+	if( ((a >> 8) & 0xF) == 6 && ((a >> 4) & 0xF) < 3 && (a & 0xF) < 3 )
+		return -1;
+
+	wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss->esp0);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)SYSENTER_ENTRY);
+	return 0;
+}
@@ -15,6 +15,15 @@
 #include "rtc.h"
 #include "int_handler.h"
 #include "scheduler.h"
+#include "vbe.h"
+#include "klog.h"
+#include "mouse.h"
+#include "ioring.h"
+#include "pipe.h"
+#include "ipc.h"
+#include "shm.h"
+#include "mmap.h"
+#include "syscall_numbers.h"
 
 
 #define MAX_BUFFER_LENGTH 	     1024
@@ -71,8 +80,35 @@
 #define FILE_DENTRY_VAL          2
 #define PRESET_INODE_NUM         0
 
+/*
+	syscall_batch() runs an array of these in order, storing each call's
+	return value in result. With BATCH_STOP_ON_ERROR it stops after the
+	first call that returns a negative value.
+*/
+typedef struct syscall_desc_t {
+	int32_t number;
+	int32_t args[3];
+	int32_t result;
+} syscall_desc_t;
+
+#define BATCH_STOP_ON_ERROR      0x1
+#define SYSCALL_BATCH_MAX        64       // descriptors per call
+
+/*
+	SYSENTER fast system call entry (SYSENTER_ENTRY in int_handler.S).
+	The caller passes the number and arguments as for int 0x80, plus its
+	return address in EDI and its stack pointer in EBP. ECX and EDX come
+	back clobbered (SYSEXIT takes the return ESP / EIP in them).
+*/
+#define MSR_SYSENTER_CS          0x174
+#define MSR_SYSENTER_ESP         0x175
+#define MSR_SYSENTER_EIP         0x176
+#define CPUID_EDX_SEP            (1 << 11)
+
 
 extern int processes[MAX_NUM_PROCS];
+/* process ID allocation */
+extern spinlock_t process_lock;
 
 /* basic failure function (returns -1) */
 int32_t failure();
@@ -86,6 +122,11 @@ int find_free_process();
 /* checks if executable has args but shouldn't */
 int32_t check_exec(uint8_t* cmd, int8_t* args, int n);
 
+/* 1 once the boot CPU has SYSENTER set up */
+extern int sysenter_enabled;
+/* points this CPU's SYSENTER MSRs at the kernel; -1 if there is no SYSENTER */
+int32_t sysenter_init();
+
 /*
 
 	The System Calls
@@ -101,6 +142,27 @@ int32_t getargs(uint8_t* buf, int32_t nbytes);
 int32_t vidmap(uint8_t** screen_start);
 int32_t set_handler(int32_t signum, void* handler_address);
 int32_t sigreturn(void);
+int32_t fbmap(fb_info_t* info);
+int32_t fbflip(void);
+int32_t dmesg(uint8_t* buf, int32_t nbytes);
+int32_t syscall_batch(syscall_desc_t* descs, int32_t count, int32_t flags);
+int32_t io_setup(void);
+int32_t io_enter(int32_t to_submit, int32_t min_complete);
+int32_t pipe(int32_t* fds);
+int32_t msg_setup();
+int32_t msg_send(int32_t pid, ipc_msg_t* msg);
+int32_t msg_recv(ipc_msg_t* msg);
+int32_t shm_create(uint32_t key, uint32_t size);
+int32_t shm_map(int32_t id, uint32_t addr);
+int32_t shm_unmap(uint32_t addr);
+int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count);
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence);
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, int32_t offset);
+
+/* lseek() whence */
+#define SEEK_SET                 0
+#define SEEK_CUR                 1
+#define SEEK_END                 2
 
 /*
 
@@ -111,14 +173,53 @@ int32_t sigreturn(void);
 	write, open and close system calls. Specifically,
 	it containts function pointers, so that they can
 	be mapped to the more specific calls for the different
-	file types (i.e. terminal, RTC, etc)
+	file types (i.e. terminal, RTC, etc). poll takes the
+	owning process since the I/O rings also call it from
+	interrupt handlers. readv / writev take several buffers
+	at once; default_readv / default_writev just loop over
+	read / write.
 */
+typedef struct iovec_t {
+	void* base;
+	int32_t len;
+} iovec_t;
+
+#define IOV_MAX                  16
+
+struct pcb_t;
 typedef struct file_op {
  	int32_t (*read) (int32_t fd, void* buf, int32_t nbytes);
 	int32_t (*write)(int32_t fd, const void* buf, int32_t nbytes);
 	int32_t (*open) (const uint8_t* filename);
 	int32_t (*close)(int32_t fd);
+	int32_t (*poll) (struct pcb_t* pcb, int32_t fd);   // POLLIN / POLLOUT if read / write wouldn't wait
+	int32_t (*readv) (int32_t fd, const iovec_t* iov, int32_t iovcnt);
+	int32_t (*writev)(int32_t fd, const iovec_t* iov, int32_t iovcnt);
 } file_op;
+
+/* readv / writev hooks for files without vectored I/O of their own */
+int32_t default_readv(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+int32_t default_writev(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+/* the loops behind them, for a given file_op */
+int32_t iov_read_each(const file_op* ops, int32_t fd, const iovec_t* iov, int32_t iovcnt);
+int32_t iov_write_each(const file_op* ops, int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
+/*
+	poll() waits on an array of these; revents is filled in with the
+	events (from events, plus POLLERR / POLLNVAL) that are ready
+*/
+typedef struct pollfd_t {
+	int32_t fd;
+	int16_t events;
+	int16_t revents;
+} pollfd_t;
+
+#define POLLIN                   0x01
+#define POLLOUT                  0x04
+#define POLLERR                  0x08
+#define POLLNVAL                 0x20
+#define POLL_MAX_FDS             16
+#define POLL_TICK_MS             25       // timeouts are rounded up to PIT ticks
 /*
 
 
@@ -131,6 +232,7 @@ typedef struct fd_t {
 	int32_t inode_num; 		//inode for file
 	uint32_t file_position; //where in the file we are
 	uint32_t flags;
+	void* private_data;     //per-open state returned by the open hook (devices)
 } fd_t;
 
 /*
@@ -149,7 +251,28 @@ typedef struct pcb_t {
   int terminal_number;                 // terminal number of this process (either 0,1,2)
   uint32_t esp;						             // holds the current process's esp for scheduling
 	uint32_t ebp;						             // holds the current process's ebp for scheduling
+	uint32_t prog_phys;                  // frame mapped at 128 MB when esp/ebp were saved
 	int status;
 } pcb_t;
 
+/* waits for events on several fds */
+int32_t poll(pollfd_t* fds, int32_t nfds, int32_t timeout);
+int32_t poll_fds(pcb_t* pcb, pollfd_t* fds, int32_t nfds, int32_t timeout);
+/* copies a file to another fd inside the kernel */
+int32_t sendfile_fds(pcb_t* pcb, int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count);
+/* random access to files and directories */
+int32_t lseek_fd(pcb_t* pcb, int32_t fd, int32_t offset, int32_t whence);
+int32_t pread_fd(pcb_t* pcb, int32_t fd, void* buf, int32_t nbytes, int32_t offset);
+/* packed directory entries (dirent_t in file_system.h) */
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes);
+int32_t getdents_fd(pcb_t* pcb, int32_t fd, void* buf, int32_t nbytes);
+/* read-only file mappings (mmap.h) */
+int32_t mmap(int32_t fd, int32_t offset, int32_t length);
+int32_t munmap(uint32_t addr);
+/* vectored I/O through the fd's readv / writev hook */
+int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+int32_t readv_fd(pcb_t* pcb, int32_t fd, const iovec_t* iov, int32_t iovcnt);
+int32_t writev_fd(pcb_t* pcb, int32_t fd, const iovec_t* iov, int32_t iovcnt);
+
 #endif
@@ -6,10 +6,13 @@
 
 #include "terminal.h"
 
+spinlock_t terminal_lock = SPINLOCK_INIT("terminal");
+
 /*
 	terminal_init()
 
-	Description: initializes all 3 terminal structures
+	Description: initializes the terminal structures; only Terminal 1 is
+				 created here, the others get their video page on first use
 	Inputs: None
 	Outputs: None
 	Side Effects: None
@@ -17,31 +20,18 @@
 void terminal_init()
 {
 	int i;
-	for( i = 0; i < NUM_TERMINALS; i++ )
+	for( i = 0; i < MAX_TERMINALS; i++ )
 	{
-			clear_buffer(i);
-			terminals[i].length = 0;
-			terminals[i].commit_flag = 0;
-			terminals[i].line_flag = 0;
-			terminals[i].term_write_flag = 0;
-			terminals[i].screen_x = 0;
-			terminals[i].screen_y = 0;
+			terminals[i].is_created = 0;
 			terminals[i].current_process = -1;
-      terminals[i].has_been_launched = 0;
+			terminals[i].has_been_launched = 0;
 			terminals[i].is_visible = 0;
-			terminals[i].rtc_flag = 0;
+			terminals[i].vidmem_addr = 0;
+			terminals[i].vidmap_table = NULL;
+			terminals[i].user_vidmem_addr = TERM_USER_VID(i);
 	}
-	terminals[0].vidmem_addr = TERM_1_VIDEO;
-	terminals[1].vidmem_addr = TERM_2_VIDEO;
-	terminals[2].vidmem_addr = TERM_3_VIDEO;
-
-	terminals[0].user_vidmem_addr = TERM_1_USER_VID;
-	terminals[1].user_vidmem_addr = TERM_2_USER_VID;
-	terminals[2].user_vidmem_addr = TERM_3_USER_VID;
 
-	clear_screen(0);
-	clear_screen(1);
-	clear_screen(2);
+	terminal_create(0);
 
   /* prepare for the execution of Terminal 1's shell */
   visible_terminal = 0;
@@ -50,6 +40,97 @@ void terminal_init()
   display_terminal(visible_terminal, -1);
 }
 
+/*
+	terminal_create()
+
+	Description: allocates a terminal's backing video pages (one cell per
+				 screen_cols x screen_rows position) and resets its state
+	Inputs: term_num = terminal number
+	Outputs: 0 for success (or already created), -1 for failure
+	Side Effects: takes frames from the frame pool
+*/
+int32_t terminal_create(int term_num)
+{
+	uint32_t page;
+	uint32_t num_pages = ((screen_cols * screen_rows * 2) + FOUR_KB - 1) / FOUR_KB;
+
+	if( term_num < 0 || term_num >= MAX_TERMINALS )
+		return -1;
+	if( terminals[term_num].is_created )
+		return 0;
+
+	page = alloc_frames(num_pages);
+	if( page == 0 )
+		return -1;
+
+	terminals[term_num].vidmem_addr = page;
+	terminals[term_num].length = 0;
+	terminals[term_num].commit_flag = 0;
+	terminals[term_num].line_flag = 0;
+	terminals[term_num].term_write_flag = 0;
+	terminals[term_num].screen_x = 0;
+	terminals[term_num].screen_y = 0;
+	terminals[term_num].rtc_flag = 0;
+	ansi_init(term_num);
+	clear_screen(term_num);
+	terminals[term_num].is_created = 1;
+
+	return 0;
+}
+
+/*
+	switch_terminal()
+
+	Description: handles ALT + F#: makes a terminal visible, creating it
+				 and launching its base shell the first time
+	Inputs: term_num = terminal number
+	Outputs: None
+	Side Effects: swaps video memory, may execute a shell
+*/
+void switch_terminal(int term_num)
+{
+	int prev_term = visible_terminal;
+
+	if( terminal_create(term_num) != 0 )
+		return;
+
+	visible_terminal = term_num;
+	terminals[prev_term].is_visible = 0;
+	terminals[term_num].is_visible = 1;
+	/* point the terminal's video memory page to physical video memory */
+	display_terminal(term_num, prev_term);
+	update_cursor(visible_terminal);
+	if( terminals[term_num].has_been_launched == 0 )
+	{
+		sti();
+		/* launch the terminal's base shell */
+		if( execute((uint8_t*)"shell") == 0 )
+		{
+				/* execute failed due to max processes reached, reset has_been_launched and curr_idx */
+				terminals[term_num].has_been_launched = 0;
+				sched_remove_terminal(term_num);
+				curr_idx = restore_curr_idx;
+		}
+	}
+}
+
+/*
+	terminal_vid_phys()
+
+	Description: picks the physical page behind a terminal's vidmap()
+				 mapping: VGA memory while the terminal is on a text mode
+				 screen, its own video page otherwise (hidden, or drawn by
+				 the framebuffer console)
+	Inputs: term_num = terminal number
+	Outputs: physical address to map
+*/
+uint32_t terminal_vid_phys(int term_num)
+{
+	if( terminals[term_num].is_visible && !fbcon.enabled )
+		return VIDMEM_START_ADDR;
+	return terminals[term_num].vidmem_addr;
+}
+
 /*
 	terminal_open()
 
@@ -74,6 +155,20 @@ int32_t terminal_close(int32_t fd)
 	return 0;
 }
 
+/*
+	terminal_poll()
+
+	Description: poll hook of stdin / stdout
+	Inputs: pcb = owning process, fd = file descriptor (DOES NOT USE)
+	Outputs: POLLOUT, plus POLLIN once a line has been entered
+*/
+int32_t terminal_poll(struct pcb_t* pcb, int32_t fd)
+{
+	if( terminals[pcb->terminal_number].commit_flag )
+		return POLLIN | POLLOUT;
+	return POLLOUT;
+}
+
 /*
 	terminal_read()
 
@@ -87,27 +182,26 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 	int i;
 	int32_t ret_val;
 	unsigned char* ptr = (unsigned char*)buf;
+	uint32_t flags;
 
-	cli();
 	pcb_t * pcb = get_PCB_from_stack();
 	int term_num = pcb->terminal_number;
-	sti();
 
 	/* loop until the keyboard buffer is ready */
-	while(1)
-	{
-		cli();
-		if( terminals[term_num].commit_flag )
-				break;
-		sti();
-	}
+	while( !terminals[term_num].commit_flag )
+		cpu_relax();
+
+	spin_lock_irqsave(&terminal_lock, flags);
 
 	/* reset flag */
 	terminals[term_num].commit_flag = 0;
 
 	/* Fail cases */
 	if( buf == NULL || nbytes <= 0)
+	{
+		spin_unlock_irqrestore(&terminal_lock, flags);
 		return -1;
+	}
 
 	ret_val = 0;
 	i = 0;
@@ -131,10 +225,55 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 	/* clear buffer */
 	clear_buffer(term_num);
 
+	spin_unlock_irqrestore(&terminal_lock, flags);
+
 	/* return number of bytes read */
 	return ret_val;
 }
 
+/*
+	terminal_put()
+
+	Description: prints characters, dropping terminal_lock every
+				 TERMINAL_WRITE_CHUNK characters so that a long write can be
+				 interrupted (and preempted) in between
+	Inputs: term = terminal, ptr / nbytes = characters, count = characters
+			printed since the lock was taken, flags = saved by the caller
+	Outputs: None
+	Side Effects: called with terminal_lock held
+*/
+static void terminal_put(int term, const unsigned char* ptr, int32_t nbytes, int32_t* count, uint32_t* flags)
+{
+	int32_t i;
+
+	for( i = 0; i < nbytes; i++, (*count)++ )
+	{
+		if( *count != 0 && *count % TERMINAL_WRITE_CHUNK == 0 )
+		{
+			spin_unlock_irqrestore(&terminal_lock, *flags);
+			spin_lock_irqsave(&terminal_lock, *flags);
+		}
+		putc( ptr[i], term );
+	}
+}
+
+/*
+	terminal_put_done()
+
+	Description: finishes a write: stops backspacing into the output and
+				 moves the cursor
+	Inputs: term = terminal written to
+	Outputs: None
+	Side Effects: called with terminal_lock held
+*/
+static void terminal_put_done(int term)
+{
+	/* since write() is being called, we want to prevent horizontal backspacing */
+	terminals[term].term_write_flag = terminals[term].screen_x;
+
+	update_cursor(visible_terminal);
+}
+
 /*
 	terminal_write()
 
@@ -144,29 +283,46 @@ int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes)
 */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes)
 {
-	cli();
-
 	pcb_t * current_pcb = get_PCB_from_stack();
-
-	int i = 0;
-	unsigned char* ptr = (unsigned char*)buf;
+	int32_t count = 0;
+	uint32_t flags;
 
 	/* check if buffer pointer is NULL */
-	if( buf == NULL )
+	if( buf == NULL || nbytes < 0 )
 		return -1;
 
-	/* print buffer to screen */
-	for( i = 0; i < nbytes; i++ )
-		putc( (unsigned char)(ptr[i]), current_pcb->terminal_number );
+	spin_lock_irqsave(&terminal_lock, flags);
+	terminal_put(current_pcb->terminal_number, (const unsigned char*)buf, nbytes, &count, &flags);
+	terminal_put_done(current_pcb->terminal_number);
+	spin_unlock_irqrestore(&terminal_lock, flags);
 
-	/* since write() is being called, we want to prevent horizontal backspacing */
-	terminals[current_pcb->terminal_number].term_write_flag = terminals[current_pcb->terminal_number].screen_x;
+	return nbytes;
+}
 
-	update_cursor(visible_terminal);
+/*
+	terminal_writev()
+
+	Description: writev hook of stdout: prints every buffer under one
+				 terminal_lock hold (still chunked) with one cursor update
+				 at the end, instead of one per write()
+	Inputs: fd = file descriptor, iov / iovcnt = the buffers (already
+			copied into the kernel)
+	Outputs: number of bytes written
+*/
+int32_t terminal_writev(int32_t fd, const struct iovec_t* iov, int32_t iovcnt)
+{
+	pcb_t * current_pcb = get_PCB_from_stack();
+	int32_t count = 0;
+	uint32_t flags;
+	int32_t i;
 
-	sti();
+	spin_lock_irqsave(&terminal_lock, flags);
+	for( i = 0; i < iovcnt; i++ )
+		terminal_put(current_pcb->terminal_number, (const unsigned char*)iov[i].base, iov[i].len, &count, &flags);
+	terminal_put_done(current_pcb->terminal_number);
+	spin_unlock_irqrestore(&terminal_lock, flags);
 
-	return 0;
+	return count;
 }
 
 /*
@@ -227,6 +383,14 @@ void update_cursor(int term_num)
 
     uint16_t  pos = (y * VIDEO_WIDTH + x);
 
+		/* the framebuffer console draws its own cursor (and flushes pending text) */
+		if( fbcon.enabled )
+		{
+			if( terminals[term_num].is_visible )
+				fbcon_update_cursor(x, y);
+			return;
+		}
+
 		outb(SELECT_X,VGA_PORT_1);
 	  outb((uint8_t) (pos & MASK), VGA_PORT_2);
 	  outb(SELECT_Y,VGA_PORT_1);
@@ -283,7 +447,6 @@ void clear_buffer(int term_num)
 */
 void scroll_up(int term_num)
 {
-	int i;
 	int num_bytes;
 
 	uint8_t * virt_addr = (uint8_t*)terminals[term_num].vidmem_addr;
@@ -291,25 +454,24 @@ void scroll_up(int term_num)
 	/*
 		General Note: we multiply everything
 		by 2 since we are shifting both the character
-		AND its color (though the color is always the same)
+		AND its color
 	*/
-	num_bytes = (NUM_COLS * (NUM_ROWS - 1) * 2);
+	num_bytes = (screen_cols * (screen_rows - 1) * 2);
 	/*
 		copy all data written on screen (except the
 		very top line, since that will be erased by
 		scrolling) and move it "back" one logical line
 	*/
-	memcpy(virt_addr, virt_addr + (NUM_COLS * 2), num_bytes);
+	memcpy(virt_addr, virt_addr + (screen_cols * 2), num_bytes);
+	/* move the pixels too instead of redrawing every cell */
+	if( fbcon.enabled && terminals[term_num].is_visible )
+		fbcon_scroll();
 
 	/* "erase" the bottom most line */
-	for( i = 0; i < NUM_COLS; i++ )
-	{
-	    *(uint8_t *)(virt_addr + num_bytes + (i << 1)) = ' ';
-	    *(uint8_t *)(virt_addr + num_bytes + (i << 1) + 1) = ATTRIB;
-	}
+	ansi_erase(term_num, screen_cols * (screen_rows - 1), screen_cols * screen_rows);
 	/* reset x and y coords */
 	terminals[term_num].screen_x = 0;
-	terminals[term_num].screen_y = (NUM_ROWS - 1);
+	terminals[term_num].screen_y = (screen_rows - 1);
 }
 
 /*
@@ -324,6 +486,7 @@ void scroll_up(int term_num)
 void backspace(int term_num)
 {
 	uint8_t * virt_addr = (uint8_t*)terminals[term_num].vidmem_addr;
+	int cell;
 
 	/*
 		cases:
@@ -345,7 +508,7 @@ void backspace(int term_num)
 		/* go up one line and move on the far right */
 		else
 		{
-			terminals[term_num].screen_x = (NUM_COLS - 1);
+			terminals[term_num].screen_x = (screen_cols - 1);
 			terminals[term_num].screen_y -= 1;
 		}
 	}
@@ -356,11 +519,46 @@ void backspace(int term_num)
 	}
 
 	/* update video memory */
-	*(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1)) = ' ';
-  *(uint8_t *)(virt_addr + ((NUM_COLS * terminals[term_num].screen_y + terminals[term_num].screen_x) << 1) + 1) = ATTRIB;
+	cell = screen_cols * terminals[term_num].screen_y + terminals[term_num].screen_x;
+	*(uint8_t *)(virt_addr + (cell << 1)) = ' ';
+  *(uint8_t *)(virt_addr + (cell << 1) + 1) = terminals[term_num].attrib;
+	FBCON_DIRTY(term_num, cell, cell + 1);
+	if( serial.enabled && term_num == serial.term )
+		serial_puts("\b \b");
 	return;
 }
 
+/*
+	terminal_input()
+
+	Description: handles one typed character (keyboard or serial port):
+				 echoes it, updates the line buffer and the cursor
+	Inputs: ascii = character, BACKSPACE or ENTER
+			term_num = terminal number
+	Outputs: None
+	Side Effects: may commit the line for terminal_read()
+*/
+void terminal_input(unsigned char ascii, int term_num)
+{
+	uint32_t flags;
+
+	spin_lock_irqsave(&terminal_lock, flags);
+
+	if( ascii == BACKSPACE )
+		backspace(term_num);
+
+	/* print it to the screen */
+	if( (ascii != 0 && ascii != BACKSPACE) && (terminals[term_num].length < PRINT_LENGTH || ascii == ENTER) )
+		putc(ascii, term_num);
+	/* send ascii value to buffer for handling the buffer */
+	handle_buffer(ascii, term_num);
+
+	if( terminals[term_num].is_visible )
+		update_cursor(term_num);
+
+	spin_unlock_irqrestore(&terminal_lock, flags);
+}
+
 /*
 	handle_buffer()
 
@@ -399,6 +597,7 @@ void handle_buffer(unsigned char input, int term_num)
     		terminals[term_num].io_buffer[len] = ENTER;
     		/* terminal read is ready to process the buffer */
     		terminals[term_num].commit_flag = 1;
+    		sched_wakeup(term_num);
     		//clear_buffer();
     		return;
     	}
@@ -12,12 +12,20 @@
 #include "lib.h"
 #include "keyboard.h"
 #include "system_calls.h"
-
-#define NUM_TERMINALS 3
+#include "ansi.h"
+#include "fbcon.h"
+#include "serial.h"
+#include "spinlock.h"
+
+/* terminals are created on demand (Alt+F1..F12) up to this limit */
+#ifndef MAX_TERMINALS
+#define MAX_TERMINALS 12
+#endif
 
 #define BUFFER_LENGTH 		128
 #define PRINT_LENGTH 		127
 #define LAST_PRINTED 		126
+#define TERMINAL_WRITE_CHUNK 	128 	/* characters written per terminal_lock hold */
 #define SCAN_START 			14 	//height
 #define SCAN_END 			15 	//of cursor
 
@@ -40,7 +48,7 @@
 #define PREV_POSITON 		2
 #define DECREASE_TWO_UPDATE 2
 
-/* either 0, 1 or 2 depending on which terminal is visible */
+/* index of the visible terminal, 0 to MAX_TERMINALS - 1 */
 int visible_terminal;
 
 /* terminal structure */
@@ -58,14 +66,32 @@ typedef struct terminal_t {
   volatile int rtc_flag;                  /* flag for each terminal's RTC */
   uint32_t vidmem_addr;                   /* pointer to terminal-specific vid mem page */
   uint32_t user_vidmem_addr;              /* address used specifically for the vidmap() function */
+  uint32_t* vidmap_table;                 /* page table behind user_vidmem_addr, allocated by the first vidmap() */
+  int is_created;                         /* 1 once the terminal's video page has been allocated */
+  uint8_t attrib;                         /* current text color, changed by SGR escape sequences */
+  ansi_state_t ansi;                      /* escape-sequence parser state */
+  volatile int sleeping;                  /* process waits in poll(); not scheduled until woken */
+  uint32_t wake_tick;                     /* pit_ticks at which a sleep times out, 0 for never */
 } terminal_t;
 
 /* array of our terminal structures */
-terminal_t terminals[NUM_TERMINALS];
+terminal_t terminals[MAX_TERMINALS];
 
-/* Initializes the 3 terminal structures */
+/* line buffers and screen output of every terminal */
+extern spinlock_t terminal_lock;
+
+/* Initializes the terminal structures and creates Terminal 1 */
 void terminal_init();
 
+/* allocates a terminal's video page the first time it is used */
+int32_t terminal_create(int term_num);
+
+/* makes a terminal visible (ALT + F#), creating it and its shell if needed */
+void switch_terminal(int term_num);
+
+/* physical page a terminal's vidmap() mapping should point at */
+uint32_t terminal_vid_phys(int term_num);
+
 /* terminal-specific open syscall */
 int32_t terminal_open(const uint8_t* filename);
 
@@ -74,9 +100,15 @@ int32_t terminal_close(int32_t fd);
 
 /* terminal-specific read syscall */
 int32_t terminal_read(int32_t fd, void* buf, int32_t nbytes);
+struct pcb_t;
+/* POLLIN once a line has been entered; writes never wait */
+int32_t terminal_poll(struct pcb_t* pcb, int32_t fd);
 
 /* terminal-specific write syscall */
 int32_t terminal_write(int32_t fd, const void* buf, int32_t nbytes);
+struct iovec_t;
+/* writes several buffers with one cursor update */
+int32_t terminal_writev(int32_t fd, const struct iovec_t* iov, int32_t iovcnt);
 
 /* enables cursor */
 void enable_cursor();
@@ -99,6 +131,9 @@ void scroll_up(int term_num);
 /* deletes a character from the input buffer */
 void backspace(int term_num);
 
+/* echoes a typed character and passes it to the line buffer */
+void terminal_input(unsigned char ascii, int term_num);
+
 /*helper function that interacts with buffer if a key is pressed*/
 void handle_buffer(unsigned char input, int term_num);
 
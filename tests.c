@@ -6,6 +6,7 @@
 #include "terminal.h"
 #include "file_system.h"
 #include "system_calls.h"
+#include "scheduler.h"
 
 #define PASS 1
 #define FAIL 0
@@ -16,12 +17,67 @@
 #define TEST_OUTPUT(name, result)	\
 	printf("[TEST %s] Result = %s\n", name, (result) ? "PASS" : "FAIL");
 
+/* null system call benchmark (syscall_bench_test) */
+#define BENCH_LOOPS 		1000
+#define BENCH_VECTOR 		0x81 	/* temporary gate back from the user code */
+#define BENCH_USER_STACK 	(MB128 + MB4 - 16)
+#define _STR(x) 	#x
+#define STR(x) 		_STR(x)
+
+/* process slot whose memory, windows and kernel stack the tests borrow */
+#define TEST_PROCESS 		(MAX_NUM_PROCS - 1)
+
 static inline void assertion_failure(){
 	/* Use exception #15 for assertions, otherwise
 	   reserved by Intel */
 	asm volatile("int $15");
 }
 
+/* test_borrow_user_page
+* maps TEST_PROCESS's program page at 128 MB, so a test has user memory
+* to pass to the system call cores
+* Input: none
+* Output: the entry that was there, for test_restore_user_page()
+* Side Effects: changes this CPU's 128 MB mapping
+*/
+static uint32_t test_borrow_user_page()
+{
+	uint32_t old_pde = cpu_page_directory()[MB128 / FOUR_MB];
+
+	map_task(MB128, MB8 + (TEST_PROCESS * MB4));
+	return old_pde;
+}
+
+/* test_restore_user_page
+* puts back the 128 MB mapping test_borrow_user_page() replaced
+* Input: old_pde = its return value
+* Output: none
+* Side Effects: flushes the TLB
+*/
+static void test_restore_user_page(uint32_t old_pde)
+{
+	preempt_disable();
+	cpu_page_directory()[MB128 / FOUR_MB] = old_pde;
+	flush_tlb();
+	preempt_enable();
+}
+
+/* test_stand_in
+* gives a test a cleared PCB for TEST_PROCESS on terminal 0
+* Input: none
+* Output: the PCB (shared by the tests, which run one at a time)
+* Side Effects: none
+*/
+static pcb_t* test_stand_in()
+{
+	static pcb_t pcb;
+
+	memset(&pcb, 0, sizeof(pcb));
+	pcb.process_id = TEST_PROCESS;
+	pcb.terminal_number = 0;
+	return &pcb;
+}
+
 
 // /* Checkpoint 1 tests */
 
@@ -213,6 +269,1207 @@ static inline void assertion_failure(){
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* ansi_test
+* feeds cursor-addressing, erase and SGR sequences through putc and
+* checks the resulting cells in the visible terminal's video memory
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: clears the visible terminal
+*/
+int ansi_test()
+{
+	TEST_HEADER;
+	int8_t* seq = "\033[2J\033[3;5HX\033[31;1mY\033[0m\033[1;1H\033[K";
+	uint8_t* vid = (uint8_t*)terminals[visible_terminal].vidmem_addr;
+	int cell = (screen_cols * 2) + 4;
+	uint8_t reversed = (uint8_t)(((ATTRIB & ATTRIB_FG_MASK) << ATTRIB_BG_SHIFT) | ((ATTRIB & ATTRIB_BG_MASK) >> ATTRIB_BG_SHIFT));
+	int result = PASS;
+
+	clear_screen(visible_terminal);
+	puts(seq);
+
+	/* X at row 3 col 5 in the default color, Y right after it in bright red */
+	if( vid[cell << 1] != 'X' || vid[(cell << 1) + 1] != ATTRIB )
+		result = FAIL;
+	if( vid[(cell + 1) << 1] != 'Y' || vid[((cell + 1) << 1) + 1] != (ATTRIB_BRIGHT | 4) )
+		result = FAIL;
+	/* ESC [ 1 ; 1 H moved the cursor home, ESC [ 0 m restored the color */
+	if( terminals[visible_terminal].screen_x != 0 || terminals[visible_terminal].screen_y != 0 )
+		result = FAIL;
+	if( terminals[visible_terminal].attrib != ATTRIB )
+		result = FAIL;
+
+	/* 27 on normal text changes nothing, a second 7 doesn't undo the first */
+	puts("\033[27m");
+	if( terminals[visible_terminal].attrib != ATTRIB )
+		result = FAIL;
+	puts("\033[7m\033[7m");
+	if( terminals[visible_terminal].attrib != reversed )
+		result = FAIL;
+	puts("\033[27m");
+	if( terminals[visible_terminal].attrib != ATTRIB )
+		result = FAIL;
+
+	clear_screen(visible_terminal);
+	return result;
+}
+
+/* fbmap_test
+* maps the back buffer for a stand-in process and checks that only that
+* process's FB_USER_ADDR entry is set, that a pixel written through it
+* lands in the back buffer, and that a flip remaps it to the other buffer
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: sets the default VBE mode if the display was in text mode
+*				(back to text mode at the end); borrows process slot
+*				TEST_PROCESS
+*/
+int fbmap_test()
+{
+	TEST_HEADER;
+	uint32_t* pde = &cpu_page_directory()[FB_USER_ADDR / FOUR_MB];
+	uint32_t* user = (uint32_t*)FB_USER_ADDR;
+	uint8_t* back;
+	int result = PASS;
+
+	if( !vbe.enabled && vbe_set_mode(FB_DEFAULT_XRES, FB_DEFAULT_YRES, FB_DEFAULT_BPP) != 0 )
+		return FAIL;
+	if( vbe_map_user(TEST_PROCESS) != 0 || vbe_map_user(TEST_PROCESS - 1) != -1 )
+		return FAIL;
+
+	if( !(*pde & PAGE_PRESENT) || !(*pde & PAGE_USER) )
+		result = FAIL;
+	back = vbe_back_buffer();
+	user[0] = 0x00C0FFEE;
+	if( *(uint32_t*)back != 0x00C0FFEE )
+		result = FAIL;
+
+	/* after a flip the same address shows the other buffer */
+	if( vbe_flip() != 0 || vbe_back_buffer() == back ||
+		(vbe.user_table[0] & PAGE_ADDR_MASK) != (uint32_t)vbe_back_buffer() )
+		result = FAIL;
+
+	/* any other process gets no mapping */
+	user_windows_map(TEST_PROCESS - 1);
+	if( *pde != 0 )
+		result = FAIL;
+
+	vbe_release(TEST_PROCESS);
+	if( vbe.owner != -1 || *pde != 0 )
+		result = FAIL;
+	flush_tlb();
+	return result;
+}
+
+/* fbcon_dirty_test
+* checks that single cells grow the dirty rectangle column-wise and that
+* a range spanning rows dirties whole rows (no framebuffer needed)
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: none (console state is restored)
+*/
+int fbcon_dirty_test()
+{
+	TEST_HEADER;
+	fbcon_t saved = fbcon;
+	int result = PASS;
+
+	fbcon.cols = 100;
+	fbcon.dirty_x0 = fbcon.dirty_y0 = fbcon.dirty_x1 = fbcon.dirty_y1 = 0;
+
+	fbcon_dirty(205, 206);
+	fbcon_dirty(210, 213);
+	if( fbcon.dirty_x0 != 5 || fbcon.dirty_x1 != 13 || fbcon.dirty_y0 != 2 || fbcon.dirty_y1 != 3 )
+		result = FAIL;
+
+	fbcon_dirty(390, 410);
+	if( fbcon.dirty_x0 != 0 || fbcon.dirty_x1 != 100 || fbcon.dirty_y0 != 2 || fbcon.dirty_y1 != 5 )
+		result = FAIL;
+
+	fbcon = saved;
+	return result;
+}
+
+/* blit_cycles
+* helper for pat_blit_test: average TSC cycles to copy a screen's worth
+* of text cells into VGA memory
+*/
+#define BLIT_ITERATIONS 256
+static uint32_t blit_cycles(uint8_t* screen, uint32_t num_bytes)
+{
+	uint64_t start;
+	int i;
+
+	start = rdtsc();
+	for( i = 0; i < BLIT_ITERATIONS; i++ )
+		memcpy((void*)VIDEO, screen, num_bytes);
+	return (uint32_t)(rdtsc() - start) / BLIT_ITERATIONS;
+}
+
+/* pat_blit_test
+* checks that VGA memory is mapped write-combining when the CPU has a PAT,
+* then times screen blits through the WC mapping and through an uncached one
+* Input: none
+* Output: PASS/FAIL, prints cycles per blit for both memory types
+* Side Effects: briefly remaps the VGA page, screen contents are unchanged
+*/
+int pat_blit_test()
+{
+	TEST_HEADER;
+	static uint8_t screen[NUM_COLS * NUM_ROWS * 2];
+	uint32_t index = VIDEO >> PAGE_SHIFT;
+	uint32_t saved = page_table[index];
+	uint32_t wc;
+	uint32_t uc;
+	int result = PASS;
+
+	if( page_wc_bits == PAGE_PWT && paging_mem_type(VIDEO) != MEM_TYPE_WC )
+		result = FAIL;
+
+	memcpy(screen, (void*)VIDEO, sizeof(screen));
+	wc = blit_cycles(screen, sizeof(screen));
+
+	page_table[index] = (saved & ~(PAGE_PWT | PAGE_PCD)) | PAGE_PCD | PAGE_PWT;
+	asm volatile ("wbinvd" : : : "memory");
+	flush_tlb();
+	if( paging_mem_type(VIDEO) != MEM_TYPE_UC )
+		result = FAIL;
+	uc = blit_cycles(screen, sizeof(screen));
+
+	page_table[index] = saved;
+	asm volatile ("wbinvd" : : : "memory");
+	flush_tlb();
+
+	printf("%u byte blit: %u cycles with page_wc_bits, %u cycles uncached\n", sizeof(screen), wc, uc);
+	return result;
+}
+
+/* serial_test
+* queues a newline and checks that "\r\n" went into the TX ring back to
+* back and that serial_lock was let go
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: starts the COM1 mirror of the visible terminal if it
+*				wasn't on; sends a newline to the port
+*/
+int serial_test()
+{
+	TEST_HEADER;
+	uint32_t flags;
+	uint32_t tail;
+	int result = PASS;
+
+	if( !serial.enabled && serial_init(visible_terminal) != 0 )
+		return FAIL;
+
+	/* keep the THR-empty interrupt from draining the ring meanwhile */
+	cli_and_save(flags);
+	tail = serial.tx_tail;
+	serial_putc('\n');
+	if( serial.tx_tail != ((tail + 2) & (SERIAL_TX_SIZE - 1)) || serial.tx_buf[tail] != '\r' ||
+		serial.tx_buf[(tail + 1) & (SERIAL_TX_SIZE - 1)] != '\n' || serial_lock.locked )
+		result = FAIL;
+	restore_flags(flags);
+	return result;
+}
+
+/* klog_test
+* logs a record and checks that dmesg's formatter returns it as the last line
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: adds a debug record to the kernel log
+*/
+int klog_test()
+{
+	TEST_HEADER;
+	static uint8_t buf[KLOG_ENTRIES * KLOG_LINE_LENGTH];
+	int8_t* expected = "debug: klog_test 42% 000000ab ok\n";
+	uint32_t len = strlen(expected);
+	int32_t n;
+
+	klog(KLOG_DEBUG, "klog_test %d%% %#x %s", 42, 0xab, "ok");
+	n = klog_read(buf, sizeof(buf));
+
+	if( n < (int32_t)len || strncmp((int8_t*)buf + n - len, expected, len) != 0 )
+		return FAIL;
+	return PASS;
+}
+
+/* run_queue_test
+* checks the per-CPU run queues: every launched terminal is queued on
+* exactly one online CPU and each CPU's current terminal is its own
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: none
+*/
+int run_queue_test()
+{
+	TEST_HEADER;
+	uint32_t seen = 0;
+	int i, t;
+
+	if( smp_enabled && this_cpu()->apic_id != lapic_id() )
+		return FAIL;
+
+	for( i = 0; i < APIC_MAX_CPUS; i++ )
+	{
+		if( !cpus[i].online )
+			continue;
+		if( seen & cpus[i].run_queue )
+			return FAIL;
+		seen |= cpus[i].run_queue;
+		if( cpus[i].curr_term != -1 && !(cpus[i].run_queue & (1 << cpus[i].curr_term)) )
+			return FAIL;
+	}
+
+	for( t = 0; t < MAX_TERMINALS; t++ )
+		if( terminals[t].has_been_launched && !(seen & (1 << t)) )
+			return FAIL;
+	return PASS;
+}
+
+/* spinlock_test
+* takes a lock, checks that trylock fails while it is held and that the
+* acquisitions are counted, then logs the subsystem locks' counters
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: adds records to the kernel log
+*/
+int spinlock_test()
+{
+	TEST_HEADER;
+	static spinlock_t lock = SPINLOCK_INIT("test");
+	uint32_t flags;
+	int taken;
+
+	/* every path out drops what it took, or the machine stays locked */
+	spin_lock_irqsave(&lock, flags);
+	taken = spin_trylock(&lock);
+	if( taken )
+		preempt_enable();
+	spin_unlock_irqrestore(&lock, flags);
+	if( taken )
+		return FAIL;
+
+	if( !spin_trylock(&lock) )
+		return FAIL;
+	spin_unlock(&lock);
+
+	if( LOCK_STATS && (lock.acquired != 2 || lock.contended != 0) )
+		return FAIL;
+
+	spinlock_report();
+	return PASS;
+}
+
+/* preempt_test
+* checks that a held spinlock raises the preempt count, that a PIT tick
+* inside a preempt_disable() section is held back as pending and that
+* preempt_enable() takes it, then logs the worst scheduling latency
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: waits two PIT ticks, adds records to the kernel log
+*/
+int preempt_test()
+{
+	TEST_HEADER;
+	static spinlock_t lock = SPINLOCK_INIT("test");
+	cpu_t* cpu = this_cpu();
+	int base = cpu->preempt_count;
+	int held;
+	uint32_t start;
+
+	spin_lock(&lock);
+	held = cpu->preempt_count;
+	spin_unlock(&lock);
+	if( held != base + 1 || cpu->preempt_count != base )
+		return FAIL;
+
+	preempt_disable();
+	start = pit_ticks;
+	while( pit_ticks - start < 2 )
+		cpu_relax();
+	if( !cpu->need_resched )
+	{
+		preempt_enable();
+		return FAIL;
+	}
+	preempt_enable();
+	if( cpu->need_resched || cpu->preempt_count != base )
+		return FAIL;
+
+	sched_latency_report();
+	return PASS;
+}
+
+/*
+	Null system call benchmark. syscall_bench_user is copied to 128 MB and
+	run in user mode: it times BENCH_LOOPS invalid (number 0) system calls
+	through int 0x80, then as many through SYSENTER, and comes back to
+	syscall_bench_exit through BENCH_VECTOR with the cycle counts in EBX
+	and EAX. Interrupts stay off throughout (invalid numbers never reach
+	the sti in front of the jump table).
+*/
+static uint32_t syscall_bench_esp __attribute__((used));
+static uint32_t syscall_bench_cycles[2] __attribute__((used));
+extern uint8_t syscall_bench_user[], syscall_bench_user_end[];
+void syscall_bench_enter();
+void syscall_bench_exit();
+
+asm (
+"	.text\n"
+"syscall_bench_user:\n"
+"	rdtsc\n"
+"	movl %eax, %edi\n"
+"	movl $" STR(BENCH_LOOPS) ", %esi\n"
+"1:	xorl %eax, %eax\n"
+"	int $0x80\n"
+"	decl %esi\n"
+"	jnz 1b\n"
+"	rdtsc\n"
+"	subl %edi, %eax\n"
+"	movl %eax, %ebx\n"
+	/* SYSENTER returns to the address in EDI: label 3, wherever we were copied */
+"	call 2f\n"
+"2:	popl %edi\n"
+"	addl $(3f - 2b), %edi\n"
+"	rdtsc\n"
+"	pushl %eax\n"
+"	movl %esp, %ebp\n"
+"	movl $" STR(BENCH_LOOPS) ", %esi\n"
+"4:	xorl %eax, %eax\n"
+"	sysenter\n"
+"3:	decl %esi\n"
+"	jnz 4b\n"
+"	rdtsc\n"
+"	popl %ecx\n"
+"	subl %ecx, %eax\n"
+"	int $" STR(BENCH_VECTOR) "\n"
+"syscall_bench_user_end:\n"
+"\n"
+"syscall_bench_enter:\n"
+"	pushl %ebp\n"
+"	pushl %ebx\n"
+"	pushl %esi\n"
+"	pushl %edi\n"
+"	movl %esp, syscall_bench_esp\n"
+"	movw $" STR(USER_DS) ", %ax\n"
+"	movw %ax, %ds\n"
+"	movw %ax, %es\n"
+"	pushl $" STR(USER_DS) "\n"
+"	pushl $" STR(BENCH_USER_STACK) "\n"
+"	pushl $0x2\n"
+"	pushl $" STR(USER_CS) "\n"
+"	pushl $" STR(MB128) "\n"
+"	iret\n"
+"\n"
+"syscall_bench_exit:\n"
+"	movw $" STR(KERNEL_DS) ", %cx\n"
+"	movw %cx, %ds\n"
+"	movw %cx, %es\n"
+"	movl syscall_bench_esp, %esp\n"
+"	movl %ebx, syscall_bench_cycles\n"
+"	movl %eax, syscall_bench_cycles + 4\n"
+"	popl %edi\n"
+"	popl %esi\n"
+"	popl %ebx\n"
+"	popl %ebp\n"
+"	ret\n"
+);
+
+/* syscall_bench_test
+* runs the null system call benchmark above in user mode and prints the
+* round trip through int 0x80 and through SYSENTER / SYSEXIT
+* Input: none
+* Output: PASS/FAIL (FAIL without SYSENTER)
+* Side Effects: borrows process slot TEST_PROCESS's memory and kernel stack
+*/
+int syscall_bench_test()
+{
+	TEST_HEADER;
+	cpu_t* cpu = this_cpu();
+	uint32_t old_pde;
+	uint32_t old_esp0 = cpu->tss->esp0;
+	idt_desc_t old_gate = idt[BENCH_VECTOR];
+	uint32_t flags;
+
+	if( !sysenter_enabled )
+		return FAIL;
+
+	cli_and_save(flags);
+
+	/* a user-callable gate like the system call's */
+	idt[BENCH_VECTOR] = idt[0x80];
+	SET_IDT_ENTRY(idt[BENCH_VECTOR], syscall_bench_exit);
+
+	old_pde = test_borrow_user_page();
+	memcpy((void*)MB128, syscall_bench_user, syscall_bench_user_end - syscall_bench_user);
+	cpu->tss->esp0 = MB8 - (KB8 * TEST_PROCESS) - 4;
+
+	syscall_bench_enter();
+
+	cpu->tss->esp0 = old_esp0;
+	test_restore_user_page(old_pde);
+	idt[BENCH_VECTOR] = old_gate;
+	restore_flags(flags);
+
+	printf("null syscall round trip: int 0x80 %u cycles, sysenter %u cycles\n",
+		syscall_bench_cycles[0] / BENCH_LOOPS, syscall_bench_cycles[1] / BENCH_LOOPS);
+
+	if( syscall_bench_cycles[0] == 0 || syscall_bench_cycles[1] == 0 )
+		return FAIL;
+	return PASS;
+}
+
+/* vdso_test
+* checks that the vDSO pages are user readable but not writable, and that
+* the user entries agree with the kernel's view of the clock and move
+* forward with the PIT
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: waits for two PIT ticks
+*/
+int vdso_test()
+{
+	TEST_HEADER;
+	uint32_t (*user_ticks)() = (uint32_t (*)())VDSO_TICKS;
+	uint64_t (*user_uptime_ns)() = (uint64_t (*)())VDSO_UPTIME_NS;
+	void (*user_time)(uint32_t*) = (void (*)(uint32_t*))VDSO_TIME;
+	uint32_t* table;
+	uint32_t tv[2];
+	uint64_t before, after;
+	uint32_t start;
+
+	if( vdso_data == NULL )
+		return FAIL;
+
+	table = (uint32_t*)(page_directory[VDSO_ADDR / FOUR_MB] & PAGE_ADDR_MASK);
+	if( (table[0] & (PAGE_USER | PAGE_RW)) != PAGE_USER || (table[1] & (PAGE_USER | PAGE_RW)) != PAGE_USER )
+		return FAIL;
+
+	before = user_uptime_ns();
+	if( vdso_uptime_ns() < before )
+		return FAIL;
+
+	start = pit_ticks;
+	while( pit_ticks - start < 2 )
+		cpu_relax();
+
+	after = user_uptime_ns();
+	/* two ticks are 50 ms; allow for the calibration being a little off */
+	if( after - before < (uint64_t)PIT_TICK_NS || user_ticks() - start < 2 )
+		return FAIL;
+
+	user_time(tv);
+	if( tv[0] < vdso_data->sec || tv[1] >= NS_PER_SEC )
+		return FAIL;
+
+	printf("vdso: %u ticks, Unix time %u s + %u ns\n", user_ticks(), tv[0], tv[1]);
+	return PASS;
+}
+
+/* syscall_batch_test
+* batches two dmesg calls around an invalid one in a borrowed user page and
+* checks the per-entry results, with and without BATCH_STOP_ON_ERROR, and
+* that an array outside the user page is refused
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's memory
+*/
+int syscall_batch_test()
+{
+	TEST_HEADER;
+	uint32_t old_pde = test_borrow_user_page();
+	syscall_desc_t* descs = (syscall_desc_t*)MB128;
+	uint8_t* buf = (uint8_t*)(MB128 + FOUR_KB);
+	int32_t run_all, run_stop;
+	int result = PASS;
+
+	descs[0].number = SYS_DMESG;
+	descs[0].args[0] = (int32_t)buf;
+	descs[0].args[1] = FOUR_KB;
+	descs[1].number = 0;
+	descs[2] = descs[0];
+
+	run_all = syscall_batch(descs, 3, 0);
+	if( run_all != 3 || descs[0].result < 0 || descs[1].result != -1 || descs[2].result < 0 )
+		result = FAIL;
+
+	descs[2].result = 0x1234;
+	run_stop = syscall_batch(descs, 3, BATCH_STOP_ON_ERROR);
+	if( run_stop != 2 || descs[2].result != 0x1234 )
+		result = FAIL;
+
+	if( syscall_batch((syscall_desc_t*)(MB128 + MB4 - sizeof(syscall_desc_t)), 2, 0) != -1 ||
+		syscall_batch((syscall_desc_t*)0xFFFFFFF0, 1, 0) != -1 )
+		result = FAIL;
+
+	test_restore_user_page(old_pde);
+	return result;
+}
+
+/* ioring_test
+* sets up an I/O ring for a stand-in process, submits a nop, a write to a
+* closed fd and an unknown opcode, and checks the completions as seen
+* through the user mapping
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's ring
+*/
+int ioring_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = test_stand_in();
+	io_ring_t* ring = (io_ring_t*)IORING_ADDR;
+	int result = PASS;
+	int i;
+
+	if( ioring_setup(pcb) != IORING_ADDR )
+		return FAIL;
+
+	for( i = 0; i < 3; i++ )
+	{
+		ring->sq[i].fd = 3;
+		ring->sq[i].buf = (uint8_t*)MB128;
+		ring->sq[i].len = 1;
+		ring->sq[i].user_data = 100 + i;
+	}
+	ring->sq[0].opcode = IORING_OP_NOP;
+	ring->sq[1].opcode = IORING_OP_WRITE;
+	ring->sq[2].opcode = 7;
+	ring->sq_tail = 3;
+
+	if( ioring_enter(pcb, 3, 3) != 3 || ring->sq_head != 3 || ring->cq_tail != 3 )
+		result = FAIL;
+	else if( ring->cq[0].user_data != 100 || ring->cq[0].res != 0 ||
+			 ring->cq[1].user_data != 101 || ring->cq[1].res != -1 ||
+			 ring->cq[2].user_data != 102 || ring->cq[2].res != -1 )
+		result = FAIL;
+
+	ioring_release(TEST_PROCESS);
+	user_windows_map(TEST_PROCESS);
+	flush_tlb();
+	return result;
+}
+
+/* poll_test
+* polls a stand-in process's stdout, stdin and a closed fd without waiting,
+* then an empty set with a timeout, which must sleep for about that long
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's memory
+*/
+int poll_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = test_stand_in();
+	uint32_t old_pde = test_borrow_user_page();
+	pollfd_t* fds = (pollfd_t*)MB128;
+	uint32_t start;
+	int result = PASS;
+
+	pcb->fd_array[FD_IN].f_op.poll = terminal_poll;
+	pcb->fd_array[FD_IN].flags = BUSY;
+	pcb->fd_array[FD_OUT].f_op.poll = terminal_poll;
+	pcb->fd_array[FD_OUT].flags = BUSY;
+	terminals[0].commit_flag = 0;
+
+	fds[0].fd = FD_OUT;
+	fds[0].events = POLLOUT;
+	fds[1].fd = FD_IN;
+	fds[1].events = POLLIN;
+	fds[2].fd = 5;
+	fds[2].events = POLLIN;
+
+	if( poll_fds(pcb, fds, 3, 0) != 2 || fds[0].revents != POLLOUT ||
+		fds[1].revents != 0 || fds[2].revents != POLLNVAL )
+		result = FAIL;
+
+	/* 60 ms rounds up to three ticks */
+	start = pit_ticks;
+	if( poll_fds(pcb, fds, 0, 60) != 0 || pit_ticks - start < 3 || terminals[0].sleeping )
+		result = FAIL;
+
+	if( poll_fds(pcb, (pollfd_t*)(MB128 + MB4 - sizeof(pollfd_t)), 2, 0) != -1 )
+		result = FAIL;
+
+	test_restore_user_page(old_pde);
+	return result;
+}
+
+#define PIPE_BENCH_BYTES 	(1024 * 1024)
+#define PIPE_SMALL_WRITE 	100
+
+/* pipe_bench_time
+* pushes PIPE_BENCH_BYTES through a pipe, writing and then reading back
+* chunk bytes at a time, and checks the data
+* Input: p = pipe, chunk = bytes per write / read
+* Output: microseconds taken, 0 if data was lost or changed
+* Side Effects: none
+*/
+static uint32_t pipe_bench_time(pipe_t* p, int32_t chunk)
+{
+	static uint8_t src[FOUR_KB];
+	static uint8_t dst[FOUR_KB];
+	uint64_t start;
+	uint32_t us;
+	int32_t done;
+	int i;
+
+	for( i = 0; i < FOUR_KB; i++ )
+		src[i] = (uint8_t)(i * 7 + chunk);
+
+	start = vdso_uptime_ns();
+	for( done = 0; done + chunk <= PIPE_BENCH_BYTES; done += chunk )
+	{
+		if( pipe_put(p, src, chunk) != chunk || pipe_get(p, dst, chunk) != chunk )
+			return 0;
+	}
+	us = (uint32_t)(vdso_uptime_ns() - start) / 1000;
+
+	for( i = 0; i < chunk; i++ )
+		if( src[i] != dst[i] )
+			return 0;
+	return (us != 0) ? us : 1;
+}
+
+/* pipe_bench_test
+* checks that a pipe holds PIPE_BUFS pages and hands them back in order,
+* then reports its throughput for whole-page and small writes
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: prints the throughput
+*/
+int pipe_bench_test()
+{
+	TEST_HEADER;
+	static uint8_t buf[FOUR_KB];
+	pipe_t* p = pipe_create();
+	uint32_t page_us, small_us;
+	int result = PASS;
+	int i;
+
+	if( p == NULL )
+		return FAIL;
+
+	/* fill it up: the last put must find no room */
+	for( i = 0; i < PIPE_BUFS; i++ )
+	{
+		memset(buf, i, FOUR_KB);
+		if( pipe_put(p, buf, FOUR_KB) != FOUR_KB )
+			result = FAIL;
+	}
+	if( pipe_put(p, buf, 1) != 0 || p->bytes != PIPE_BUFS * FOUR_KB )
+		result = FAIL;
+
+	for( i = 0; i < PIPE_BUFS; i++ )
+	{
+		if( pipe_get(p, buf, FOUR_KB) != FOUR_KB || buf[0] != i || buf[FOUR_KB - 1] != i )
+			result = FAIL;
+	}
+	if( pipe_get(p, buf, 1) != 0 || p->head != p->tail )
+		result = FAIL;
+
+	page_us = pipe_bench_time(p, FOUR_KB);
+	small_us = pipe_bench_time(p, PIPE_SMALL_WRITE);
+	if( page_us == 0 || small_us == 0 )
+		result = FAIL;
+	else
+		printf("pipe: %u MB/s with %u-byte writes, %u MB/s with %u-byte writes\n",
+			PIPE_BENCH_BYTES / page_us, FOUR_KB, PIPE_BENCH_BYTES / small_us, PIPE_SMALL_WRITE);
+
+	pipe_drop(p, PIPE_READ_END);
+	pipe_drop(p, PIPE_WRITE_END);
+	if( p->in_use )
+		result = FAIL;
+	return result;
+}
+
+/* pipe_self_test
+* the running process fills its pipe past PIPE_BUFS pages: the write must
+* stop at what fits, and a read of the emptied pipe must fail while the
+* write end is open
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows fd 2 of the running pcb
+*/
+int pipe_self_test()
+{
+	TEST_HEADER;
+	static uint8_t buf[FOUR_KB];
+	pcb_t* pcb = get_PCB_from_stack();
+	fd_t saved = pcb->fd_array[2];
+	pipe_t* p = pipe_create();
+	int result = PASS;
+	int i;
+
+	if( p == NULL )
+		return FAIL;
+	pcb->fd_array[2].private_data = p;
+	pcb->fd_array[2].flags = BUSY;
+
+	for( i = 0; i < PIPE_BUFS; i++ )
+		if( pipe_write(2, buf, FOUR_KB) != FOUR_KB )
+			result = FAIL;
+	if( pipe_write(2, buf, 1) != -1 || p->bytes != PIPE_BUFS * FOUR_KB )
+		result = FAIL;
+
+	for( i = 0; i < PIPE_BUFS; i++ )
+		if( pipe_read(2, buf, FOUR_KB) != FOUR_KB )
+			result = FAIL;
+	if( pipe_read(2, buf, 1) != -1 )
+		result = FAIL;
+
+	/* a partial write returns what fit: the frames left after one */
+	if( pipe_write(2, buf, FOUR_KB) != FOUR_KB ||
+		pipe_write(2, buf, FOUR_KB * PIPE_BUFS) != FOUR_KB * (PIPE_BUFS - 1) )
+		result = FAIL;
+
+	pipe_drop(p, PIPE_READ_END);
+	pipe_drop(p, PIPE_WRITE_END);
+	pcb->fd_array[2] = saved;
+	return result;
+}
+
+/* ipc_test
+* a stand-in process sends itself a message with inline data and a window
+* page, and checks that the page was remapped (same frame, no copy), that
+* the sender got a zeroed page back and that a full mailbox refuses more
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's memory and mailbox
+*/
+int ipc_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = test_stand_in();
+	uint32_t old_pde = test_borrow_user_page();
+	ipc_msg_t* msg = (ipc_msg_t*)MB128;
+	uint32_t* window = (uint32_t*)IPC_ADDR;
+	uint32_t frame;
+	int result = PASS;
+	int i;
+
+
+	if( ipc_send(pcb, TEST_PROCESS, msg) != -1 || ipc_setup(pcb) != IPC_ADDR )
+	{
+		test_restore_user_page(old_pde);
+		return FAIL;
+	}
+
+	window[3 * FOUR_KB / 4] = 0x1C1C1C1C;
+	frame = ipc_boxes[TEST_PROCESS].table[3] & PAGE_ADDR_MASK;
+
+	msg->len = 4;
+	strncpy((int8_t*)msg->data, "ping", 4);
+	msg->page = 3;
+	msg->num_pages = 1;
+	if( ipc_send(pcb, TEST_PROCESS, msg) != 0 || window[3 * FOUR_KB / 4] != 0 )
+		result = FAIL;
+
+	memset(msg, 0, sizeof(ipc_msg_t));
+	if( ipc_recv(pcb, msg) != 0 || msg->sender != TEST_PROCESS || msg->len != 4 ||
+		strncmp((int8_t*)msg->data, "ping", 4) != 0 || msg->num_pages != 1 || msg->page != 0 )
+		result = FAIL;
+	if( (ipc_boxes[TEST_PROCESS].table[0] & PAGE_ADDR_MASK) != frame || window[0] != 0x1C1C1C1C )
+		result = FAIL;
+
+	/* inline only, until the mailbox is full */
+	msg->num_pages = 0;
+	for( i = 0; i < IPC_QUEUE; i++ )
+		if( ipc_send(pcb, TEST_PROCESS, msg) != 0 )
+			result = FAIL;
+	if( ipc_send(pcb, TEST_PROCESS, msg) != -1 )
+		result = FAIL;
+
+	ipc_release(TEST_PROCESS);
+	user_windows_map(TEST_PROCESS);
+	test_restore_user_page(old_pde);
+	return result;
+}
+
+/* shm_test
+* two stand-in processes find the same segment by key and map it at
+* different addresses; a write through one mapping shows through the
+* other; the segment outlives the other process's mappings while its
+* creator runs and is freed once both have let go of it
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows the shared memory state of the last two process slots
+*/
+int shm_test()
+{
+	TEST_HEADER;
+	pcb_t* a = test_stand_in();
+	static pcb_t b;
+	uint32_t* addr_a = (uint32_t*)(SHM_ADDR + FOUR_KB);
+	uint32_t* addr_b = (uint32_t*)(SHM_ADDR + 3 * FOUR_MB / 4);
+	int32_t id;
+	int result = PASS;
+
+	b.process_id = TEST_PROCESS - 1;
+
+	id = shm_get(a, 0x5EED, 2 * FOUR_KB);
+	if( id < 0 || shm_get(&b, 0x5EED, FOUR_KB) != id || shm_get(&b, 0x5EED, 3 * FOUR_KB) != -1 )
+		return FAIL;
+
+	if( shm_attach(a, id, (uint32_t)addr_a) != (int32_t)addr_a ||
+		shm_attach(a, id, SHM_ADDR + 2 * FOUR_KB) != -1 ||
+		shm_attach(&b, id, (uint32_t)addr_b) != (int32_t)addr_b )
+		result = FAIL;
+
+	/* b's window is the one mapped now */
+	addr_b[FOUR_KB / 4] = 0x5A5A5A5A;
+	user_windows_map(a->process_id);
+	flush_tlb();
+	if( addr_a[FOUR_KB / 4] != 0x5A5A5A5A || shm_segments[id].refs != 3 )
+		result = FAIL;
+
+	if( shm_detach(a, (uint32_t)addr_a) != 0 || shm_detach(a, (uint32_t)addr_a) != -1 ||
+		!shm_segments[id].in_use )
+		result = FAIL;
+	shm_release(b.process_id);
+	/* a created it: its ID still names the same frames */
+	if( !shm_segments[id].in_use || shm_segments[id].refs != 1 ||
+		shm_attach(a, id, (uint32_t)addr_a) != (int32_t)addr_a || addr_a[FOUR_KB / 4] != 0x5A5A5A5A )
+		result = FAIL;
+	shm_release(a->process_id);
+	if( shm_segments[id].in_use )
+		result = FAIL;
+
+	user_windows_map(TEST_PROCESS);
+	flush_tlb();
+	return result;
+}
+
+#define SENDFILE_TEST_BYTES 	6000
+
+static uint8_t sendfile_sink_buf[SENDFILE_TEST_BYTES];
+static int32_t sendfile_sink_len;
+
+/* sendfile_sink
+* write hook for sendfile_test: appends to sendfile_sink_buf
+* Input: fd (not used), buf, nbytes
+* Output: nbytes, -1 once the buffer is full
+* Side Effects: none
+*/
+static int32_t sendfile_sink(int32_t fd, const void* buf, int32_t nbytes)
+{
+	if( nbytes > SENDFILE_TEST_BYTES - sendfile_sink_len )
+		return -1;
+	memcpy(sendfile_sink_buf + sendfile_sink_len, buf, nbytes);
+	sendfile_sink_len += nbytes;
+	return nbytes;
+}
+
+/* sendfile_test
+* sends part of "shell" that crosses a data block boundary, then the rest
+* from the file position, into a stand-in fd and compares with read_data()
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: none
+*/
+int sendfile_test()
+{
+	TEST_HEADER;
+	static pcb_t pcb;
+	static uint8_t expect[SENDFILE_TEST_BYTES];
+	dentry_t dentry;
+	int32_t len;
+	int i;
+
+	if( read_dentry_by_name((uint8_t*)"shell", &dentry) == -1 )
+		return FAIL;
+	len = read_data(dentry.inode, 100, expect, SENDFILE_TEST_BYTES);
+	if( len <= FOUR_KB )
+		return FAIL;
+
+	pcb.fd_array[2].f_op.read = file_read;
+	pcb.fd_array[2].inode_num = dentry.inode;
+	pcb.fd_array[2].file_position = 100;
+	pcb.fd_array[2].flags = BUSY;
+	pcb.fd_array[3].f_op.write = sendfile_sink;
+	pcb.fd_array[3].flags = BUSY;
+	sendfile_sink_len = 0;
+
+	/* an explicit offset leaves the file position alone */
+	if( sendfile_fds(&pcb, 3, 2, 100, 10) != 10 || pcb.fd_array[2].file_position != 100 )
+		return FAIL;
+	sendfile_sink_len = 0;
+	if( sendfile_fds(&pcb, 3, 2, -1, len) != len || pcb.fd_array[2].file_position != 100 + len )
+		return FAIL;
+
+	for( i = 0; i < len; i++ )
+		if( sendfile_sink_buf[i] != expect[i] )
+			return FAIL;
+
+	if( sendfile_fds(&pcb, 2, 3, 0, 1) != -1 )
+		return FAIL;
+	return PASS;
+}
+
+/* sendfile_terminal_test
+* sends a text file that spans two data blocks to the terminal through the
+* running pcb's fds, like cat does; every block must reach the screen
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: prints the file; borrows fds 1 and 2 of the running pcb
+*/
+int sendfile_terminal_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = get_PCB_from_stack();
+	fd_t saved_out = pcb->fd_array[1];
+	fd_t saved_in = pcb->fd_array[2];
+	int saved_term = pcb->terminal_number;
+	dentry_t dentry;
+	int32_t len, sent;
+
+	if( read_dentry_by_name((uint8_t*)"verylargetextwithverylongname.tx", &dentry) == -1 )
+		return FAIL;
+	len = file_length(dentry.inode);
+
+	pcb->terminal_number = visible_terminal;
+	pcb->fd_array[1].f_op.write = terminal_write;
+	pcb->fd_array[1].flags = BUSY;
+	pcb->fd_array[2].f_op.read = file_read;
+	pcb->fd_array[2].inode_num = dentry.inode;
+	pcb->fd_array[2].file_position = 0;
+	pcb->fd_array[2].flags = BUSY;
+
+	sent = sendfile_fds(pcb, 1, 2, -1, len);
+
+	pcb->fd_array[1] = saved_out;
+	pcb->fd_array[2] = saved_in;
+	pcb->terminal_number = saved_term;
+	return (len > FOUR_KB && sent == len) ? PASS : FAIL;
+}
+
+/* lseek_pread_test
+* seeks around "frame0.txt" and the directory with every whence, reads at
+* offsets with pread_fd() and checks that it leaves the position alone
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: none
+*/
+int lseek_pread_test()
+{
+	TEST_HEADER;
+	static pcb_t pcb;
+	uint8_t buf[FILENAME_SIZE];
+	uint8_t expect[10];
+	dentry_t dentry;
+	int32_t len;
+
+	if( read_dentry_by_name((uint8_t*)"frame0.txt", &dentry) == -1 )
+		return FAIL;
+	len = file_length(dentry.inode);
+
+	pcb.fd_array[2].f_op.read = file_read;
+	pcb.fd_array[2].inode_num = dentry.inode;
+	pcb.fd_array[2].file_position = 0;
+	pcb.fd_array[2].flags = BUSY;
+	pcb.fd_array[3].f_op.read = directory_read;
+	pcb.fd_array[3].file_position = 0;
+	pcb.fd_array[3].flags = BUSY;
+
+	if( lseek_fd(&pcb, 2, 0, SEEK_END) != len || lseek_fd(&pcb, 2, 1, SEEK_END) != -1 ||
+		lseek_fd(&pcb, 2, 50, SEEK_SET) != 50 || lseek_fd(&pcb, 2, -10, SEEK_CUR) != 40 ||
+		lseek_fd(&pcb, 2, -41, SEEK_CUR) != -1 || lseek_fd(&pcb, 2, 0, 7) != -1 )
+		return FAIL;
+
+	read_data(dentry.inode, 100, expect, 10);
+	if( pread_fd(&pcb, 2, buf, 10, 100) != 10 || strncmp((int8_t*)buf, (int8_t*)expect, 10) != 0 ||
+		pcb.fd_array[2].file_position != 40 || pread_fd(&pcb, 2, buf, 10, len) != 0 )
+		return FAIL;
+
+	/* directory: positions are entry numbers ("." is entry 0) */
+	if( lseek_fd(&pcb, 3, 0, SEEK_END) != directory_length() ||
+		lseek_fd(&pcb, 3, 1, SEEK_SET) != 1 ||
+		pread_fd(&pcb, 3, buf, FILENAME_SIZE, 0) != 1 || buf[0] != '.' ||
+		pread_fd(&pcb, 3, buf, FILENAME_SIZE, directory_length()) != 0 ||
+		pcb.fd_array[3].file_position != 1 )
+		return FAIL;
+
+	pcb.fd_array[3].f_op.read = failure;
+	if( lseek_fd(&pcb, 3, 0, SEEK_SET) != -1 || pread_fd(&pcb, 3, buf, 1, 0) != -1 )
+		return FAIL;
+	return PASS;
+}
+
+
+static file_op writev_sink_fops;
+static int writev_sink_calls;
+
+/* writev hook of the stand-in fd: counts calls, then writes piece by piece */
+static int32_t writev_sink(int32_t fd, const iovec_t* iov, int32_t iovcnt)
+{
+	writev_sink_calls++;
+	return iov_write_each(&writev_sink_fops, fd, iov, iovcnt);
+}
+
+/* readv_writev_test
+* writes three pieces to a stand-in fd through writev_fd() (one hook call,
+* pieces in order), stops at a failed piece, and checks the bad iovec
+* arrays are refused
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's memory
+*/
+int readv_writev_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = test_stand_in();
+	uint32_t old_pde = test_borrow_user_page();
+	iovec_t* iov = (iovec_t*)MB128;
+	int8_t* data = (int8_t*)(MB128 + FOUR_KB);
+	int result = PASS;
+
+	strncpy(data, "one two three", 14);
+	iov[0].base = data;
+	iov[0].len = 4;
+	iov[1].base = data + 4;
+	iov[1].len = 0;
+	iov[2].base = data + 4;
+	iov[2].len = 9;
+
+	writev_sink_fops.write = sendfile_sink;
+	pcb->fd_array[2].f_op.write = sendfile_sink;
+	pcb->fd_array[2].f_op.writev = writev_sink;
+	pcb->fd_array[2].flags = BUSY;
+
+	sendfile_sink_len = 0;
+	writev_sink_calls = 0;
+	if( writev_fd(pcb, 2, iov, 3) != 13 || writev_sink_calls != 1 || sendfile_sink_len != 13 ||
+		strncmp((int8_t*)sendfile_sink_buf, data, 13) != 0 )
+		result = FAIL;
+
+	/* the sink holds SENDFILE_TEST_BYTES: the third piece no longer fits */
+	sendfile_sink_len = SENDFILE_TEST_BYTES - 5;
+	if( writev_fd(pcb, 2, iov, 3) != 4 )
+		result = FAIL;
+	sendfile_sink_len = SENDFILE_TEST_BYTES;
+	if( writev_fd(pcb, 2, iov, 3) != -1 )
+		result = FAIL;
+
+	/* iovec array outside user memory, too long, negative length, closed fd */
+	sendfile_sink_len = 0;
+	iov[1].len = -1;
+	if( writev_fd(pcb, 2, (iovec_t*)FOUR_MB, 1) != -1 || writev_fd(pcb, 2, iov, IOV_MAX + 1) != -1 ||
+		writev_fd(pcb, 2, iov, 3) != -1 || writev_fd(pcb, 3, iov, 1) != -1 || writev_sink_calls != 3 )
+		result = FAIL;
+
+	test_restore_user_page(old_pde);
+	return result;
+}
+
+/* getdents_test
+* lists the directory with getdents_fd() into a small buffer, checks each
+* record against read_dentry_by_index() and that the end returns 0, then
+* a buffer too small for one entry and a non-directory fd
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: none
+*/
+int getdents_test()
+{
+	TEST_HEADER;
+	static pcb_t pcb;
+	static uint32_t buf[64];
+	dentry_t dentry;
+	dirent_t* d;
+	int32_t index = 0;
+	int32_t calls = 0;
+	int32_t n, off;
+
+	pcb.fd_array[2].f_op.read = directory_read;
+	pcb.fd_array[2].file_position = 0;
+	pcb.fd_array[2].flags = BUSY;
+
+	while( (n = getdents_fd(&pcb, 2, buf, sizeof(buf))) > 0 )
+	{
+		calls++;
+		for( off = 0; off < n; off += d->reclen, index++ )
+		{
+			d = (dirent_t*)((uint8_t*)buf + off);
+			if( read_dentry_by_index(index, &dentry) == -1 || d->inode != dentry.inode ||
+				d->type != dentry.filetype || d->name[d->namelen] != '\0' ||
+				strncmp(d->name, dentry.filename, FILENAME_SIZE) != 0 ||
+				(d->type == FILE_DENTRY_VAL && d->size != file_length(d->inode)) )
+				return FAIL;
+		}
+	}
+	/* a 256 byte buffer can't hold every entry at once */
+	if( n != 0 || index != directory_length() || calls < 2 ||
+		pcb.fd_array[2].file_position != directory_length() )
+		return FAIL;
+
+	pcb.fd_array[2].file_position = 0;
+	if( getdents_fd(&pcb, 2, buf, sizeof(dirent_t)) != -1 || pcb.fd_array[2].file_position != 0 )
+		return FAIL;
+	pcb.fd_array[2].f_op.read = file_read;
+	if( getdents_fd(&pcb, 2, buf, sizeof(buf)) != -1 )
+		return FAIL;
+	return PASS;
+}
+
+/* mmap_test
+* maps "shell" (a whole data block and a partly used one) and "frame0.txt",
+* compares the mappings with read_data(), checks the tail of each last page
+* reads as zeros and that whole blocks aren't copies, then unmaps
+* Input: none
+* Output: PASS/FAIL
+* Side Effects: borrows process slot TEST_PROCESS's file mappings
+*/
+int mmap_test()
+{
+	TEST_HEADER;
+	pcb_t* pcb = test_stand_in();
+	static uint8_t expect[2 * FOUR_KB];
+	dentry_t shell, frame0;
+	uint8_t* map;
+	uint8_t* small;
+	uint8_t* block;
+	int32_t len;
+	int result = PASS;
+	int32_t i;
+
+	if( read_dentry_by_name((uint8_t*)"shell", &shell) == -1 ||
+		read_dentry_by_name((uint8_t*)"frame0.txt", &frame0) == -1 )
+		return FAIL;
+	len = read_data(shell.inode, 0, expect, sizeof(expect));
+
+	if( mmap_file(pcb, shell.inode, 1, 0) != -1 || mmap_file(pcb, shell.inode, 2 * FOUR_KB, 0) != -1 )
+		return FAIL;
+	map = (uint8_t*)mmap_file(pcb, shell.inode, 0, 0);
+	small = (uint8_t*)mmap_file(pcb, frame0.inode, 0, 0);
+	if( (int32_t)map != MMAP_ADDR || (int32_t)small != MMAP_ADDR + 2 * FOUR_KB )
+		result = FAIL;
+
+	for( i = 0; i < 2 * FOUR_KB && result == PASS; i++ )
+		if( map[i] != ((i < len) ? expect[i] : 0) )
+			result = FAIL;
+	if( small[file_length(frame0.inode)] != 0 || small[FOUR_KB - 1] != 0 )
+		result = FAIL;
+
+	/* a whole, aligned block is the file system's own page */
+	read_data_span(shell.inode, 0, &block);
+	if( ((uint32_t)block & (FOUR_KB - 1)) == 0 &&
+		(mmap_procs[TEST_PROCESS].table[0] & PAGE_ADDR_MASK) != (uint32_t)block )
+		result = FAIL;
+
+	if( mmap_unmap(pcb, (uint32_t)map) != 0 || mmap_unmap(pcb, (uint32_t)map) != -1 ||
+		mmap_procs[TEST_PROCESS].table[1] != 0 )
+		result = FAIL;
+	/* the freed run is found again */
+	if( mmap_file(pcb, frame0.inode, 0, 0) != MMAP_ADDR )
+		result = FAIL;
+
+	mmap_release(TEST_PROCESS);
+	user_windows_map(TEST_PROCESS);
+	flush_tlb();
+	return result;
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -310,4 +1567,34 @@ void launch_tests(){
 		printf(vid_map_base);
 	}
 	*/
+
+	/*
+
+		Checkpoint 5 tests
+
+	*/
+	//TEST_OUTPUT("ansi_test", ansi_test());
+	//TEST_OUTPUT("fbmap_test", fbmap_test());
+	//TEST_OUTPUT("fbcon_dirty_test", fbcon_dirty_test());
+	//TEST_OUTPUT("pat_blit_test", pat_blit_test());
+	//TEST_OUTPUT("serial_test", serial_test());
+	//TEST_OUTPUT("klog_test", klog_test());
+	//TEST_OUTPUT("run_queue_test", run_queue_test());
+	//TEST_OUTPUT("spinlock_test", spinlock_test());
+	//TEST_OUTPUT("preempt_test", preempt_test());
+	//TEST_OUTPUT("syscall_bench_test", syscall_bench_test());
+	//TEST_OUTPUT("vdso_test", vdso_test());
+	//TEST_OUTPUT("syscall_batch_test", syscall_batch_test());
+	//TEST_OUTPUT("ioring_test", ioring_test());
+	//TEST_OUTPUT("poll_test", poll_test());
+	//TEST_OUTPUT("pipe_bench_test", pipe_bench_test());
+	//TEST_OUTPUT("pipe_self_test", pipe_self_test());
+	//TEST_OUTPUT("ipc_test", ipc_test());
+	//TEST_OUTPUT("shm_test", shm_test());
+	//TEST_OUTPUT("sendfile_test", sendfile_test());
+	//TEST_OUTPUT("sendfile_terminal_test", sendfile_terminal_test());
+	//TEST_OUTPUT("lseek_pread_test", lseek_pread_test());
+	//TEST_OUTPUT("readv_writev_test", readv_writev_test());
+	//TEST_OUTPUT("getdents_test", getdents_test());
+	//TEST_OUTPUT("mmap_test", mmap_test());
 }
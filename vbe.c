@@ -0,0 +1,237 @@
+/*
+	vbe.c
+
+	Driver for the Bochs/QEMU VBE extensions (the "BGA"). It switches the
+	display into a linear framebuffer mode whose virtual height holds two
+	buffers. A process maps the back buffer with fbmap() and presents it
+	with fbflip(), which only moves the VBE Y offset to the back buffer and
+	points the process's mapping at the old front buffer: the display never
+	shows a half-drawn frame and no frame is ever copied.
+
+	Only the owner sees the mapping: like the I/O ring and shared memory
+	windows, the FB_USER_ADDR directory entry follows the running process
+	(scheduler, execute, halt) and is empty for everyone else.
+*/
+
+#include "vbe.h"
+#include "lib.h"
+#include "paging.h"
+#include "fbcon.h"
+
+vbe_t vbe = { 0, 0, 0, 0, 0, 0, 0, 0, -1, NULL };
+
+/*
+	vbe_write() / vbe_read()
+
+	Description: access one BGA register
+*/
+static void vbe_write(uint16_t index, uint16_t value)
+{
+	outw(index, VBE_DISPI_IOPORT_INDEX);
+	outw(value, VBE_DISPI_IOPORT_DATA);
+}
+
+static uint16_t vbe_read(uint16_t index)
+{
+	outw(index, VBE_DISPI_IOPORT_INDEX);
+	return (uint16_t)inw(VBE_DISPI_IOPORT_DATA);
+}
+
+/*
+	pci_config_read()
+
+	Description: reads a dword from bus 0 PCI configuration space
+	Inputs: dev = device number, reg = register offset
+	Outputs: the register's value
+*/
+static uint32_t pci_config_read(uint32_t dev, uint32_t reg)
+{
+	outl(PCI_ENABLE_BIT | (dev << 11) | (reg & 0xFC), PCI_CONFIG_ADDRESS);
+	return inl(PCI_CONFIG_DATA);
+}
+
+/*
+	vbe_find_lfb()
+
+	Description: finds the BGA's PCI device and returns its framebuffer BAR
+	Inputs: None
+	Outputs: physical address of the linear framebuffer
+*/
+static uint32_t vbe_find_lfb()
+{
+	uint32_t dev;
+	uint32_t id;
+
+	for( dev = 0; dev < PCI_MAX_DEVICES; dev++ )
+	{
+		id = pci_config_read(dev, 0);
+		if( (id & 0xFFFF) == BGA_PCI_VENDOR && (id >> 16) == BGA_PCI_DEVICE )
+			return pci_config_read(dev, PCI_BAR0) & PCI_BAR_MEM_MASK;
+	}
+	return VBE_DEFAULT_LFB;
+}
+
+/*
+	vbe_set_mode()
+
+	Description: sets a linear framebuffer mode with room for two buffers
+				 and maps the framebuffer into the kernel (4 MB pages)
+	Inputs: xres, yres, bpp = mode to set
+	Outputs: 0 for success, -1 if there is no BGA or the mode doesn't fit
+	Side Effects: the VGA text screen is no longer displayed
+*/
+int32_t vbe_set_mode(uint32_t xres, uint32_t yres, uint32_t bpp)
+{
+	uint32_t id = vbe_read(VBE_DISPI_INDEX_ID);
+	uint32_t size = xres * yres * (bpp / 8);
+	uint32_t addr;
+
+	if( id < VBE_DISPI_ID0 || id > VBE_DISPI_ID5 )
+		return -1;
+	if( size == 0 || size > FB_USER_MAX_SIZE )
+		return -1;
+
+	vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+	vbe_write(VBE_DISPI_INDEX_XRES, xres);
+	vbe_write(VBE_DISPI_INDEX_YRES, yres);
+	vbe_write(VBE_DISPI_INDEX_BPP, bpp);
+	vbe_write(VBE_DISPI_INDEX_VIRT_WIDTH, xres);
+	vbe_write(VBE_DISPI_INDEX_VIRT_HEIGHT, yres * FB_NUM_BUFFERS);
+	vbe_write(VBE_DISPI_INDEX_X_OFFSET, 0);
+	vbe_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+	vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_ENABLED | VBE_DISPI_LFB_ENABLED);
+
+	/* the device may not have enough memory for a double-height virtual screen */
+	if( vbe_read(VBE_DISPI_INDEX_VIRT_HEIGHT) < yres * FB_NUM_BUFFERS )
+	{
+		vbe_disable();
+		return -1;
+	}
+
+	vbe.lfb = vbe_find_lfb();
+	vbe.xres = xres;
+	vbe.yres = yres;
+	vbe.bpp = bpp;
+	vbe.pitch = xres * (bpp / 8);
+	vbe.size = size;
+	vbe.front = 0;
+
+	/* identity map both buffers for the kernel, write-combined */
+	for( addr = vbe.lfb & ~(FOUR_MB - 1); addr < vbe.lfb + (size * FB_NUM_BUFFERS); addr += FOUR_MB )
+		set_pde_all(addr / FOUR_MB, addr | PAGE_SIZE_4MB | page_wc_bits | PAGE_RW | PAGE_PRESENT);
+	smp_flush_tlb();
+
+	vbe.enabled = 1;
+	return 0;
+}
+
+/*
+	vbe_disable()
+
+	Description: turns the VBE extensions off, which brings back VGA text mode
+	Inputs: None
+	Outputs: None
+*/
+void vbe_disable()
+{
+	vbe_write(VBE_DISPI_INDEX_ENABLE, VBE_DISPI_DISABLED);
+	vbe.enabled = 0;
+}
+
+/*
+	vbe_back_buffer()
+
+	Description: returns the kernel address of the buffer not being displayed
+*/
+uint8_t* vbe_back_buffer()
+{
+	return (uint8_t*)(vbe.lfb + ((1 - vbe.front) * vbe.size));
+}
+
+/*
+	vbe_map_back()
+
+	Description: points the FB_USER_ADDR page table at the current back buffer
+*/
+static void vbe_map_back()
+{
+	uint32_t back = (uint32_t)vbe_back_buffer();
+	uint32_t i;
+
+	for( i = 0; i < (vbe.size + FOUR_KB - 1) / FOUR_KB; i++ )
+		vbe.user_table[i] = (back + (i * FOUR_KB)) | page_wc_bits | PAGE_USER | PAGE_RW | PAGE_PRESENT;
+	smp_flush_tlb();
+}
+
+/*
+	vbe_map_user()
+
+	Description: maps the back buffer into user space at FB_USER_ADDR
+	Inputs: pid = process that will own the framebuffer
+	Outputs: 0 for success, -1 if another process owns it or no memory is left
+*/
+int32_t vbe_map_user(int pid)
+{
+	if( vbe.owner != -1 && vbe.owner != pid )
+		return -1;
+
+	if( vbe.user_table == NULL )
+	{
+		vbe.user_table = (uint32_t*)alloc_frame();
+		if( vbe.user_table == NULL )
+			return -1;
+	}
+
+	vbe.owner = pid;
+	user_window_attach(pid, USER_WIN_FB, (uint32_t)vbe.user_table | PAGE_USER | PAGE_RW | PAGE_PRESENT);
+	vbe_map_back();
+	return 0;
+}
+
+/*
+	vbe_flip()
+
+	Description: presents the back buffer by moving the scanout Y offset,
+				 then remaps the owner's view to the new back buffer
+	Inputs: None
+	Outputs: 0 for success, -1 if no mode is set
+*/
+int32_t vbe_flip()
+{
+	if( !vbe.enabled )
+		return -1;
+
+	vbe.front = 1 - vbe.front;
+	vbe_write(VBE_DISPI_INDEX_Y_OFFSET, vbe.front * vbe.yres);
+
+	if( vbe.owner != -1 )
+		vbe_map_back();
+	return 0;
+}
+
+/*
+	vbe_release()
+
+	Description: removes a halting process's framebuffer mapping and, if
+				 it owned the display, hands it back to the framebuffer
+				 console or returns to text mode
+	Inputs: pid = process id
+	Outputs: None
+*/
+void vbe_release(int pid)
+{
+	if( vbe.owner != pid )
+		return;
+
+	vbe.owner = -1;
+	user_window_attach(pid, USER_WIN_FB, 0);
+
+	if( fbcon.enabled )
+	{
+		vbe.front = 0;
+		vbe_write(VBE_DISPI_INDEX_Y_OFFSET, 0);
+		fbcon_redraw();
+	}
+	else
+		vbe_disable();
+}
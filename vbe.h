@@ -0,0 +1,86 @@
+/*
+	vbe.h
+
+	Bochs/QEMU VBE (BGA) linear framebuffer driver
+*/
+
+#ifndef _VBE_H
+#define _VBE_H
+
+#include "types.h"
+
+/* BGA I/O ports and register indices */
+#define VBE_DISPI_IOPORT_INDEX 		0x01CE
+#define VBE_DISPI_IOPORT_DATA 		0x01CF
+#define VBE_DISPI_INDEX_ID 			0x0
+#define VBE_DISPI_INDEX_XRES 		0x1
+#define VBE_DISPI_INDEX_YRES 		0x2
+#define VBE_DISPI_INDEX_BPP 		0x3
+#define VBE_DISPI_INDEX_ENABLE 		0x4
+#define VBE_DISPI_INDEX_VIRT_WIDTH 	0x6
+#define VBE_DISPI_INDEX_VIRT_HEIGHT 0x7
+#define VBE_DISPI_INDEX_X_OFFSET 	0x8
+#define VBE_DISPI_INDEX_Y_OFFSET 	0x9
+
+#define VBE_DISPI_ID0 				0xB0C0 	/* oldest BGA interface we accept */
+#define VBE_DISPI_ID5 				0xB0C5
+#define VBE_DISPI_DISABLED 			0x00
+#define VBE_DISPI_ENABLED 			0x01
+#define VBE_DISPI_LFB_ENABLED 		0x40
+
+/* PCI configuration mechanism #1, used to find the LFB (BAR0 of the BGA device) */
+#define PCI_CONFIG_ADDRESS 			0xCF8
+#define PCI_CONFIG_DATA 			0xCFC
+#define PCI_ENABLE_BIT 				0x80000000
+#define PCI_MAX_DEVICES 			32
+#define PCI_BAR0 					0x10
+#define PCI_BAR_MEM_MASK 			0xFFFFFFF0
+#define BGA_PCI_VENDOR 				0x1234
+#define BGA_PCI_DEVICE 				0x1111
+#define VBE_DEFAULT_LFB 			0xE0000000 	/* ISA Bochs VBE, no PCI device */
+
+/* mode used when a program maps the framebuffer in text mode */
+#define FB_DEFAULT_XRES 			640
+#define FB_DEFAULT_YRES 			480
+#define FB_DEFAULT_BPP 				32
+#define FB_NUM_BUFFERS 				2
+
+/* user-visible description of the mapped back buffer (filled by fbmap) */
+typedef struct fb_info_t {
+	uint8_t* addr;      /* user address of the back buffer */
+	uint32_t xres;
+	uint32_t yres;
+	uint32_t bpp;
+	uint32_t pitch;     /* bytes per scanline */
+} fb_info_t;
+
+/* driver state */
+typedef struct vbe_t {
+	int enabled;        /* 1 while a linear framebuffer mode is set */
+	uint32_t lfb;       /* physical (= kernel virtual) address of the LFB */
+	uint32_t xres;
+	uint32_t yres;
+	uint32_t bpp;
+	uint32_t pitch;
+	uint32_t size;      /* bytes in one buffer */
+	int front;          /* index of the buffer being scanned out */
+	int owner;          /* process id that mapped the back buffer, -1 if none */
+	uint32_t* user_table; /* page table behind FB_USER_ADDR */
+} vbe_t;
+
+extern vbe_t vbe;
+
+/* checks for the BGA and sets a linear framebuffer mode with two buffers */
+int32_t vbe_set_mode(uint32_t xres, uint32_t yres, uint32_t bpp);
+/* goes back to VGA text mode */
+void vbe_disable();
+/* returns the kernel address of the back buffer */
+uint8_t* vbe_back_buffer();
+/* maps the back buffer at FB_USER_ADDR for the calling process */
+int32_t vbe_map_user(int pid);
+/* shows the back buffer and gives the old front buffer to the owner */
+int32_t vbe_flip();
+/* drops a process's framebuffer mapping (called from halt) */
+void vbe_release(int pid);
+
+#endif
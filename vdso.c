@@ -0,0 +1,175 @@
+/*
+	vdso.c
+
+	The vDSO pages (see vdso.h). The boot CPU's PIT handler advances the
+	clock by the TSC cycles since the previous tick, so the time only
+	moves forward, and a reader interpolates from the last update with the
+	same multiplier. The wall clock is read from the CMOS once at boot.
+*/
+
+#include "vdso.h"
+#include "lib.h"
+#include "paging.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "smp.h"
+#include "terminal.h"
+
+/* the last terminal's vidmap slot must end at or below the vDSO pages */
+#if TERM_USER_VID(MAX_TERMINALS) > VDSO_ADDR
+#error "terminal vidmap slots overlap VDSO_ADDR"
+#endif
+
+vdso_data_t* vdso_data;
+
+/*
+	div64_32()
+
+	Description: 64 by 32 bit division (there is no libgcc to do it)
+	Inputs: n = dividend, d = divisor, larger than n's upper half
+	Outputs: n / d
+*/
+static uint32_t div64_32(uint64_t n, uint32_t d)
+{
+	uint32_t q, r;
+
+	asm ("divl %4"
+		: "=a"(q), "=d"(r)
+		: "a"((uint32_t)n), "d"((uint32_t)(n >> 32)), "rm"(d));
+	return q;
+}
+
+/*
+	vdso_free()
+
+	Description: gives back whichever of vdso_init()'s frames it got
+*/
+static void vdso_free(uint32_t data, uint32_t text, uint32_t table)
+{
+	if( data != 0 )
+		free_frame(data);
+	if( text != 0 )
+		free_frame(text);
+	if( table != 0 )
+		free_frame(table);
+}
+
+/*
+	vdso_init()
+
+	Description: measures the TSC against the PIT, fills in the data page,
+				 copies the readers and maps both pages read-only at
+				 VDSO_ADDR on every CPU
+	Inputs: None
+	Outputs: 0 for success, -1 if the frames or the TSC rate were not there
+	Side Effects: waits VDSO_CALIBRATE_TICKS + 1 PIT ticks
+*/
+int32_t vdso_init()
+{
+	uint64_t ns_per_tick = (uint64_t)PIT_TICK_NS << VDSO_SHIFT;
+	vdso_data_t* data = (vdso_data_t*)alloc_frame();
+	uint32_t text = alloc_frame();
+	uint32_t* table = (uint32_t*)alloc_frame();
+	uint32_t start, cycles;
+	uint64_t tsc;
+
+	if( data == NULL || text == 0 || table == NULL )
+	{
+		vdso_free((uint32_t)data, text, (uint32_t)table);
+		return -1;
+	}
+
+	/* TSC cycles per PIT tick, from a tick boundary */
+	start = pit_ticks;
+	while( pit_ticks == start )
+		cpu_relax();
+	tsc = rdtsc();
+	start = pit_ticks;
+	while( pit_ticks - start < VDSO_CALIBRATE_TICKS )
+		cpu_relax();
+	cycles = (uint32_t)(rdtsc() - tsc) / VDSO_CALIBRATE_TICKS;
+
+	/* mult has to fit 32 bits */
+	if( cycles <= (uint32_t)(ns_per_tick >> 32) )
+	{
+		vdso_free((uint32_t)data, text, (uint32_t)table);
+		return -1;
+	}
+
+	data->mult = div64_32(ns_per_tick, cycles);
+	data->ticks = pit_ticks;
+	data->ns = (uint64_t)pit_ticks * PIT_TICK_NS;
+	data->sec = rtc_read_time();
+	data->nsec = 0;
+	data->tsc = rdtsc();
+
+	memcpy((void*)text, vdso_text_start, vdso_text_end - vdso_text_start);
+
+	/* user may read (and run) both pages but not write them */
+	table[0] = (uint32_t)data | PAGE_PRESENT | PAGE_USER;
+	table[1] = text | PAGE_PRESENT | PAGE_USER;
+	set_pde_all(VDSO_ADDR / FOUR_MB, (uint32_t)table | PAGE_PRESENT | PAGE_RW | PAGE_USER);
+	smp_flush_tlb();
+
+	/* the PIT handler starts updating once this is set */
+	barrier();
+	vdso_data = data;
+	return 0;
+}
+
+/*
+	vdso_update()
+
+	Description: advances the clock to now. Called by the PIT handler on
+				 the boot CPU, the only writer.
+	Inputs: None
+	Outputs: None
+*/
+void vdso_update()
+{
+	vdso_data_t* data = vdso_data;
+	uint64_t now;
+	uint32_t ns;
+
+	if( data == NULL )
+		return;
+
+	now = rdtsc();
+	ns = (uint32_t)(((uint64_t)(uint32_t)(now - data->tsc) * data->mult) >> VDSO_SHIFT);
+
+	write_seqcount_begin(&data->seq);
+	data->ticks = pit_ticks;
+	data->tsc = now;
+	data->ns += ns;
+	data->nsec += ns;
+	while( data->nsec >= NS_PER_SEC )
+	{
+		data->nsec -= NS_PER_SEC;
+		data->sec++;
+	}
+	write_seqcount_end(&data->seq);
+}
+
+/*
+	vdso_uptime_ns()
+
+	Description: nanoseconds since boot, computed like the user entry
+	Inputs: None
+	Outputs: the time, 0 before vdso_init()
+*/
+uint64_t vdso_uptime_ns()
+{
+	vdso_data_t* data = vdso_data;
+	uint32_t seq;
+	uint64_t ns;
+
+	if( data == NULL )
+		return 0;
+
+	do {
+		seq = read_seqcount_begin(&data->seq);
+		ns = data->ns + (((uint64_t)(uint32_t)(rdtsc() - data->tsc) * data->mult) >> VDSO_SHIFT);
+	} while( read_seqcount_retry(&data->seq, seq) );
+
+	return ns;
+}
@@ -0,0 +1,72 @@
+/*
+	vdso.h
+
+	Read-only kernel data page mapped into every process at VDSO_ADDR
+	(after the terminal vidmap slots), with user-callable readers on the
+	page after it. Programs get the tick count and the time from there
+	without a system call.
+*/
+
+#ifndef _VDSO_H
+#define _VDSO_H
+
+#define VDSO_ADDR 			0x0B400000 	// 180 MB
+#define VDSO_TEXT 			(VDSO_ADDR + 0x1000)
+
+/*
+	Entry points (cdecl) at fixed offsets into VDSO_TEXT:
+		uint32_t ticks(void)            PIT ticks since boot
+		uint64_t uptime_ns(void)        nanoseconds since boot
+		void time(uint32_t tv[2])       Unix seconds and nanoseconds
+*/
+#define VDSO_ENTRY_SIZE 	8
+#define VDSO_TICKS 			(VDSO_TEXT + 0 * VDSO_ENTRY_SIZE)
+#define VDSO_UPTIME_NS 		(VDSO_TEXT + 1 * VDSO_ENTRY_SIZE)
+#define VDSO_TIME 			(VDSO_TEXT + 2 * VDSO_ENTRY_SIZE)
+
+/* vdso_data_t field offsets, for vdso_user.S */
+#define VDSO_SEQ_OFF 		0
+#define VDSO_TICKS_OFF 		4
+#define VDSO_TSC_OFF 		8
+#define VDSO_NS_OFF 		16
+#define VDSO_MULT_OFF 		24
+#define VDSO_SEC_OFF 		28
+#define VDSO_NSEC_OFF 		32
+
+#define VDSO_SHIFT 			24 		/* ns = TSC cycles * mult >> VDSO_SHIFT */
+#define VDSO_CALIBRATE_TICKS 4 		/* PIT ticks to measure the TSC over */
+#define NS_PER_SEC 			1000000000
+
+#ifndef ASM
+
+#include "types.h"
+#include "spinlock.h"
+
+/* written by the boot CPU on every PIT tick, under seq */
+typedef struct vdso_data_t {
+	seqcount_t seq;
+	uint32_t ticks;     /* PIT ticks since boot */
+	uint64_t tsc;       /* TSC at the last update */
+	uint64_t ns;        /* nanoseconds since boot at tsc */
+	uint32_t mult;      /* nanoseconds per TSC cycle << VDSO_SHIFT */
+	uint32_t sec;       /* wall clock at tsc, Unix seconds */
+	uint32_t nsec;      /* and nanoseconds */
+} vdso_data_t;
+
+/* kernel address of the data page, NULL until vdso_init() */
+extern vdso_data_t* vdso_data;
+
+/* sets up and maps the pages; needs the PIT running and interrupts on */
+int32_t vdso_init();
+/* advances the clock (PIT handler) */
+void vdso_update();
+/* nanoseconds since boot, as the user entry computes it */
+uint64_t vdso_uptime_ns();
+
+/* the readers in vdso_user.S, copied to VDSO_TEXT */
+extern uint8_t vdso_text_start[];
+extern uint8_t vdso_text_end[];
+
+#endif /* ASM */
+
+#endif
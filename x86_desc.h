@@ -16,6 +16,10 @@
 #define KERNEL_TSS  0x0030
 #define KERNEL_LDT  0x0038
 
+/* TSS selectors of the application processors (CPU 1 and up) */
+#define NUM_AP_TSS  7
+#define AP_TSS(cpu) (0x0040 + (8 * ((cpu) - 1)))
+
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE    104
 
@@ -123,6 +127,10 @@ extern uint32_t ldt;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t ap_tss_desc_ptr[NUM_AP_TSS];
+
+/* The 6-byte (limit, base) operand for lgdt */
+extern uint16_t gdt_desc_ptr;
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim)                          \